@@ -0,0 +1,17 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <climits>
+
+// Integer arithmetic shared by every execution engine (the tree-walking
+// interpreter, the IR interpreter and its constant folding, and the VM):
+// results wrap around on overflow, computed on unsigned values so that
+// overflow is well defined, and INT_MIN / -1 wraps to INT_MIN. The
+// caller checks for division by zero.
+
+inline int wrap_add(int a, int b) { return int(unsigned(a) + unsigned(b)); }
+inline int wrap_sub(int a, int b) { return int(unsigned(a) - unsigned(b)); }
+inline int wrap_mul(int a, int b) { return int(unsigned(a) * unsigned(b)); }
+inline int wrap_div(int a, int b) { return b == -1 ? wrap_sub(0, a) : a / b; }
+
+#endif // ARITH_H
@@ -67,6 +67,8 @@ std::string ASTTreePrint::node_tag_to_string(int tag) const {
       return "ARGUMENT_LIST";
     case AST_FUNC_CALL:
       return "FUNC_CALL";
+    case AST_LAZY_STMTS:
+      return "LAZY_STATEMENT_LIST";
     default:
       RuntimeError::raise("Unknown AST node type %d\n", tag);
   }
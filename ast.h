@@ -34,7 +34,8 @@ enum ASTKind {
   AST_PARAMS,
   AST_STMTS,
   AST_ARGS,
-  AST_FUNC_CALL
+  AST_FUNC_CALL,
+  AST_LAZY_STMTS  // unparsed function body: the body's source text, see Parser2::set_lazy_functions
 };
 
 class ASTTreePrint : public TreePrint {
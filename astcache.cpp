@@ -0,0 +1,242 @@
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "node.h"
+#include "astcache.h"
+#include "memstats.h"
+
+////////////////////////////////////////////////////////////////////////
+// ASTCache implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const char CACHE_MAGIC[8] = { 'M', 'L', 'A', 'S', 'T', 'C', '\0', '\1' };
+const uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t source_hash;
+  uint32_t num_nodes;
+  uint32_t num_kid_refs;
+  uint32_t strings_size;
+  uint32_t reserved;
+};
+
+struct CacheNode {
+  int32_t tag;
+  uint32_t str_offset;
+  uint32_t str_len;
+  int32_t line;
+  int32_t col;
+  uint32_t first_kid;   // index into the kid array
+  uint32_t num_kids;
+};
+
+// a read-only mapping of a file, unmapped on destruction
+class MappedFile {
+private:
+  void *m_data;
+  size_t m_size;
+
+public:
+  MappedFile(const std::string &path) : m_data(MAP_FAILED), m_size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      m_size = size_t(st.st_size);
+      m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (m_data != MAP_FAILED) munmap(m_data, m_size);
+  }
+
+  bool is_valid() const { return m_data != MAP_FAILED; }
+  const char *get_data() const { return static_cast<const char *>(m_data); }
+  size_t get_size() const { return m_size; }
+};
+
+}
+
+ASTCache::ASTCache(const std::string &cache_dir, const std::string &source_path, FILE *source, uint32_t flags)
+  : m_source_path(source_path)
+  , m_source_hash(14695981039346656037ULL)
+  , m_flags(flags) {
+  assert(can_cache(source));
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), source)) > 0) {
+    m_source_hash = hash_bytes(buf, n, m_source_hash);
+  }
+  rewind(source);
+
+  char name[64];
+  snprintf(name, sizeof(name), "/%016llx-%u.astc", (unsigned long long) m_source_hash, unsigned(m_flags));
+  m_cache_path = cache_dir + name;
+}
+
+ASTCache::~ASTCache() {
+}
+
+bool ASTCache::can_cache(FILE *f) {
+  struct stat st;
+  return fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+Node *ASTCache::load() const {
+  MemoryScope scope(MEM_AST);
+  MappedFile file(m_cache_path);
+  if (!file.is_valid()) {
+    return nullptr;
+  }
+  uint32_t flags;
+  uint64_t source_hash;
+  std::unique_ptr<Node> ast(deserialize(file.get_data(), file.get_size(), m_source_path, flags, source_hash));
+  if (!ast || flags != m_flags || source_hash != m_source_hash) {
+    return nullptr;
+  }
+  return ast.release();
+}
+
+void ASTCache::store(Node *ast) const {
+  std::string image = serialize(ast, m_flags, m_source_hash);
+
+  // write to a temporary file and rename it into place, so a
+  // concurrent run never maps a partially written cache
+  std::string tmp_path = m_cache_path + "." + std::to_string(getpid());
+  FILE *out = fopen(tmp_path.c_str(), "wb");
+  if (!out) {
+    return;
+  }
+  bool ok = fwrite(image.data(), 1, image.size(), out) == image.size();
+  ok = (fclose(out) == 0) && ok;
+  if (!ok || rename(tmp_path.c_str(), m_cache_path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+  }
+}
+
+std::string ASTCache::serialize(Node *ast, uint32_t flags, uint64_t source_hash) {
+  std::vector<CacheNode> nodes;
+  std::vector<uint32_t> kids;
+  std::string strings;
+
+  // assign record indices in preorder, then fill in the child lists
+  std::vector<Node *> order;
+  ast->preorder([&order](Node *n) { order.push_back(n); });
+  std::unordered_map<Node *, uint32_t> index;
+  for (uint32_t i = 0; i < order.size(); i++) {
+    index[order[i]] = i;
+  }
+  for (Node *n : order) {
+    std::string str = n->get_str();
+    CacheNode rec;
+    rec.tag = n->get_tag();
+    rec.str_offset = uint32_t(strings.size());
+    rec.str_len = uint32_t(str.size());
+    rec.line = n->get_loc().get_line();
+    rec.col = n->get_loc().get_col();
+    rec.first_kid = uint32_t(kids.size());
+    rec.num_kids = n->get_num_kids();
+    strings += str;
+    n->each_child([&](Node *kid) { kids.push_back(index[kid]); });
+    nodes.push_back(rec);
+  }
+
+  CacheHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  hdr.version = CACHE_VERSION;
+  hdr.flags = flags;
+  hdr.source_hash = source_hash;
+  hdr.num_nodes = uint32_t(nodes.size());
+  hdr.num_kid_refs = uint32_t(kids.size());
+  hdr.strings_size = uint32_t(strings.size());
+
+  std::string image;
+  image.append(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+  image.append(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof(CacheNode));
+  image.append(reinterpret_cast<const char *>(kids.data()), kids.size() * sizeof(uint32_t));
+  image.append(strings);
+  return image;
+}
+
+Node *ASTCache::deserialize(const char *data, size_t size, const std::string &srcfile,
+                            uint32_t &flags, uint64_t &source_hash) {
+  if (size < sizeof(CacheHeader)) {
+    return nullptr;
+  }
+  const CacheHeader *hdr = reinterpret_cast<const CacheHeader *>(data);
+  if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || hdr->version != CACHE_VERSION || hdr->num_nodes == 0) {
+    return nullptr;
+  }
+  size_t nodes_size = size_t(hdr->num_nodes) * sizeof(CacheNode);
+  size_t kids_size = size_t(hdr->num_kid_refs) * sizeof(uint32_t);
+  if (size != sizeof(CacheHeader) + nodes_size + kids_size + hdr->strings_size) {
+    return nullptr;
+  }
+  const CacheNode *nodes = reinterpret_cast<const CacheNode *>(data + sizeof(CacheHeader));
+  const uint32_t *kids = reinterpret_cast<const uint32_t *>(data + sizeof(CacheHeader) + nodes_size);
+  const char *strings = data + sizeof(CacheHeader) + nodes_size + kids_size;
+
+  // reject out-of-range references rather than trusting the image,
+  // and anything but a tree: each record other than the root must be
+  // the kid of exactly one other (or it would be freed twice, or leak)
+  std::vector<bool> referenced(hdr->num_nodes, false);
+  for (uint32_t i = 0; i < hdr->num_nodes; i++) {
+    const CacheNode &n = nodes[i];
+    if (n.str_offset > hdr->strings_size || n.str_len > hdr->strings_size - n.str_offset
+        || n.first_kid > hdr->num_kid_refs || n.num_kids > hdr->num_kid_refs - n.first_kid) {
+      return nullptr;
+    }
+    // preorder: children always follow their parent
+    for (uint32_t j = 0; j < n.num_kids; j++) {
+      uint32_t kid = kids[n.first_kid + j];
+      if (kid <= i || kid >= hdr->num_nodes || referenced[kid]) {
+        return nullptr;
+      }
+      referenced[kid] = true;
+    }
+  }
+  if (std::find(referenced.begin() + 1, referenced.end(), false) != referenced.end()) {
+    return nullptr;
+  }
+
+  // build the nodes last to first, so that each node's kids (which
+  // follow it) are built before it
+  std::vector<std::unique_ptr<Node>> built(hdr->num_nodes);
+  for (uint32_t i = hdr->num_nodes; i-- > 0; ) {
+    const CacheNode &n = nodes[i];
+    built[i].reset(new Node(n.tag, std::string(strings + n.str_offset, n.str_len)));
+    built[i]->set_loc(Location(srcfile, n.line, n.col));
+    for (uint32_t j = 0; j < n.num_kids; j++) {
+      built[i]->append_kid(built[kids[n.first_kid + j]].release());
+    }
+  }
+
+  flags = hdr->flags;
+  source_hash = hdr->source_hash;
+  return built[0].release();
+}
+
+// 64-bit FNV-1a
+uint64_t ASTCache::hash_bytes(const void *data, size_t len, uint64_t hash) {
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
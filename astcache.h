@@ -0,0 +1,67 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+class Node;
+
+// On-disk cache of the AST parsed from a source file, stored in a
+// cache directory and named by a hash of the source text (and the
+// flags), so repeated runs of an unchanged script skip lexing and
+// parsing.
+//
+// The file is a header, a flat array of fixed-size node records in
+// preorder (the root is record 0), an array of child record indices,
+// and a string table. It contains no pointers, so it is read through
+// a read-only mapping and the AST rebuilt from the records in one pass,
+// without lexing or parsing. It is not used in place: each node is
+// still allocated, with its string and Location copied out of the
+// image, so loading is linear in the size of the AST.
+class ASTCache {
+public:
+  // flags recorded in the cache, which must match for it to be used
+  enum {
+    LAZY_FUNCTIONS = 1,
+  };
+
+private:
+  std::string m_source_path;
+  std::string m_cache_path;
+  uint64_t m_source_hash;
+  uint32_t m_flags;
+
+  // value semantics prohibited
+  ASTCache(const ASTCache &);
+  ASTCache &operator=(const ASTCache &);
+
+public:
+  // hashes the contents of source, which must be a regular file
+  // (it is rewound afterwards)
+  ASTCache(const std::string &cache_dir, const std::string &source_path, FILE *source, uint32_t flags);
+
+  // true if f can be read twice (a regular file, not a pipe or FIFO)
+  static bool can_cache(FILE *f);
+  ~ASTCache();
+
+  // the cached AST, or nullptr if there is no cache or it is stale
+  Node *load() const;
+
+  // write the cache; failure (e.g., a read-only directory) is ignored
+  void store(Node *ast) const;
+
+  // The serialized image of an AST, as stored in cache files (and
+  // embedded in bundled executables). deserialize returns nullptr if
+  // the image is malformed, and otherwise reports the flags and
+  // source hash it was stored with.
+  static std::string serialize(Node *ast, uint32_t flags, uint64_t source_hash);
+  static Node *deserialize(const char *data, size_t size, const std::string &srcfile,
+                           uint32_t &flags, uint64_t &source_hash);
+
+  uint64_t get_source_hash() const { return m_source_hash; }
+  uint32_t get_flags() const { return m_flags; }
+
+  static uint64_t hash_bytes(const void *data, size_t len, uint64_t hash = 14695981039346656037ULL);
+};
+
+#endif // ASTCACHE_H
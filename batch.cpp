@@ -0,0 +1,178 @@
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include "exceptions.h"
+#include "minilang.h"
+#include "threadpool.h"
+#include "prefork.h"
+#include "batch.h"
+
+////////////////////////////////////////////////////////////////////////
+// BatchRunner implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool read_file(const std::string &path, std::string &contents) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::ostringstream buf;
+  buf << in.rdbuf();
+  contents = buf.str();
+  return true;
+}
+
+}
+
+BatchRunner::BatchRunner(unsigned num_threads)
+  : m_num_threads(num_threads)
+  , m_isolate(false)
+  , m_timeout_ms(0)
+  , m_restarts(0)
+  , m_total_ms(0.0) {
+}
+
+BatchRunner::~BatchRunner() {
+}
+
+void BatchRunner::load_manifest(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    RuntimeError::raise("Could not open manifest '%s'", path.c_str());
+  }
+  std::string line;
+  int line_num = 0;
+  while (std::getline(in, line)) {
+    line_num++;
+    std::istringstream fields(line);
+    Job job;
+    if (!(fields >> job.script) || job.script[0] == '#') {
+      continue;
+    }
+    std::string extra;
+    if (!(fields >> job.input_path >> job.output_path) || (fields >> extra)) {
+      RuntimeError::raise("%s:%d: expected 'script input output'", path.c_str(), line_num);
+    }
+    job.program = nullptr;
+    job.wall_ms = 0.0;
+
+    // compile each distinct script once
+    if (m_programs.count(job.script) == 0 && m_compile_errors.count(job.script) == 0) {
+      try {
+        m_programs[job.script].reset(MinilangProgram::compile_file(job.script));
+      } catch (BaseException &ex) {
+        m_programs.erase(job.script);
+        m_compile_errors[job.script] = ex.get_message();
+      }
+    }
+    auto i = m_programs.find(job.script);
+    if (i != m_programs.end()) {
+      job.program = i->second.get();
+    } else {
+      job.compile_error = m_compile_errors[job.script];
+    }
+    m_jobs.push_back(job);
+  }
+}
+
+void BatchRunner::run() {
+  auto start = std::chrono::steady_clock::now();
+  if (m_isolate) {
+    run_forked();
+  } else {
+    run_threads();
+  }
+  m_total_ms = ms_since(start);
+}
+
+unsigned BatchRunner::print_report(FILE *out) const {
+  unsigned failed = 0;
+  for (unsigned i = 0; i < m_jobs.size(); i++) {
+    const Job &job = m_jobs[i];
+    fprintf(out, "job %u: %s < %s > %s: %.3f ms%s%s\n", i + 1, job.script.c_str(), job.input_path.c_str(),
+            job.output_path.c_str(), job.wall_ms, job.error.empty() ? "" : ": ", job.error.c_str());
+    if (!job.error.empty()) {
+      failed++;
+    }
+  }
+  double secs = m_total_ms / 1000.0;
+  fprintf(out, "%u jobs (%u failed) in %.3f s on %u %s: %.1f jobs/s\n", unsigned(m_jobs.size()), failed,
+          secs, m_num_threads, m_isolate ? "processes" : "threads", secs > 0.0 ? m_jobs.size() / secs : 0.0);
+  if (m_isolate && m_restarts > 0) {
+    fprintf(out, "%u worker processes restarted\n", m_restarts);
+  }
+  return failed;
+}
+
+void BatchRunner::run_threads() {
+  // one context per worker, reused by its jobs (and destroyed after
+  // the pool's threads have stopped)
+  std::vector<std::unique_ptr<MinilangContext>> contexts(m_num_threads);
+  WorkStealingPool pool(m_num_threads);
+  for (auto i = m_jobs.begin(); i != m_jobs.end(); ++i) {
+    Job *job = &*i;
+    pool.submit([this, job, &pool, &contexts]() { run_job(*job, contexts[unsigned(pool.get_current_worker())]); });
+  }
+  pool.wait_idle();
+}
+
+void BatchRunner::run_forked() {
+  // the workers inherit m_jobs and the compiled programs; each job's
+  // result comes back as its error message, and the parent times it.
+  // Each worker process reuses its own copy of ctx.
+  std::unique_ptr<MinilangContext> ctx;
+  PreforkPool pool(m_num_threads, [this, &ctx](unsigned i) {
+    run_job(m_jobs[i], ctx);
+    return m_jobs[i].error;
+  });
+  std::vector<std::string> errors;
+  std::vector<double> wall_ms;
+  pool.run(unsigned(m_jobs.size()), m_timeout_ms, errors, wall_ms);
+  for (unsigned i = 0; i < m_jobs.size(); i++) {
+    m_jobs[i].error = errors[i];
+    m_jobs[i].wall_ms = wall_ms[i];
+  }
+  m_restarts = pool.get_restarts();
+}
+
+void BatchRunner::run_job(Job &job, std::unique_ptr<MinilangContext> &ctx) {
+  auto start = std::chrono::steady_clock::now();
+  if (!job.program) {
+    job.error = job.compile_error;
+    job.wall_ms = ms_since(start);
+    return;
+  }
+
+  StringIOHandler io;
+  try {
+    std::string input;
+    if (!read_file(job.input_path, input)) {
+      RuntimeError::raise("Could not open input file '%s'", job.input_path.c_str());
+    }
+    io.reset(input);
+    if (!ctx) {
+      ctx.reset(new MinilangContext(job.program, &io));
+      ctx->set_timeout(m_timeout_ms);
+    } else {
+      ctx->set_program(job.program);
+      ctx->set_io(&io);
+    }
+    Value result = ctx->run();
+    io.get_output() += "Result: " + result.as_str() + "\n";
+  } catch (BaseException &ex) {
+    job.error = ex.get_message();
+  }
+
+  std::ofstream out(job.output_path, std::ios::binary | std::ios::trunc);
+  out << io.get_output();
+  if (!out && job.error.empty()) {
+    job.error = "Error: Could not write output file '" + job.output_path + "'";
+  }
+  job.wall_ms = ms_since(start);
+}
@@ -0,0 +1,71 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+class MinilangProgram;
+class MinilangContext;
+
+// Runs a batch of jobs in one process. The manifest has one job per
+// line, "script input output" (blank lines and lines starting with
+// '#' are ignored). Each distinct script is compiled once and shared
+// by all of its jobs, which run concurrently on a WorkStealingPool,
+// each with its own context and in-memory input and output. A job's
+// output file receives what "minilang script < input" would print on
+// standard output; errors are listed in the report.
+//
+// With process isolation, the jobs run in a PreforkPool instead: the
+// worker processes are forked after the scripts have been compiled,
+// and a job that crashes or times out only takes its worker with it.
+class BatchRunner {
+private:
+  struct Job {
+    std::string script, input_path, output_path;
+    const MinilangProgram *program;
+    std::string compile_error;   // if the script failed to compile
+    std::string error;           // if the job failed
+    double wall_ms;
+  };
+
+  unsigned m_num_threads;
+  bool m_isolate;
+  unsigned m_timeout_ms;
+  unsigned m_restarts;
+  std::vector<Job> m_jobs;
+  std::unordered_map<std::string, std::unique_ptr<MinilangProgram>> m_programs;
+  std::unordered_map<std::string, std::string> m_compile_errors;
+  double m_total_ms;
+
+  // value semantics prohibited
+  BatchRunner(const BatchRunner &);
+  BatchRunner &operator=(const BatchRunner &);
+
+public:
+  BatchRunner(unsigned num_threads);
+  ~BatchRunner();
+
+  // read the manifest and compile its scripts
+  void load_manifest(const std::string &path);
+
+  // run each job in a forked worker process rather than a thread
+  void set_process_isolation(bool isolate) { m_isolate = isolate; }
+  // time limit per job in milliseconds (0, the default, for none)
+  void set_timeout(unsigned timeout_ms) { m_timeout_ms = timeout_ms; }
+
+  void run();
+
+  // per-job status and wall time, then total throughput;
+  // returns the number of failed jobs
+  unsigned print_report(FILE *out) const;
+
+private:
+  void run_threads();
+  void run_forked();
+  // ctx is the calling worker's context, created by its first job
+  void run_job(Job &job, std::unique_ptr<MinilangContext> &ctx);
+};
+
+#endif // BATCH_H
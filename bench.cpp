@@ -0,0 +1,340 @@
+// minilang-bench: runs benchmark programs under minilang and compares
+// the results with a stored baseline (see `make bench`).
+//
+//   minilang-bench [-x minilang] [-a option] [-n runs] [-t percent] [-c results.csv]
+//                  [-b baseline.json | -u baseline.json] file.ml...
+//
+// Each program is run (reading the program from standard input, so
+// that the AST cache isn't used, and discarding its output) n times
+// (default 5) after one warmup run. For each program, the median and
+// 95th percentile wall time, the peak RSS, and the median time of each
+// phase (from the counters that minilang -S reports) are printed. With
+// -b, a median time or peak RSS more than the threshold (-t, default 10
+// percent) above the baseline's is flagged as a regression, and the
+// exit status is 1 if there are any; -u writes the results as the new
+// baseline instead. -a passes an option (such as -k, to only parse and
+// analyze) to minilang along with -S, and -c also writes the results,
+// with each program's size in bytes, as CSV (for plotting).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+namespace {
+
+// differences in median time smaller than this are noise
+const double MIN_REGRESSION_MS = 2.0;
+
+struct Run {
+  double wall_ms;
+  long max_rss_kb;
+  std::vector<std::pair<std::string, double>> phases_ms;   // in order
+};
+
+struct Result {
+  std::string name;
+  long bytes;
+  double median_ms, p95_ms;
+  long peak_rss_kb;
+  std::vector<std::pair<std::string, double>> phases_ms;   // median of each phase
+};
+
+struct Baseline {
+  double median_ms;
+  long peak_rss_kb;
+};
+
+int usage() {
+  fprintf(stderr, "Usage: minilang-bench [-x minilang] [-a option] [-n runs] [-t percent] [-c results.csv]\n"
+                  "                      [-b baseline.json | -u baseline.json] file.ml...\n");
+  return 1;
+}
+
+// the program's name: its file name without the directory or .ml
+std::string program_name(const std::string &path) {
+  size_t slash = path.rfind('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  if (name.size() > 3 && name.compare(name.size() - 3, 3, ".ml") == 0) {
+    name.erase(name.size() - 3);
+  }
+  return name;
+}
+
+// parse the "phases_ms" object of the counters report
+void parse_phases(const std::string &report, std::vector<std::pair<std::string, double>> &phases) {
+  size_t pos = report.find("\"phases_ms\": {");
+  if (pos == std::string::npos) {
+    return;
+  }
+  pos += strlen("\"phases_ms\": {");
+  char name[64];
+  double ms;
+  int len;
+  while (sscanf(report.c_str() + pos, " \"%63[^\"]\": %lf%n", name, &ms, &len) == 2) {
+    phases.push_back(std::make_pair(std::string(name), ms));
+    pos += size_t(len);
+    if (report[pos] != ',') break;
+    pos++;
+  }
+}
+
+// run minilang -S (and the extra option, if any) on the program,
+// returning false if it fails
+bool run_once(const char *minilang, const char *option, const char *path, Run &run) {
+  int in = open(path, O_RDONLY);
+  if (in < 0) {
+    fprintf(stderr, "Could not open %s\n", path);
+    return false;
+  }
+  char report_path[] = "/tmp/minilang-bench-XXXXXX";
+  int report = mkstemp(report_path);
+  if (report < 0) {
+    close(in);
+    fprintf(stderr, "Could not create a temporary file\n");
+    return false;
+  }
+  unlink(report_path);
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int out = open("/dev/null", O_WRONLY);
+    dup2(in, 0);
+    dup2(out, 1);
+    dup2(report, 2);
+    execl(minilang, minilang, "-S", option, static_cast<char *>(nullptr));
+    _exit(127);
+  }
+  close(in);
+  int status = 0;
+  struct rusage usage;
+  if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+    close(report);
+    fprintf(stderr, "Could not run %s\n", minilang);
+    return false;
+  }
+  run.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  run.max_rss_kb = usage.ru_maxrss;
+
+  std::string text;
+  char buf[4096];
+  ssize_t n;
+  lseek(report, 0, SEEK_SET);
+  while ((n = read(report, buf, sizeof(buf))) > 0) {
+    text.append(buf, size_t(n));
+  }
+  close(report);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "%s failed:\n%s", path, text.c_str());
+    return false;
+  }
+  parse_phases(text, run.phases_ms);
+  return true;
+}
+
+// the value at the given percentile (nearest rank) of sorted values
+double percentile(const std::vector<double> &sorted, double pct) {
+  size_t rank = size_t(pct / 100.0 * double(sorted.size()) + 0.999999);
+  return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+bool load_baseline(const char *path, std::map<std::string, Baseline> &baseline) {
+  FILE *in = fopen(path, "r");
+  if (in == nullptr) {
+    return false;
+  }
+  char line[1024], name[256];
+  Baseline b;
+  while (fgets(line, sizeof(line), in) != nullptr) {
+    if (sscanf(line, " \"%255[^\"]\": {\"median_ms\": %lf, \"p95_ms\": %*f, \"peak_rss_kb\": %ld",
+               name, &b.median_ms, &b.peak_rss_kb) == 3) {
+      baseline[name] = b;
+    }
+  }
+  fclose(in);
+  return true;
+}
+
+bool write_baseline(const char *path, const std::vector<Result> &results) {
+  FILE *out = fopen(path, "w");
+  if (out == nullptr) {
+    return false;
+  }
+  fprintf(out, "{\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    fprintf(out, "  \"%s\": {\"median_ms\": %.3f, \"p95_ms\": %.3f, \"peak_rss_kb\": %ld}%s\n",
+            r.name.c_str(), r.median_ms, r.p95_ms, r.peak_rss_kb, i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "}\n");
+  fclose(out);
+  return true;
+}
+
+// one row per program; the phase columns are those of the first program
+bool write_csv(const char *path, const std::vector<Result> &results) {
+  FILE *out = fopen(path, "w");
+  if (out == nullptr) {
+    return false;
+  }
+  fprintf(out, "program,bytes,median_ms,p95_ms,peak_rss_kb");
+  const std::vector<std::pair<std::string, double>> &phases = results.front().phases_ms;
+  for (auto p = phases.begin(); p != phases.end(); ++p) {
+    fprintf(out, ",%s_ms", p->first.c_str());
+  }
+  fprintf(out, "\n");
+  for (auto r = results.begin(); r != results.end(); ++r) {
+    fprintf(out, "%s,%ld,%.3f,%.3f,%ld", r->name.c_str(), r->bytes, r->median_ms, r->p95_ms, r->peak_rss_kb);
+    for (auto p = phases.begin(); p != phases.end(); ++p) {
+      double ms = 0.0;
+      for (auto q = r->phases_ms.begin(); q != r->phases_ms.end(); ++q) {
+        if (q->first == p->first) ms = q->second;
+      }
+      fprintf(out, ",%.3f", ms);
+    }
+    fprintf(out, "\n");
+  }
+  fclose(out);
+  return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+  const char *minilang = "./minilang";
+  const char *option = nullptr;
+  const char *baseline_path = nullptr;
+  const char *csv_path = nullptr;
+  bool update = false;
+  unsigned num_runs = 5;
+  double threshold_pct = 10.0;
+  int opt;
+  while ((opt = getopt(argc, argv, "x:a:n:t:c:b:u:")) != -1) {
+    switch (opt) {
+    case 'x':
+      minilang = optarg;
+      break;
+    case 'a':
+      option = optarg;
+      break;
+    case 'n':
+      num_runs = unsigned(std::max(1, atoi(optarg)));
+      break;
+    case 't':
+      threshold_pct = atof(optarg);
+      break;
+    case 'c':
+      csv_path = optarg;
+      break;
+    case 'b':
+      baseline_path = optarg;
+      break;
+    case 'u':
+      baseline_path = optarg;
+      update = true;
+      break;
+    default:
+      return usage();
+    }
+  }
+  if (optind >= argc) {
+    return usage();
+  }
+
+  std::map<std::string, Baseline> baseline;
+  if (baseline_path != nullptr && !update && !load_baseline(baseline_path, baseline)) {
+    fprintf(stderr, "Could not read baseline %s (create it with -u)\n", baseline_path);
+  }
+
+  std::vector<Result> results;
+  unsigned regressions = 0;
+  printf("%-14s %10s %10s %10s  %-40s %s\n", "program", "median ms", "p95 ms", "peak RSS", "phases (median ms)", "vs. baseline");
+  for (int i = optind; i < argc; i++) {
+    Result r;
+    r.name = program_name(argv[i]);
+    struct stat st;
+    r.bytes = stat(argv[i], &st) == 0 ? long(st.st_size) : 0;
+    std::vector<Run> runs(num_runs);
+    Run warmup;
+    bool ok = run_once(minilang, option, argv[i], warmup);
+    for (unsigned j = 0; ok && j < num_runs; j++) {
+      ok = run_once(minilang, option, argv[i], runs[j]);
+    }
+    if (!ok) {
+      return 1;
+    }
+
+    std::vector<double> walls;
+    r.peak_rss_kb = 0;
+    for (auto j = runs.begin(); j != runs.end(); ++j) {
+      walls.push_back(j->wall_ms);
+      r.peak_rss_kb = std::max(r.peak_rss_kb, j->max_rss_kb);
+    }
+    std::sort(walls.begin(), walls.end());
+    r.median_ms = percentile(walls, 50.0);
+    r.p95_ms = percentile(walls, 95.0);
+    std::string phases;
+    for (auto p = runs[0].phases_ms.begin(); p != runs[0].phases_ms.end(); ++p) {
+      std::vector<double> times;
+      for (auto j = runs.begin(); j != runs.end(); ++j) {
+        for (auto q = j->phases_ms.begin(); q != j->phases_ms.end(); ++q) {
+          if (q->first == p->first) times.push_back(q->second);
+        }
+      }
+      std::sort(times.begin(), times.end());
+      r.phases_ms.push_back(std::make_pair(p->first, percentile(times, 50.0)));
+      char buf[64];
+      snprintf(buf, sizeof(buf), "%s%s %.1f", phases.empty() ? "" : ", ", p->first.c_str(), r.phases_ms.back().second);
+      phases += buf;
+    }
+
+    std::string comparison;
+    auto b = baseline.find(r.name);
+    if (b != baseline.end()) {
+      double time_pct = 100.0 * (r.median_ms / b->second.median_ms - 1.0);
+      double rss_pct = 100.0 * (double(r.peak_rss_kb) / double(b->second.peak_rss_kb) - 1.0);
+      char buf[128];
+      snprintf(buf, sizeof(buf), "time %+.1f%%, RSS %+.1f%%", time_pct, rss_pct);
+      comparison = buf;
+      if ((time_pct > threshold_pct && r.median_ms - b->second.median_ms > MIN_REGRESSION_MS) || rss_pct > threshold_pct) {
+        comparison += "  REGRESSION";
+        regressions++;
+      }
+    } else if (!baseline.empty()) {
+      comparison = "(not in baseline)";
+    }
+    printf("%-14s %10.1f %10.1f %7ld KB  %-40s %s\n", r.name.c_str(), r.median_ms, r.p95_ms, r.peak_rss_kb,
+           phases.c_str(), comparison.c_str());
+    fflush(stdout);
+    results.push_back(r);
+  }
+
+  if (csv_path != nullptr) {
+    if (!write_csv(csv_path, results)) {
+      fprintf(stderr, "Could not write %s\n", csv_path);
+      return 1;
+    }
+    printf("Wrote %s\n", csv_path);
+  }
+  if (update) {
+    if (!write_baseline(baseline_path, results)) {
+      fprintf(stderr, "Could not write baseline %s\n", baseline_path);
+      return 1;
+    }
+    printf("Wrote baseline %s\n", baseline_path);
+  } else if (regressions > 0) {
+    printf("%u regression(s) (threshold %.1f%%)\n", regressions, threshold_pct);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,20 @@
+function add(a, b) { a + b; }
+function sq(x) { x * x; }
+function clamp(x, lo, hi) {
+  var r;
+  r = x;
+  if (x < lo) { r = lo; }
+  if (x > hi) { r = hi; }
+  r;
+}
+function step(acc, i) { clamp(add(acc, sq(i / 10)), 0, 100000); }
+
+var i;
+var acc;
+acc = 0;
+i = 0;
+while (i < 10000) {
+  acc = step(acc, i);
+  i = i + 1;
+}
+acc;
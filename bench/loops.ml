@@ -0,0 +1,18 @@
+var i;
+var j;
+var sum;
+sum = 0;
+i = 0;
+while (i < 250) {
+  j = 0;
+  while (j < 250) {
+    if (i * j / 7 * 7 == i * j) {
+      sum = sum + 1;
+    } else {
+      sum = sum + 2;
+    }
+    j = j + 1;
+  }
+  i = i + 1;
+}
+sum;
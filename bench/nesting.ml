@@ -0,0 +1,169 @@
+var total;
+var k;
+total = 0;
+k = 0;
+while (k < 1000) {
+  var v0;
+  v0 = k + 0;
+  if (v0 >= 0) {
+    var v1;
+    v1 = k + 1;
+    if (v1 >= 0) {
+      var v2;
+      v2 = k + 2;
+      if (v2 >= 0) {
+        var v3;
+        v3 = k + 3;
+        if (v3 >= 0) {
+          var v4;
+          v4 = k + 4;
+          if (v4 >= 0) {
+            var v5;
+            v5 = k + 5;
+            if (v5 >= 0) {
+              var v6;
+              v6 = k + 6;
+              if (v6 >= 0) {
+                var v7;
+                v7 = k + 7;
+                if (v7 >= 0) {
+                  var v8;
+                  v8 = k + 8;
+                  if (v8 >= 0) {
+                    var v9;
+                    v9 = k + 9;
+                    if (v9 >= 0) {
+                      var v10;
+                      v10 = k + 10;
+                      if (v10 >= 0) {
+                        var v11;
+                        v11 = k + 11;
+                        if (v11 >= 0) {
+                          var v12;
+                          v12 = k + 12;
+                          if (v12 >= 0) {
+                            var v13;
+                            v13 = k + 13;
+                            if (v13 >= 0) {
+                              var v14;
+                              v14 = k + 14;
+                              if (v14 >= 0) {
+                                var v15;
+                                v15 = k + 15;
+                                if (v15 >= 0) {
+                                  var v16;
+                                  v16 = k + 16;
+                                  if (v16 >= 0) {
+                                    var v17;
+                                    v17 = k + 17;
+                                    if (v17 >= 0) {
+                                      var v18;
+                                      v18 = k + 18;
+                                      if (v18 >= 0) {
+                                        var v19;
+                                        v19 = k + 19;
+                                        if (v19 >= 0) {
+                                          var v20;
+                                          v20 = k + 20;
+                                          if (v20 >= 0) {
+                                            var v21;
+                                            v21 = k + 21;
+                                            if (v21 >= 0) {
+                                              var v22;
+                                              v22 = k + 22;
+                                              if (v22 >= 0) {
+                                                var v23;
+                                                v23 = k + 23;
+                                                if (v23 >= 0) {
+                                                  var v24;
+                                                  v24 = k + 24;
+                                                  if (v24 >= 0) {
+                                                    var v25;
+                                                    v25 = k + 25;
+                                                    if (v25 >= 0) {
+                                                      var v26;
+                                                      v26 = k + 26;
+                                                      if (v26 >= 0) {
+                                                        var v27;
+                                                        v27 = k + 27;
+                                                        if (v27 >= 0) {
+                                                          var v28;
+                                                          v28 = k + 28;
+                                                          if (v28 >= 0) {
+                                                            var v29;
+                                                            v29 = k + 29;
+                                                            if (v29 >= 0) {
+                                                              var v30;
+                                                              v30 = k + 30;
+                                                              if (v30 >= 0) {
+                                                                var v31;
+                                                                v31 = k + 31;
+                                                                if (v31 >= 0) {
+                                                                  var v32;
+                                                                  v32 = k + 32;
+                                                                  if (v32 >= 0) {
+                                                                    var v33;
+                                                                    v33 = k + 33;
+                                                                    if (v33 >= 0) {
+                                                                      var v34;
+                                                                      v34 = k + 34;
+                                                                      if (v34 >= 0) {
+                                                                        var v35;
+                                                                        v35 = k + 35;
+                                                                        if (v35 >= 0) {
+                                                                          var v36;
+                                                                          v36 = k + 36;
+                                                                          if (v36 >= 0) {
+                                                                            var v37;
+                                                                            v37 = k + 37;
+                                                                            if (v37 >= 0) {
+                                                                              var v38;
+                                                                              v38 = k + 38;
+                                                                              if (v38 >= 0) {
+                                                                                var v39;
+                                                                                v39 = k + 39;
+                                                                                if (v39 >= 0) {
+                                                                                  total = total + v0 + v39;
+                                                                                }
+                                                                              }
+                                                                            }
+                                                                          }
+                                                                        }
+                                                                      }
+                                                                    }
+                                                                  }
+                                                                }
+                                                              }
+                                                            }
+                                                          }
+                                                        }
+                                                      }
+                                                    }
+                                                  }
+                                                }
+                                              }
+                                            }
+                                          }
+                                        }
+                                      }
+                                    }
+                                  }
+                                }
+                              }
+                            }
+                          }
+                        }
+                      }
+                    }
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  k = k + 1;
+}
+total;
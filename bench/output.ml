@@ -0,0 +1,7 @@
+var i;
+i = 0;
+while (i < 40000) {
+  println(i * 31);
+  i = i + 1;
+}
+i;
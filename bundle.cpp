@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "exceptions.h"
+#include "node.h"
+#include "astcache.h"
+#include "bundle.h"
+#include "memstats.h"
+
+////////////////////////////////////////////////////////////////////////
+// Bundle implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const char BUNDLE_MAGIC[8] = { 'M', 'L', 'B', 'U', 'N', 'D', 'L', 'E' };
+const char *SELF_EXE = "/proc/self/exe";
+
+struct BundleTrailer {
+  uint64_t image_offset;
+  uint64_t image_size;
+  uint32_t name_size;   // the source name precedes the trailer
+  uint32_t reserved;
+  char magic[8];
+};
+
+// read the trailer of the executable open as fd (false if there is none)
+bool read_trailer(int fd, off_t file_size, BundleTrailer &trailer) {
+  if (file_size < off_t(sizeof(BundleTrailer))
+      || pread(fd, &trailer, sizeof(trailer), file_size - sizeof(trailer)) != ssize_t(sizeof(trailer))
+      || memcmp(trailer.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+    return false;
+  }
+  return trailer.image_offset + trailer.image_size + trailer.name_size + sizeof(trailer) == uint64_t(file_size);
+}
+
+}
+
+void Bundle::write(const std::string &out_path, Node *ast, const std::string &srcfile) {
+  int in_fd = open(SELF_EXE, O_RDONLY);
+  struct stat st;
+  if (in_fd < 0 || fstat(in_fd, &st) != 0) {
+    RuntimeError::raise("Could not read the minilang executable");
+  }
+
+  // if this executable is itself a bundle, copy only the interpreter
+  BundleTrailer trailer;
+  off_t exe_size = read_trailer(in_fd, st.st_size, trailer) ? off_t(trailer.image_offset) : st.st_size;
+
+  FILE *out = fopen(out_path.c_str(), "wb");
+  if (!out) {
+    close(in_fd);
+    RuntimeError::raise("Could not open output file '%s'", out_path.c_str());
+  }
+  char buf[65536];
+  off_t copied = 0;
+  bool ok = true;
+  while (ok && copied < exe_size) {
+    size_t want = size_t(std::min(off_t(sizeof(buf)), exe_size - copied));
+    ssize_t n = pread(in_fd, buf, want, copied);
+    ok = n > 0 && fwrite(buf, 1, size_t(n), out) == size_t(n);
+    copied += n > 0 ? n : 0;
+  }
+  close(in_fd);
+
+  std::string image = ASTCache::serialize(ast, 0, 0);
+  memset(&trailer, 0, sizeof(trailer));
+  trailer.image_offset = uint64_t(exe_size);
+  trailer.image_size = image.size();
+  trailer.name_size = uint32_t(srcfile.size());
+  memcpy(trailer.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+  ok = ok && fwrite(image.data(), 1, image.size(), out) == image.size()
+          && fwrite(srcfile.data(), 1, srcfile.size(), out) == srcfile.size()
+          && fwrite(&trailer, sizeof(trailer), 1, out) == 1;
+  ok = (fclose(out) == 0) && ok;
+  if (!ok || chmod(out_path.c_str(), 0755) != 0) {
+    RuntimeError::raise("Could not write bundle '%s'", out_path.c_str());
+  }
+}
+
+Node *Bundle::load_embedded() {
+  int fd = open(SELF_EXE, O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  BundleTrailer trailer;
+  if (fstat(fd, &st) != 0 || !read_trailer(fd, st.st_size, trailer)) {
+    close(fd);
+    return nullptr;
+  }
+
+  void *data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    RuntimeError::raise("Could not map the bundled program");
+  }
+  const char *base = static_cast<const char *>(data);
+  std::string srcfile(base + trailer.image_offset + trailer.image_size, trailer.name_size);
+  uint32_t flags;
+  uint64_t source_hash;
+  MemoryScope scope(MEM_AST);
+  Node *ast = ASTCache::deserialize(base + trailer.image_offset, size_t(trailer.image_size), srcfile, flags, source_hash);
+  munmap(data, size_t(st.st_size));
+  if (!ast) {
+    RuntimeError::raise("The bundled program is corrupt");
+  }
+  return ast;
+}
@@ -0,0 +1,31 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <string>
+class Node;
+
+// A bundled executable is a copy of the minilang binary with an
+// analyzed program appended to it:
+//
+//   [executable] [AST image (see ASTCache)] [source name] [trailer]
+//
+// On startup, minilang checks its own executable for the trailer;
+// if present it maps the file, rebuilds the embedded program's AST
+// from the image with ASTCache::deserialize, and runs it, without
+// lexing, parsing, or semantic analysis. As with the cache, the AST
+// is rebuilt (a Node per record) on every start rather than used in
+// place.
+class Bundle {
+private:
+  // prohibit instantiation
+  Bundle();
+
+public:
+  // write a bundle running ast (which must have passed analysis)
+  static void write(const std::string &out_path, Node *ast, const std::string &srcfile);
+
+  // the program embedded in the running executable, if any
+  static Node *load_embedded();
+};
+
+#endif // BUNDLE_H
@@ -0,0 +1,116 @@
+#include "exceptions.h"
+#include "bytecode.h"
+
+namespace {
+
+const char *op_to_str(BytecodeOp op) {
+  switch (op) {
+    case BC_PUSH:          return "push";
+    case BC_POP:           return "pop";
+    case BC_LOAD_LOCAL:    return "load_local";
+    case BC_STORE_LOCAL:   return "store_local";
+    case BC_LOAD_GLOBAL:   return "load_global";
+    case BC_STORE_GLOBAL:  return "store_global";
+    case BC_ADD:           return "add";
+    case BC_SUB:           return "sub";
+    case BC_MUL:           return "mul";
+    case BC_CHKZERO:       return "chkzero";
+    case BC_DIVR:          return "divr";
+    case BC_LT:            return "lt";
+    case BC_LE:            return "le";
+    case BC_GT:            return "gt";
+    case BC_GE:            return "ge";
+    case BC_EQ:            return "eq";
+    case BC_NE:            return "ne";
+    case BC_TRUTH:         return "truth";
+    case BC_JUMP:          return "jump";
+    case BC_JUMP_IF_FALSE: return "jump_if_false";
+    case BC_JUMP_IF_TRUE:  return "jump_if_true";
+    case BC_SET_RESULT:    return "set_result";
+    case BC_BIND_FUNC:     return "bind_func";
+    case BC_CALL:          return "call";
+    case BC_CALLI:         return "calli";
+    case BC_RET:           return "ret";
+    default:
+      RuntimeError::raise("Unknown bytecode op %d", int(op));
+  }
+}
+
+}
+
+Bytecode::Bytecode() {
+}
+
+Bytecode::~Bytecode() {
+  for (auto i = m_functions.begin(); i != m_functions.end(); ++i) {
+    delete *i;
+  }
+}
+
+int Bytecode::add_function(BytecodeFunction *fn) {
+  m_functions.push_back(fn);
+  return int(m_functions.size()) - 1;
+}
+
+int Bytecode::add_global(const std::string &name) {
+  m_globals.push_back(name);
+  return int(m_globals.size()) - 1;
+}
+
+int Bytecode::add_func_slot(const std::string &name) {
+  m_func_slots.push_back(name);
+  return int(m_func_slots.size()) - 1;
+}
+
+int Bytecode::add_intrinsic(const std::string &name, IntrinsicFn fn) {
+  for (unsigned i = 0; i < m_intrinsics.size(); i++) {
+    if (m_intrinsics[i] == fn) {
+      return int(i);
+    }
+  }
+  m_intrinsics.push_back(fn);
+  m_intrinsic_names.push_back(name);
+  return int(m_intrinsics.size()) - 1;
+}
+
+int Bytecode::add_location(const Location &loc) {
+  m_locations.push_back(loc);
+  return int(m_locations.size()) - 1;
+}
+
+void Bytecode::print(FILE *out) const {
+  for (unsigned i = 0; i < m_functions.size(); i++) {
+    const BytecodeFunction *fn = m_functions[i];
+    fprintf(out, "%sfunction %d %s(%u params, %u locals)\n", i > 0 ? "\n" : "", i, fn->name.c_str(), fn->num_params, fn->num_locals);
+    for (unsigned pc = 0; pc < fn->code.size(); pc++) {
+      const BytecodeInstr &ins = fn->code[pc];
+      fprintf(out, "  %4u  %s", pc, op_to_str(ins.op));
+      switch (ins.op) {
+        case BC_PUSH:
+          fprintf(out, " %d", ins.a);
+          break;
+        case BC_LOAD_LOCAL: case BC_STORE_LOCAL:
+          fprintf(out, " %d", ins.a);
+          break;
+        case BC_LOAD_GLOBAL: case BC_STORE_GLOBAL:
+          fprintf(out, " %d (%s)", ins.a, m_globals.at(ins.a).c_str());
+          break;
+        case BC_JUMP: case BC_JUMP_IF_FALSE: case BC_JUMP_IF_TRUE:
+          fprintf(out, " -> %d", int(pc) + 1 + ins.a);
+          break;
+        case BC_BIND_FUNC:
+          fprintf(out, " %d (%s), function %d", ins.a, m_func_slots.at(ins.a).c_str(), ins.b);
+          break;
+        case BC_CALL:
+          fprintf(out, " %d (%s), %d args", ins.a, m_func_slots.at(ins.a).c_str(), ins.b);
+          break;
+        case BC_CALLI:
+          fprintf(out, " %s, %d args", m_intrinsic_names.at(ins.a).c_str(), ins.b);
+          break;
+        default:
+          break;
+      }
+      fprintf(out, "\n");
+    }
+  }
+}
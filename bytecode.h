@@ -0,0 +1,92 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "location.h"
+#include "value.h"
+
+// Linear instruction stream for a simple stack machine,
+// produced by OnePassCompiler and executed by VM.
+// Jump offsets are relative to the following instruction,
+// so straight-line code sequences can be moved as a unit.
+
+enum BytecodeOp {
+  BC_PUSH,            // push constant a
+  BC_POP,             // discard top of stack
+  BC_LOAD_LOCAL,      // push local slot a
+  BC_STORE_LOCAL,     // local slot a = top of stack (not popped)
+  BC_LOAD_GLOBAL,     // push global slot a
+  BC_STORE_GLOBAL,    // global slot a = top of stack (not popped)
+  BC_ADD,
+  BC_SUB,
+  BC_MUL,
+  BC_CHKZERO,         // raise "Division by zero" at location b if top of stack is 0
+  BC_DIVR,            // pop numerator, pop denominator, push quotient
+  BC_LT,
+  BC_LE,
+  BC_GT,
+  BC_GE,
+  BC_EQ,
+  BC_NE,
+  BC_TRUTH,           // replace top of stack with 1 if nonzero, else 0
+  BC_JUMP,            // pc += a
+  BC_JUMP_IF_FALSE,   // pop, then pc += a if the value was 0
+  BC_JUMP_IF_TRUE,    // pop, then pc += a if the value was nonzero
+  BC_SET_RESULT,      // pop into the current frame's statement result
+  BC_BIND_FUNC,       // function slot a = function b
+  BC_CALL,            // call function in slot a with b arguments (location c)
+  BC_CALLI,           // call intrinsic a with b arguments (location c)
+  BC_RET,             // return the current frame's statement result
+};
+
+struct BytecodeInstr {
+  BytecodeOp op;
+  int a, b, c;
+};
+
+struct BytecodeFunction {
+  std::string name;
+  unsigned num_params;
+  unsigned num_locals;  // including parameters
+  std::vector<BytecodeInstr> code;
+};
+
+class Bytecode {
+private:
+  std::vector<BytecodeFunction *> m_functions;  // m_functions[0] is the top-level code
+  std::vector<std::string> m_globals;
+  std::vector<std::string> m_func_slots;
+  std::vector<IntrinsicFn> m_intrinsics;
+  std::vector<std::string> m_intrinsic_names;
+  std::vector<Location> m_locations;
+
+  // value semantics prohibited
+  Bytecode(const Bytecode &);
+  Bytecode &operator=(const Bytecode &);
+
+public:
+  Bytecode();
+  ~Bytecode();
+
+  int add_function(BytecodeFunction *fn);
+  BytecodeFunction *get_function(int index) const { return m_functions.at(index); }
+  unsigned get_num_functions() const { return unsigned(m_functions.size()); }
+
+  int add_global(const std::string &name);
+  unsigned get_num_globals() const { return unsigned(m_globals.size()); }
+
+  int add_func_slot(const std::string &name);
+  unsigned get_num_func_slots() const { return unsigned(m_func_slots.size()); }
+
+  int add_intrinsic(const std::string &name, IntrinsicFn fn);
+  IntrinsicFn get_intrinsic(int index) const { return m_intrinsics.at(index); }
+
+  int add_location(const Location &loc);
+  const Location &get_location(int index) const { return m_locations.at(index); }
+
+  void print(FILE *out) const;
+};
+
+#endif // BYTECODE_H
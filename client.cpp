@@ -0,0 +1,102 @@
+// minilang-client: submits a program to a minilang daemon (minilang -D)
+// and prints its output, as if the program had been run locally.
+//
+//   minilang-client -S socket [-t timeout_ms] [-v] file.ml < input
+//   minilang-client -S socket -H hash [-t timeout_ms] < input
+//   minilang-client -S socket -s
+//
+// -H reruns a program the daemon has cached, by the hash that -v
+// prints; -s prints the daemon's statistics. The exit status is 0 on
+// success, 1 on error, 2 on timeout, and 3 if the hash is unknown.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.h"
+
+namespace {
+
+int usage() {
+  fprintf(stderr, "Usage: minilang-client -S socket [-t timeout_ms] [-v] (file | -H hash | -s)\n");
+  return 1;
+}
+
+}
+
+int main(int argc, char **argv) {
+  const char *socket_path = nullptr;
+  DaemonRequest req;
+  req.op = DAEMON_RUN;
+  req.timeout_ms = 0;
+  req.hash = 0;
+  bool verbose = false, have_hash = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "S:t:H:sv")) != -1) {
+    switch (opt) {
+    case 'S': socket_path = optarg; break;
+    case 't': req.timeout_ms = unsigned(strtoul(optarg, nullptr, 10)); break;
+    case 'H': req.hash = strtoull(optarg, nullptr, 16); have_hash = true; break;
+    case 's': req.op = DAEMON_STATS; break;
+    case 'v': verbose = true; break;
+    default: return usage();
+    }
+  }
+  if (!socket_path || (req.op == DAEMON_RUN && !have_hash && optind >= argc)) {
+    return usage();
+  }
+
+  if (req.op == DAEMON_RUN) {
+    if (!have_hash) {
+      std::ifstream src(argv[optind], std::ios::binary);
+      if (!src) {
+        fprintf(stderr, "Error: Could not open input file '%s'\n", argv[optind]);
+        return 1;
+      }
+      std::ostringstream buf;
+      buf << src.rdbuf();
+      req.source = buf.str();
+    }
+    std::ostringstream input;
+    input << std::cin.rdbuf();
+    req.input = input.str();
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+    fprintf(stderr, "Error: Could not connect to '%s'\n", socket_path);
+    return 1;
+  }
+
+  DaemonResponse resp;
+  if (!send_request(fd, req) || !recv_response(fd, resp)) {
+    fprintf(stderr, "Error: lost connection to the server\n");
+    return 1;
+  }
+  close(fd);
+
+  fwrite(resp.output.data(), 1, resp.output.size(), stdout);
+  if (!resp.error.empty()) {
+    fprintf(stderr, "%s\n", resp.error.c_str());
+  }
+  if (verbose && req.op == DAEMON_RUN) {
+    fprintf(stderr, "hash: %016llx\n", (unsigned long long) resp.hash);
+  }
+  switch (resp.status) {
+  case DAEMON_OK:           return 0;
+  case DAEMON_TIMEOUT:      return 2;
+  case DAEMON_UNKNOWN_HASH: return 3;
+  default:                  return 1;
+  }
+}
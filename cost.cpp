@@ -0,0 +1,482 @@
+#include <cassert>
+#include <algorithm>
+#include "ast.h"
+#include "cpputil.h"
+#include "node.h"
+#include "parser2.h"
+#include "interp.h"
+#include "cost.h"
+
+////////////////////////////////////////////////////////////////////////
+// CostEstimator implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+uint64_t add_work(uint64_t a, uint64_t b) {
+  return a > CostEstimator::UNBOUNDED - b ? CostEstimator::UNBOUNDED : a + b;
+}
+
+std::string format_work(uint64_t work) {
+  return work == CostEstimator::UNBOUNDED ? "null" : std::to_string(work);
+}
+
+// intrinsics that can't assign variables or run user code
+bool is_simple_intrinsic(const std::string &name) {
+  return name == "print" || name == "println" || name == "readint";
+}
+
+unsigned long long ull(uint64_t n) {
+  return static_cast<unsigned long long>(n);
+}
+
+}
+
+CostEstimator::CostEstimator()
+  : m_ast_nodes(0)
+  , m_max_nesting(0)
+  , m_indirect_calls(0) {
+}
+
+CostEstimator::~CostEstimator() {
+}
+
+void CostEstimator::estimate(Node *unit) {
+  assert(unit->get_tag() == AST_UNIT);
+
+  // the top-level functions, by name (a name may be redefined)
+  for (auto i = unit->cbegin(); i != unit->cend(); ++i) {
+    if ((*i)->get_tag() != AST_FUNC) continue;
+    Function func;
+    func.name = (*i)->get_kid(0)->get_str();
+    func.def = *i;
+    func.recursive = func.visiting = func.done = false;
+    func.work = 0;
+    func.loop_depth = 0;
+    func.reads_input = func.starts_tasks = false;
+    m_defs[func.name].push_back(unsigned(m_funcs.size()));
+    m_funcs.push_back(func);
+  }
+
+  Context top;
+  top.function = -1;
+  top.region = &m_top_level;
+  top.refs = &m_top_level_refs;
+  top.nesting = 0;
+  top.loop_depth = 0;
+  m_ast_nodes++;
+  unsigned next_func = 0;
+  for (auto i = unit->cbegin(); i != unit->cend(); ++i) {
+    Node *stmt = *i;
+    if (stmt->get_tag() != AST_FUNC) {
+      visit(stmt, top);
+      continue;
+    }
+    // as in check_vars, a body sees the names defined before it
+    Function &func = m_funcs[next_func];
+    Context ctx;
+    ctx.function = int(next_func++);
+    ctx.region = &func.body;
+    ctx.refs = &func.refs;
+    ctx.nesting = 0;
+    ctx.loop_depth = 0;
+    m_ast_nodes += 2;   // the AST_FUNC and its name
+    if (stmt->get_num_kids() == 3) {
+      Node *params = stmt->get_kid(1);
+      m_ast_nodes += 1 + params->get_num_kids();
+    }
+    size_t mark = m_declared.size();
+    if (stmt->get_num_kids() == 3) {
+      Node *params = stmt->get_kid(1);
+      for (auto j = params->cbegin(); j != params->cend(); ++j) {
+        declare((*j)->get_str());
+      }
+    }
+    Node *body = stmt->get_last_kid();
+    if (body->get_tag() == AST_LAZY_STMTS) {
+      m_parsed_bodies.emplace_back(Parser2::parse_lazy_body(body));
+      body = m_parsed_bodies.back().get();
+    }
+    visit(body, ctx);
+    undeclare(mark);
+  }
+
+  find_cycles();
+
+  // reading input and starting tasks propagate to callers
+  for (auto i = m_funcs.begin(); i != m_funcs.end(); ++i) {
+    std::vector<const Region *> regions(1, &i->body);
+    while (!regions.empty()) {
+      const Region *region = regions.back();
+      regions.pop_back();
+      i->reads_input = i->reads_input || region->reads_input;
+      i->starts_tasks = i->starts_tasks || region->starts_tasks;
+      for (auto j = region->loops.begin(); j != region->loops.end(); ++j) {
+        regions.push_back(&m_loops[*j].body);
+      }
+    }
+  }
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (auto i = m_funcs.begin(); i != m_funcs.end(); ++i) {
+      for (auto j = i->refs.begin(); j != i->refs.end(); ++j) {
+        const Function &callee = m_funcs[*j];
+        if ((callee.reads_input && !i->reads_input) || (callee.starts_tasks && !i->starts_tasks)) {
+          i->reads_input = i->reads_input || callee.reads_input;
+          i->starts_tasks = i->starts_tasks || callee.starts_tasks;
+          changed = true;
+        }
+      }
+    }
+  }
+  for (unsigned i = 0; i < m_funcs.size(); i++) {
+    compute(i);
+  }
+}
+
+void CostEstimator::visit(Node *node, Context &ctx) {
+  m_ast_nodes++;
+  ctx.region->nodes++;
+  switch (node->get_tag()) {
+  case AST_VARDEF:
+    m_ast_nodes++;
+    declare(node->get_kid(0)->get_str());
+    return;
+  case AST_EQUAL:
+    // the assigned variable, then the value
+    m_ast_nodes++;
+    visit(node->get_kid(1), ctx);
+    return;
+  case AST_VARREF: {
+    // a function used as a value may be called
+    std::vector<unsigned> targets;
+    if (resolve(node->get_str(), ctx, targets) > 0) {
+      ctx.refs->insert(ctx.refs->end(), targets.begin(), targets.end());
+    }
+    return;
+  }
+  case AST_FUNC_CALL:
+    visit_call(node, ctx);
+    return;
+  case AST_WHILE:
+    visit_loop(node, ctx, false);
+    return;
+  case AST_STMTS: {
+    // a block's names are its own
+    Context inner(ctx);
+    inner.nesting++;
+    m_max_nesting = std::max(m_max_nesting, inner.nesting);
+    size_t mark = m_declared.size();
+    for (auto i = node->cbegin(); i != node->cend(); ++i) {
+      visit(*i, inner);
+    }
+    undeclare(mark);
+    return;
+  }
+  default:
+    for (auto i = node->cbegin(); i != node->cend(); ++i) {
+      visit(*i, ctx);
+    }
+  }
+}
+
+void CostEstimator::visit_call(Node *call, Context &ctx) {
+  const std::string &name = call->get_kid(0)->get_str();
+  Node *args = call->get_num_kids() > 1 ? call->get_kid(1) : nullptr;
+  m_ast_nodes++;
+  std::vector<unsigned> targets;
+  int kind = resolve(name, ctx, targets);
+  if (kind > 0) {
+    ctx.region->calls.insert(ctx.region->calls.end(), targets.begin(), targets.end());
+    ctx.refs->insert(ctx.refs->end(), targets.begin(), targets.end());
+  } else if (kind < 0) {
+    m_indirect_calls++;
+  } else if (name == "readint") {
+    ctx.region->reads_input = true;
+  } else if (name == "spawn" || name == "parfor") {
+    ctx.region->starts_tasks = true;
+    // spawn calls its first argument once; parfor repeatedly
+    std::vector<unsigned> task_targets;
+    Node *func = args != nullptr ? args->get_kid(0) : nullptr;
+    if (func != nullptr && func->get_tag() == AST_VARREF && resolve(func->get_str(), ctx, task_targets) > 0) {
+      if (name == "spawn") {
+        ctx.region->calls.insert(ctx.region->calls.end(), task_targets.begin(), task_targets.end());
+      }
+    } else {
+      m_indirect_calls++;
+    }
+    if (name == "parfor") {
+      visit_loop(call, ctx, true);
+    }
+  }
+  if (args != nullptr) {
+    visit(args, ctx);
+  }
+}
+
+// a while loop, or the iterations of a parfor (whose arguments are
+// visited by the caller)
+void CostEstimator::visit_loop(Node *node, Context &ctx, bool is_parfor) {
+  unsigned index = unsigned(m_loops.size());
+  m_loops.emplace_back();
+  Loop &loop = m_loops.back();
+  loop.loc = node->get_loc();
+  loop.function = ctx.function;
+  loop.depth = ctx.loop_depth + 1;
+  loop.is_parfor = is_parfor;
+  loop.never_terminates = !is_parfor && never_terminates(node);
+  ctx.region->loops.push_back(index);
+
+  Context inner(ctx);
+  inner.region = &loop.body;
+  inner.loop_depth++;
+  if (is_parfor) {
+    // each iteration is a call
+    Node *func = node->get_num_kids() > 1 ? node->get_kid(1)->get_kid(0) : nullptr;
+    std::vector<unsigned> targets;
+    loop.body.nodes++;
+    if (func != nullptr && func->get_tag() == AST_VARREF && resolve(func->get_str(), ctx, targets) > 0) {
+      loop.body.calls = targets;
+    }
+  } else {
+    visit(node->get_kid(0), inner);
+    visit(node->get_kid(1), inner);
+  }
+}
+
+void CostEstimator::declare(const std::string &name) {
+  m_declared.push_back(name);
+  m_shadowed[name]++;
+}
+
+// forget the names declared since the mark (on leaving their block)
+void CostEstimator::undeclare(size_t mark) {
+  while (m_declared.size() > mark) {
+    m_shadowed[m_declared.back()]--;
+    m_declared.pop_back();
+  }
+}
+
+// 1 if the name refers to top-level functions (returned in targets),
+// 0 for an intrinsic, or -1 if it is a variable or parameter
+int CostEstimator::resolve(const std::string &name, const Context &ctx, std::vector<unsigned> &targets) const {
+  auto shadowed = m_shadowed.find(name);
+  if (shadowed != m_shadowed.end() && shadowed->second > 0) {
+    return -1;
+  }
+  auto i = m_defs.find(name);
+  if (i != m_defs.end()) {
+    targets = i->second;
+    return 1;
+  }
+  return Interpreter::lookup_intrinsic(name) != nullptr ? 0 : -1;
+}
+
+// whether a while loop, once entered, can never end: its condition is
+// a nonzero constant, or depends only on variables that nothing run by
+// the loop assigns
+bool CostEstimator::never_terminates(Node *loop) {
+  Node *cond = loop->get_kid(0);
+  if (cond->get_tag() == AST_INT_LITERAL) {
+    return std::stoi(cond->get_str()) != 0;
+  }
+  std::unordered_set<std::string> vars;
+  bool calls = false;
+  cond->preorder([&vars, &calls](Node *n) {
+    if (n->get_tag() == AST_FUNC_CALL) calls = true;
+    if (n->get_tag() == AST_VARREF) vars.insert(n->get_str());
+  });
+  if (calls || vars.empty()) {
+    return false;
+  }
+  bool assigns = false;
+  loop->get_kid(1)->preorder([&vars, &assigns](Node *n) {
+    if (n->get_tag() == AST_FUNC_CALL && !is_simple_intrinsic(n->get_kid(0)->get_str())) assigns = true;
+    if (n->get_tag() == AST_EQUAL && vars.count(n->get_kid(0)->get_str()) > 0) assigns = true;
+  });
+  return !assigns;
+}
+
+// find the call graph's cycles (Tarjan's strongly connected components)
+void CostEstimator::find_cycles() {
+  unsigned n = unsigned(m_funcs.size()), next_index = 0;
+  std::vector<unsigned> index(n, UINT32_MAX), low(n, 0), stack;
+  std::vector<bool> on_stack(n, false);
+  // explicit stack of (function, next ref), so deep call chains don't
+  // recurse
+  std::vector<std::pair<unsigned, unsigned>> work;
+  for (unsigned root = 0; root < n; root++) {
+    if (index[root] != UINT32_MAX) continue;
+    work.push_back(std::make_pair(root, 0u));
+    while (!work.empty()) {
+      unsigned v = work.back().first, &next = work.back().second;
+      if (next == 0 && index[v] == UINT32_MAX) {
+        index[v] = low[v] = next_index++;
+        stack.push_back(v);
+        on_stack[v] = true;
+      }
+      if (next < m_funcs[v].refs.size()) {
+        unsigned w = m_funcs[v].refs[next++];
+        if (w == v) {
+          m_funcs[v].recursive = true;
+        }
+        if (index[w] == UINT32_MAX) {
+          work.push_back(std::make_pair(w, 0u));
+        } else if (on_stack[w]) {
+          low[v] = std::min(low[v], index[w]);
+        }
+        continue;
+      }
+      work.pop_back();
+      if (!work.empty()) {
+        unsigned parent = work.back().first;
+        low[parent] = std::min(low[parent], low[v]);
+      }
+      if (low[v] != index[v]) continue;
+      std::vector<unsigned> component;
+      unsigned w;
+      do {
+        w = stack.back();
+        stack.pop_back();
+        on_stack[w] = false;
+        component.push_back(w);
+      } while (w != v);
+      if (component.size() > 1 || m_funcs[v].recursive) {
+        for (auto i = component.begin(); i != component.end(); ++i) {
+          m_funcs[*i].recursive = true;
+        }
+        std::reverse(component.begin(), component.end());
+        m_cycles.push_back(component);
+      }
+    }
+  }
+}
+
+void CostEstimator::compute(unsigned index) {
+  Function &func = m_funcs[index];
+  if (func.done || func.visiting) {
+    return;
+  }
+  func.visiting = true;
+  func.work = func.recursive ? UNBOUNDED : region_work(func.body);
+  func.loop_depth = region_loop_depth(func.body);
+  func.visiting = false;
+  func.done = true;
+}
+
+uint64_t CostEstimator::region_work(const Region &region) {
+  uint64_t work = region.nodes;
+  for (auto i = region.calls.begin(); i != region.calls.end(); ++i) {
+    compute(*i);
+    work = add_work(work, m_funcs[*i].done ? m_funcs[*i].work : UNBOUNDED);
+  }
+  // a nested loop's trip count isn't known
+  return region.loops.empty() ? work : UNBOUNDED;
+}
+
+// the deepest nesting of loops run by the region (a recursive cycle
+// counts its loops once)
+unsigned CostEstimator::region_loop_depth(const Region &region) {
+  unsigned depth = 0;
+  for (auto i = region.calls.begin(); i != region.calls.end(); ++i) {
+    compute(*i);
+    depth = std::max(depth, m_funcs[*i].loop_depth);
+  }
+  for (auto i = region.loops.begin(); i != region.loops.end(); ++i) {
+    depth = std::max(depth, 1 + region_loop_depth(m_loops[*i].body));
+  }
+  return depth;
+}
+
+bool CostEstimator::region_reads_input(const Region &region) {
+  if (region.reads_input) return true;
+  for (auto i = region.calls.begin(); i != region.calls.end(); ++i) {
+    if (m_funcs[*i].reads_input) return true;
+  }
+  for (auto i = region.loops.begin(); i != region.loops.end(); ++i) {
+    if (region_reads_input(m_loops[*i].body)) return true;
+  }
+  return false;
+}
+
+bool CostEstimator::region_starts_tasks(const Region &region) {
+  if (region.starts_tasks) return true;
+  for (auto i = region.calls.begin(); i != region.calls.end(); ++i) {
+    if (m_funcs[*i].starts_tasks) return true;
+  }
+  for (auto i = region.loops.begin(); i != region.loops.end(); ++i) {
+    if (region_starts_tasks(m_loops[*i].body)) return true;
+  }
+  return false;
+}
+
+void CostEstimator::reachable_from(const std::vector<unsigned> &roots, std::vector<bool> &reachable) const {
+  reachable.assign(m_funcs.size(), false);
+  std::vector<unsigned> worklist(roots);
+  while (!worklist.empty()) {
+    unsigned f = worklist.back();
+    worklist.pop_back();
+    if (reachable[f]) continue;
+    reachable[f] = true;
+    worklist.insert(worklist.end(), m_funcs[f].refs.begin(), m_funcs[f].refs.end());
+  }
+}
+
+void CostEstimator::print_json(FILE *out) {
+  std::vector<bool> reachable;
+  reachable_from(m_top_level_refs, reachable);
+  unsigned num_reachable = 0;
+  bool recursion = false;
+  bool reads_input = region_reads_input(m_top_level), starts_tasks = region_starts_tasks(m_top_level);
+  std::string recursive;
+  for (unsigned i = 0; i < m_funcs.size(); i++) {
+    const Function &func = m_funcs[i];
+    if (func.recursive) {
+      recursive += (recursive.empty() ? "\"" : ", \"") + func.name + "\"";
+    }
+    if (!reachable[i]) continue;
+    num_reachable++;
+    recursion = recursion || func.recursive;
+    reads_input = reads_input || func.reads_input;
+    starts_tasks = starts_tasks || func.starts_tasks;
+  }
+
+  std::string cycles;
+  for (auto i = m_cycles.begin(); i != m_cycles.end(); ++i) {
+    std::string names;
+    for (auto j = i->begin(); j != i->end(); ++j) {
+      names += (names.empty() ? "\"" : ", \"") + m_funcs[*j].name + "\"";
+    }
+    cycles += (cycles.empty() ? "[" : ", [") + names + "]";
+  }
+
+  bool reject = false;
+  std::string loops;
+  for (auto i = m_loops.begin(); i != m_loops.end(); ++i) {
+    bool live = i->function < 0 || reachable[unsigned(i->function)];
+    reject = reject || (live && i->never_terminates);
+    loops += cpputil::format("%s{\"loc\": \"%s:%d:%d\", \"function\": %s, \"kind\": \"%s\", \"depth\": %u, "
+                             "\"work_per_iteration\": %s, \"nested_loop_depth\": %u, \"reads_input\": %s, "
+                             "\"never_terminates\": %s, \"reachable\": %s}",
+                             loops.empty() ? "" : ", ", i->loc.get_srcfile().c_str(), i->loc.get_line(), i->loc.get_col(),
+                             i->function < 0 ? "null" : ("\"" + m_funcs[unsigned(i->function)].name + "\"").c_str(),
+                             i->is_parfor ? "parfor" : "while", i->depth, format_work(region_work(i->body)).c_str(),
+                             region_loop_depth(i->body), region_reads_input(i->body) ? "true" : "false",
+                             i->never_terminates ? "true" : "false", live ? "true" : "false");
+  }
+
+  unsigned max_loop_depth = region_loop_depth(m_top_level);
+  const char *cost_class = "light";
+  if (reject) {
+    cost_class = "reject";
+  } else if (recursion || max_loop_depth >= HEAVY_LOOP_DEPTH || starts_tasks || m_ast_nodes > HEAVY_AST_NODES) {
+    cost_class = "heavy";
+  }
+
+  fprintf(out, "{\"class\": \"%s\", \"ast_nodes\": %llu, \"max_nesting\": %u, ", cost_class, ull(m_ast_nodes), m_max_nesting);
+  fprintf(out, "\"functions\": %zu, \"reachable_functions\": %u, \"recursive_functions\": [%s], \"call_cycles\": [%s], ",
+          m_funcs.size(), num_reachable, recursive.c_str(), cycles.c_str());
+  fprintf(out, "\"indirect_calls\": %u, \"max_loop_depth\": %u, \"loops\": [%s], ", m_indirect_calls, max_loop_depth, loops.c_str());
+  fprintf(out, "\"reads_input\": %s, \"starts_tasks\": %s, \"estimated_work\": %s}\n",
+          reads_input ? "true" : "false", starts_tasks ? "true" : "false", format_work(region_work(m_top_level)).c_str());
+}
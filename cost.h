@@ -0,0 +1,130 @@
+#ifndef COST_H
+#define COST_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "location.h"
+class Node;
+
+// Estimates the cost of running an analyzed program, without running
+// it, so that a scheduler can admit, route, or reject it: the AST's
+// size and deepest block nesting, each while loop (and parfor) with
+// the work of one iteration, the call graph's cycles, and whether the
+// program reads input or starts tasks.
+//
+// The traversal follows Interpreter::check_vars: a block sees the
+// names visible in the enclosing one (the variables a block declares
+// are forgotten when it ends, rather than copying the set for each
+// block), so a call resolves to the top-level functions of that name
+// unless a variable or parameter shadows it (a call through a variable
+// is counted as indirect). Work is measured in AST nodes executed,
+// taking both branches of an if and adding the work of each function
+// called; trip counts aren't known, so work through a loop (beyond one
+// iteration of its own body) or a recursive function is unbounded. A loop whose condition is a nonzero constant, or reads
+// only variables that the body doesn't assign (and calls no user
+// functions or task intrinsics), never terminates once entered.
+//
+// The program is classed as "reject" if a loop reachable from the
+// top level never terminates; "heavy" if it reaches recursion, loops
+// nested (directly or through calls) HEAVY_LOOP_DEPTH deep, tasks, or
+// more than HEAVY_AST_NODES nodes; and "light" otherwise.
+class CostEstimator {
+public:
+  static const uint64_t UNBOUNDED = UINT64_MAX;
+  static const unsigned HEAVY_LOOP_DEPTH = 2;
+  static const unsigned HEAVY_AST_NODES = 100000;
+
+private:
+  // the code directly in a function, at the top level, or in a loop
+  // body (without the loops nested in it)
+  struct Region {
+    uint64_t nodes;
+    std::vector<unsigned> calls;      // functions called (once per call site)
+    std::vector<unsigned> loops;      // loops nested directly in it
+    bool reads_input;                 // calls readint
+    bool starts_tasks;                // calls spawn or parfor
+
+    Region() : nodes(0), reads_input(false), starts_tasks(false) { }
+  };
+
+  struct Function {
+    std::string name;
+    Node *def;
+    Region body;
+    std::vector<unsigned> refs;       // functions called or referenced
+    bool recursive;
+    // computed on demand
+    bool visiting, done;
+    uint64_t work;
+    unsigned loop_depth;
+    bool reads_input, starts_tasks;
+  };
+
+  struct Loop {
+    Location loc;
+    int function;                     // -1 at the top level
+    unsigned depth;                   // loops enclosing it in its function, plus one
+    bool is_parfor;
+    bool never_terminates;
+    Region body;                      // condition and body
+  };
+
+  std::vector<Function> m_funcs;
+  std::unordered_map<std::string, std::vector<unsigned>> m_defs;
+  std::deque<Loop> m_loops;                       // stable, while regions are filled
+  Region m_top_level;
+  std::vector<unsigned> m_top_level_refs;
+  std::vector<std::vector<unsigned>> m_cycles;
+  std::unordered_map<std::string, unsigned> m_shadowed;  // variables and parameters in scope
+  std::vector<std::string> m_declared;                   // in the order declared
+  std::vector<std::unique_ptr<Node>> m_parsed_bodies;  // of lazily parsed functions
+  uint64_t m_ast_nodes;
+  unsigned m_max_nesting;
+  unsigned m_indirect_calls;
+
+  // value semantics prohibited
+  CostEstimator(const CostEstimator &);
+  CostEstimator &operator=(const CostEstimator &);
+
+public:
+  CostEstimator();
+  ~CostEstimator();
+
+  void estimate(Node *unit);
+
+  // print the cost profile as one line of JSON
+  void print_json(FILE *out);
+
+private:
+  // the state of the traversal at a node
+  struct Context {
+    int function;
+    Region *region;
+    std::vector<unsigned> *refs;
+    unsigned nesting;
+    unsigned loop_depth;
+  };
+
+  void visit(Node *node, Context &ctx);
+  void visit_call(Node *call, Context &ctx);
+  void visit_loop(Node *node, Context &ctx, bool is_parfor);
+  void declare(const std::string &name);
+  void undeclare(size_t mark);
+  int resolve(const std::string &name, const Context &ctx, std::vector<unsigned> &targets) const;
+  bool never_terminates(Node *loop);
+  void find_cycles();
+  void compute(unsigned func);
+  uint64_t region_work(const Region &region);
+  unsigned region_loop_depth(const Region &region);
+  bool region_reads_input(const Region &region);
+  bool region_starts_tasks(const Region &region);
+  void reachable_from(const std::vector<unsigned> &roots, std::vector<bool> &reachable) const;
+};
+
+#endif // COST_H
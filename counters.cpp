@@ -0,0 +1,185 @@
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include "cpputil.h"
+#include "counters.h"
+
+namespace {
+
+// one thread's counts
+struct Block {
+  uint64_t nodes[Counters::NUM_NODE_TAGS + 1];   // the last is for unknown tags
+  uint64_t envs_created, lookups, lookup_steps;
+  uint64_t valreps_allocated, valreps_freed;
+  uint64_t bytes_read, bytes_written;
+};
+
+// counts summed over threads
+struct Totals : Block {
+  std::map<std::string, uint64_t> calls;
+
+  Totals() : Block() { }
+  void add(const Block &block);
+  void add(const std::unordered_map<std::string, uint64_t> &calls);
+};
+
+// a thread's call counts, and its registration
+struct ThreadCounts {
+  Block *block;                     // the thread's block, once it is attached
+  std::unordered_map<std::string, uint64_t> calls;
+
+  ThreadCounts() : block(nullptr) { }
+  ~ThreadCounts();
+};
+
+std::mutex g_lock;                       // protects the three below
+std::vector<ThreadCounts *> g_threads;   // attached threads
+Totals g_exited;                         // counts of attached threads that have exited
+std::vector<std::pair<const char *, double>> g_phases;   // in the order first recorded
+
+// zero-initialized, and separate from t_calls, so that counting
+// doesn't have to check whether the thread's block was constructed
+thread_local Block t_block;
+thread_local ThreadCounts t_calls;
+
+void Totals::add(const Block &block) {
+  for (unsigned i = 0; i <= Counters::NUM_NODE_TAGS; i++) {
+    nodes[i] += block.nodes[i];
+  }
+  envs_created += block.envs_created;
+  lookups += block.lookups;
+  lookup_steps += block.lookup_steps;
+  valreps_allocated += block.valreps_allocated;
+  valreps_freed += block.valreps_freed;
+  bytes_read += block.bytes_read;
+  bytes_written += block.bytes_written;
+}
+
+void Totals::add(const std::unordered_map<std::string, uint64_t> &thread_calls) {
+  for (auto i = thread_calls.begin(); i != thread_calls.end(); ++i) {
+    calls[i->first] += i->second;
+  }
+}
+
+// runs on the exiting thread
+ThreadCounts::~ThreadCounts() {
+  std::lock_guard<std::mutex> guard(g_lock);
+  g_exited.add(t_block);
+  g_exited.add(calls);
+  if (block != nullptr) {
+    g_threads.erase(std::find(g_threads.begin(), g_threads.end(), this));
+  }
+}
+
+unsigned long long ull(uint64_t n) {
+  return static_cast<unsigned long long>(n);
+}
+
+}
+
+void Counters::count_node(int tag) {
+  unsigned i = unsigned(tag - AST_ADD);
+  t_block.nodes[i < NUM_NODE_TAGS ? i : NUM_NODE_TAGS]++;
+}
+
+void Counters::count_env_created() {
+  t_block.envs_created++;
+}
+
+void Counters::count_lookup() {
+  t_block.lookups++;
+}
+
+void Counters::count_lookup_step() {
+  t_block.lookup_steps++;
+}
+
+void Counters::count_calls(const std::string &func_name, uint64_t n) {
+  if (n == 0) {
+    return;
+  }
+  t_calls.calls[func_name] += n;
+}
+
+void Counters::count_valrep_allocated() {
+  t_block.valreps_allocated++;
+}
+
+void Counters::count_valrep_freed() {
+  t_block.valreps_freed++;
+}
+
+void Counters::count_bytes_read(size_t n) {
+  t_block.bytes_read += n;
+}
+
+void Counters::count_bytes_written(size_t n) {
+  t_block.bytes_written += n;
+}
+
+void Counters::record_phase(const char *name, double ms) {
+  std::lock_guard<std::mutex> guard(g_lock);
+  for (auto i = g_phases.begin(); i != g_phases.end(); ++i) {
+    if (strcmp(i->first, name) == 0) {
+      i->second += ms;
+      return;
+    }
+  }
+  g_phases.push_back(std::make_pair(name, ms));
+}
+
+void Counters::attach_thread() {
+  if (t_calls.block != nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(g_lock);
+  t_calls.block = &t_block;
+  g_threads.push_back(&t_calls);
+}
+
+void Counters::print_json(FILE *out) {
+  attach_thread();
+  Totals totals;
+  std::string phases;
+  {
+    std::lock_guard<std::mutex> guard(g_lock);
+    for (auto i = g_phases.begin(); i != g_phases.end(); ++i) {
+      phases += cpputil::format("%s\"%s\": %.3f", phases.empty() ? "" : ", ", i->first, i->second);
+    }
+    totals = g_exited;
+    for (auto i = g_threads.begin(); i != g_threads.end(); ++i) {
+      totals.add(*(*i)->block);
+      totals.add((*i)->calls);
+    }
+  }
+
+  ASTTreePrint tags;
+  uint64_t num_nodes = 0;
+  std::string by_tag;
+  for (unsigned i = 0; i <= NUM_NODE_TAGS; i++) {
+    if (totals.nodes[i] == 0) continue;
+    num_nodes += totals.nodes[i];
+    std::string name = i < NUM_NODE_TAGS ? tags.node_tag_to_string(int(AST_ADD + i)) : "other";
+    by_tag += (by_tag.empty() ? "\"" : ", \"") + name + "\": " + std::to_string(totals.nodes[i]);
+  }
+  uint64_t num_calls = 0;
+  std::string by_function;
+  for (auto i = totals.calls.begin(); i != totals.calls.end(); ++i) {
+    num_calls += i->second;
+    by_function += (by_function.empty() ? "\"" : ", \"") + i->first + "\": " + std::to_string(i->second);
+  }
+  double avg_depth = totals.lookups > 0 ? double(totals.lookup_steps) / double(totals.lookups) : 0.0;
+
+  fprintf(out, "{\"nodes\": {\"total\": %llu, \"by_tag\": {%s}}, ", ull(num_nodes), by_tag.c_str());
+  fprintf(out, "\"environments\": {\"created\": %llu, \"lookups\": %llu, \"parent_steps\": %llu, \"average_depth\": %.3f}, ",
+          ull(totals.envs_created), ull(totals.lookups), ull(totals.lookup_steps), avg_depth);
+  fprintf(out, "\"calls\": {\"total\": %llu, \"by_function\": {%s}}, ", ull(num_calls), by_function.c_str());
+  fprintf(out, "\"valreps\": {\"allocated\": %llu, \"freed\": %llu}, ",
+          ull(totals.valreps_allocated), ull(totals.valreps_freed));
+  fprintf(out, "\"intrinsic_io\": {\"bytes_read\": %llu, \"bytes_written\": %llu}, ",
+          ull(totals.bytes_read), ull(totals.bytes_written));
+  fprintf(out, "\"phases_ms\": {%s}}\n", phases.c_str());
+}
@@ -0,0 +1,49 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include "ast.h"
+
+// Execution counters, always collected: nodes executed by the
+// tree-walking interpreter (by tag), Environments created, variable
+// and function lookups (and how many parent Environments they walked
+// through), calls per function, ValRep allocations and frees, and the
+// bytes the intrinsics read and wrote. Each thread counts into its own
+// block, so counting is a plain increment; a thread's counts are
+// included in the totals once it has called attach_thread() (the
+// Interpreter does so for the threads that run programs and tasks),
+// and when it exits. A user-defined Function counts its own calls, and
+// reports them when it is destroyed. The times of the phases of the
+// run (as recorded by the program driving it) are included.
+class Counters {
+public:
+  static const unsigned NUM_NODE_TAGS = AST_LAZY_STMTS - AST_ADD + 1;
+
+  static void count_node(int tag);
+  static void count_env_created();
+  // a lookup that found its name, and each move to the parent
+  // Environment made by a lookup
+  static void count_lookup();
+  static void count_lookup_step();
+  static void count_calls(const std::string &func_name, uint64_t n = 1);
+  static void count_valrep_allocated();
+  static void count_valrep_freed();
+  static void count_bytes_read(size_t n);
+  static void count_bytes_written(size_t n);
+
+  // add to the wall-clock time spent in a phase of the run (e.g.,
+  // "parse"); the name must outlive the report
+  static void record_phase(const char *name, double ms);
+
+  // include the calling thread's counts in the totals (idempotent)
+  static void attach_thread();
+
+  // Print the totals as a JSON object. The counts of threads that are
+  // still running programs are read without synchronization, so this
+  // should be called once they have stopped (or exited).
+  static void print_json(FILE *out);
+};
+
+#endif // COUNTERS_H
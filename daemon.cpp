@@ -0,0 +1,196 @@
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "cpputil.h"
+#include "exceptions.h"
+#include "astcache.h"
+#include "minilang.h"
+#include "daemon.h"
+
+////////////////////////////////////////////////////////////////////////
+// Daemon implementation
+////////////////////////////////////////////////////////////////////////
+
+Daemon::Daemon(const std::string &socket_path, unsigned cache_capacity, unsigned default_timeout_ms)
+  : m_socket_path(socket_path)
+  , m_cache_capacity(cache_capacity > 0 ? cache_capacity : 1)
+  , m_default_timeout_ms(default_timeout_ms)
+  , m_requests(0)
+  , m_cache_hits(0)
+  , m_cache_misses(0)
+  , m_evictions(0)
+  , m_errors(0)
+  , m_timeouts(0) {
+  memset(m_latency_buckets, 0, sizeof(m_latency_buckets));
+}
+
+Daemon::~Daemon() {
+}
+
+void Daemon::serve() {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (m_socket_path.size() >= sizeof(addr.sun_path)) {
+    RuntimeError::raise("Socket path '%s' is too long", m_socket_path.c_str());
+  }
+  strcpy(addr.sun_path, m_socket_path.c_str());
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    RuntimeError::raise("Could not create socket: %s", strerror(errno));
+  }
+  // a socket left behind by a previous server is replaced
+  unlink(m_socket_path.c_str());
+  if (bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+    int err = errno;
+    close(listen_fd);
+    RuntimeError::raise("Could not listen on '%s': %s", m_socket_path.c_str(), strerror(err));
+  }
+  // a client disconnecting early must not kill the server
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      RuntimeError::raise("accept failed: %s", strerror(errno));
+    }
+    std::thread(&Daemon::serve_connection, this, fd).detach();
+  }
+}
+
+void Daemon::serve_connection(int fd) {
+  DaemonRequest req;
+  while (recv_request(fd, req)) {
+    auto start = std::chrono::steady_clock::now();
+    DaemonResponse resp;
+    if (req.op == DAEMON_RUN) {
+      resp = handle_run(req);
+    } else if (req.op == DAEMON_STATS) {
+      resp.status = DAEMON_OK;
+      resp.hash = 0;
+      resp.output = format_stats();
+    } else {
+      resp.status = DAEMON_BAD_REQUEST;
+      resp.hash = 0;
+      resp.error = cpputil::format("Error: unknown request %u", req.op);
+    }
+    if (req.op == DAEMON_RUN) {
+      record_latency(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    if (!send_response(fd, resp)) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+DaemonResponse Daemon::handle_run(const DaemonRequest &req) {
+  DaemonResponse resp;
+  resp.status = DAEMON_OK;
+  resp.hash = req.source.empty() ? req.hash : ASTCache::hash_bytes(req.source.data(), req.source.size());
+
+  ProgramPtr program = lookup(resp.hash);
+  if (!program) {
+    if (req.source.empty()) {
+      resp.status = DAEMON_UNKNOWN_HASH;
+      resp.error = "Error: no cached program with this hash";
+      return resp;
+    }
+    try {
+      program = insert(resp.hash, MinilangProgram::compile(req.source, "<request>"));
+    } catch (BaseException &ex) {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_errors++;
+      resp.status = DAEMON_ERROR;
+      resp.error = ex.get_message();
+      return resp;
+    }
+  }
+
+  StringIOHandler io(req.input);
+  MinilangContext ctx(program.get(), &io);
+  unsigned timeout_ms = req.timeout_ms > 0 ? req.timeout_ms : m_default_timeout_ms;
+  ctx.set_timeout(timeout_ms);
+  try {
+    Value result = ctx.run();
+    io.get_output() += "Result: " + result.as_str() + "\n";
+  } catch (BaseException &ex) {
+    bool timed_out = dynamic_cast<TimeLimitError *>(&ex) != nullptr;
+    std::lock_guard<std::mutex> guard(m_lock);
+    (timed_out ? m_timeouts : m_errors)++;
+    resp.status = timed_out ? DAEMON_TIMEOUT : DAEMON_ERROR;
+    resp.error = ex.get_message();
+  }
+  resp.output = io.get_output();
+  return resp;
+}
+
+Daemon::ProgramPtr Daemon::lookup(uint64_t hash) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  m_requests++;
+  auto i = m_cache.find(hash);
+  if (i == m_cache.end()) {
+    m_cache_misses++;
+    return ProgramPtr();
+  }
+  m_cache_hits++;
+  m_lru.splice(m_lru.begin(), m_lru, i->second);
+  return i->second->program;
+}
+
+// Programs are shared_ptrs, so evicting one that is still running
+// (or compiled concurrently by two requests) is harmless.
+Daemon::ProgramPtr Daemon::insert(uint64_t hash, MinilangProgram *program) {
+  ProgramPtr ptr(program);
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto i = m_cache.find(hash);
+  if (i != m_cache.end()) {
+    m_lru.erase(i->second);
+  }
+  m_lru.push_front({ hash, ptr });
+  m_cache[hash] = m_lru.begin();
+  while (m_lru.size() > m_cache_capacity) {
+    m_cache.erase(m_lru.back().hash);
+    m_lru.pop_back();
+    m_evictions++;
+  }
+  return ptr;
+}
+
+void Daemon::record_latency(double usecs) {
+  unsigned bucket = 0;
+  while (bucket + 1 < NUM_BUCKETS && usecs >= double(1ULL << (bucket + 1))) {
+    bucket++;
+  }
+  std::lock_guard<std::mutex> guard(m_lock);
+  m_latency_buckets[bucket]++;
+}
+
+std::string Daemon::format_stats() {
+  std::lock_guard<std::mutex> guard(m_lock);
+  std::string out = cpputil::format(
+    "requests %llu\ncache_hits %llu\ncache_misses %llu\ncache_evictions %llu\ncached_programs %zu\nerrors %llu\ntimeouts %llu\n",
+    (unsigned long long) m_requests, (unsigned long long) m_cache_hits, (unsigned long long) m_cache_misses,
+    (unsigned long long) m_evictions, m_lru.size(), (unsigned long long) m_errors, (unsigned long long) m_timeouts);
+
+  // histogram: one line per nonempty bucket [2^i, 2^(i+1)) microseconds
+  out += "latency_us:\n";
+  uint64_t total = 0;
+  for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+    total += m_latency_buckets[i];
+  }
+  uint64_t cumulative = 0;
+  for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+    if (m_latency_buckets[i] == 0) continue;
+    cumulative += m_latency_buckets[i];
+    out += cpputil::format("  [%llu, %llu) %llu (%.1f%%)\n", i == 0 ? 0ULL : 1ULL << i, 1ULL << (i + 1),
+                           (unsigned long long) m_latency_buckets[i], 100.0 * cumulative / total);
+  }
+  return out;
+}
@@ -0,0 +1,62 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <cstdint>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "protocol.h"
+class MinilangProgram;
+
+// Long-running server executing programs on behalf of clients that
+// connect to a Unix domain socket (see protocol.h, and client.cpp for
+// the client). Compiled programs are cached by a hash of their
+// source, with least-recently-used eviction, so a client can resend
+// just the hash. Each connection is served by its own thread, and
+// each run is limited to a timeout.
+class Daemon {
+private:
+  typedef std::shared_ptr<const MinilangProgram> ProgramPtr;
+
+  // cache entries, most recently used first
+  struct CacheEntry {
+    uint64_t hash;
+    ProgramPtr program;
+  };
+
+  // request latencies in power-of-two buckets of microseconds
+  static const unsigned NUM_BUCKETS = 32;
+
+  std::string m_socket_path;
+  unsigned m_cache_capacity;
+  unsigned m_default_timeout_ms;
+
+  std::mutex m_lock;  // protects everything below
+  std::list<CacheEntry> m_lru;
+  std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> m_cache;
+  uint64_t m_requests, m_cache_hits, m_cache_misses, m_evictions, m_errors, m_timeouts;
+  uint64_t m_latency_buckets[NUM_BUCKETS];
+
+  // value semantics prohibited
+  Daemon(const Daemon &);
+  Daemon &operator=(const Daemon &);
+
+public:
+  Daemon(const std::string &socket_path, unsigned cache_capacity, unsigned default_timeout_ms);
+  ~Daemon();
+
+  // accept and serve connections (does not return normally)
+  void serve();
+
+private:
+  void serve_connection(int fd);
+  DaemonResponse handle_run(const DaemonRequest &req);
+  ProgramPtr lookup(uint64_t hash);
+  ProgramPtr insert(uint64_t hash, MinilangProgram *program);
+  void record_latency(double usecs);
+  std::string format_stats();
+};
+
+#endif // DAEMON_H
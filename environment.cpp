@@ -1,47 +1,121 @@
+#include <mutex>
 #include "environment.h"
+#include "counters.h"
+#include "memstats.h"
+
+namespace {
+
+thread_local unsigned t_current_task = 0;
+
+}
 
 Environment::Environment(Environment *parent)
-  : m_parent(parent) {
+  : m_parent(parent)
+  , m_owner(t_current_task)
+  , m_shared(false) {
   assert(m_parent != this);
+  Counters::count_env_created();
 }
 
 Environment::~Environment() {
 }
 
-Value Environment::get_var(std::string var) {
-  if (m_lookup_table.find(var) == m_lookup_table.end()) {
-    return m_parent->get_var(var);
+void *Environment::operator new(size_t size) {
+  MemoryScope scope(MEM_ENVIRONMENTS);
+  return ::operator new(size);
+}
+
+void Environment::operator delete(void *p) {
+  ::operator delete(p);
+}
+
+Value Environment::get_var(const std::string &var) {
+  Value val;
+  Environment *env = this;
+  while (!env->lookup(var, val)) {
+    Counters::count_lookup_step();
+    env = env->m_parent;
   }
-  return m_lookup_table[var];
+  return val;
 }
 
-Value Environment::set_var(std::string var, int value) {
-  if (m_lookup_table.find(var) == m_lookup_table.end()) {
-    return m_parent->set_var(var, value);
+Value Environment::set_var(const std::string &var, int value, const Location &loc) {
+  for (Environment *env = this; ; env = env->m_parent) {
+    std::unique_lock<std::shared_mutex> guard(env->m_lock, std::defer_lock);
+    if (env->m_shared) guard.lock();
+    auto i = env->m_lookup_table.find(var);
+    if (i != env->m_lookup_table.end()) {
+      Counters::count_lookup();
+      env->check_writable(var, loc);
+      i->second = Value(value);
+      return i->second;
+    }
+    Counters::count_lookup_step();
   }
-  m_lookup_table[var] = Value(value);
-  return m_lookup_table[var];
 }
 
-Value Environment::create_var(std::string var) {
-  m_lookup_table[var] = Value(0);
-  return m_lookup_table[var];
+Value Environment::create_var(const std::string &var, const Location &loc) {
+  MemoryScope scope(MEM_ENVIRONMENTS);
+  std::unique_lock<std::shared_mutex> guard(m_lock, std::defer_lock);
+  if (m_shared) guard.lock();
+  check_writable(var, loc);
+  m_lookup_table.insert_or_assign(var, Value(0));
+  return Value(0);
 }
 
-Value Environment::bind_func(std::string func_name, Value func) {
+Value Environment::bind_func(const std::string &func_name, Value func, const Location &loc) {
   if (func.get_kind() != VALUE_INTRINSIC_FN && func.get_kind() != VALUE_FUNCTION) {
     RuntimeError::raise("Tried to bind an object that isn't a function.");
   }
-  m_lookup_table[func_name] = func;
-  return m_lookup_table[func_name];
+  MemoryScope scope(MEM_ENVIRONMENTS);
+  std::unique_lock<std::shared_mutex> guard(m_lock, std::defer_lock);
+  if (m_shared) guard.lock();
+  check_writable(func_name, loc);
+  return m_lookup_table.insert_or_assign(func_name, std::move(func)).first->second;
 }
 
-Value Environment::retrieve_func(std::string func_name) {
+Value Environment::retrieve_func(const std::string &func_name) {
+  Value function;
   // if function is in a parent scope
-  if (m_lookup_table.find(func_name) == m_lookup_table.end()) return m_parent->retrieve_func(func_name);
-  Value function = m_lookup_table[func_name];
+  Environment *env = this;
+  while (!env->lookup(func_name, function)) {
+    Counters::count_lookup_step();
+    env = env->m_parent;
+  }
   if (function.get_kind() != VALUE_INTRINSIC_FN && function.get_kind() != VALUE_FUNCTION) {
     RuntimeError::raise("%s not function", func_name.c_str());
   }
   return function; // valid function
-}
\ No newline at end of file
+}
+
+void Environment::share() {
+  for (Environment *env = this; env != nullptr && !env->m_shared; env = env->m_parent) {
+    env->m_shared = true;
+  }
+}
+
+unsigned Environment::get_current_task() {
+  return t_current_task;
+}
+
+void Environment::set_current_task(unsigned task_id) {
+  t_current_task = task_id;
+}
+
+bool Environment::lookup(const std::string &var, Value &val) {
+  std::shared_lock<std::shared_mutex> guard(m_lock, std::defer_lock);
+  if (m_shared) guard.lock();
+  auto i = m_lookup_table.find(var);
+  if (i == m_lookup_table.end()) {
+    return false;
+  }
+  val = i->second;
+  Counters::count_lookup();
+  return true;
+}
+
+void Environment::check_writable(const std::string &var, const Location &loc) const {
+  if (m_owner != t_current_task) {
+    EvaluationError::raise(loc, "Variable %s is read-only in a task", var.c_str());
+  }
+}
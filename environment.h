@@ -6,12 +6,21 @@
 #include <string>
 #include "value.h"
 #include <unordered_map>
+#include <shared_mutex>
 #include "exceptions.h"
 
+// Environments may be shared with tasks (see Interpreter): once an
+// Environment is captured by a task it is marked shared, and from then
+// on its table is accessed under a lock. Only the task (or the main
+// program, task 0) that created an Environment may assign to its
+// variables; to the others it is read-only.
 class Environment {
 private:
   Environment *m_parent;
   std::unordered_map<std::string, Value> m_lookup_table; // map names to Values
+  unsigned m_owner;              // the task that created it
+  bool m_shared;
+  std::shared_mutex m_lock;      // used once m_shared is set
 
   // copy constructor and assignment operator prohibited
   Environment(const Environment &);
@@ -21,12 +30,37 @@ public:
   Environment(Environment *parent = nullptr);
   ~Environment();
 
-  // functions to access, modify, and create variables
-  Value get_var(std::string var);
-  Value set_var(std::string var, int value);
-  Value create_var(std::string var);
-  Value bind_func(std::string func_name, Value func);
-  Value retrieve_func(std::string func_name);
+  // counted as MEM_ENVIRONMENTS (see memstats.h)
+  static void *operator new(size_t size);
+  static void operator delete(void *p);
+
+  // functions to access, modify, and create variables (loc is where,
+  // for the error raised if the Environment is read-only to the task)
+  Value get_var(const std::string &var);
+  Value set_var(const std::string &var, int value, const Location &loc);
+  Value create_var(const std::string &var, const Location &loc);
+  Value bind_func(const std::string &func_name, Value func, const Location &loc);
+  Value retrieve_func(const std::string &func_name);
+
+  size_t get_num_bindings() const { return m_lookup_table.size(); }
+
+  // remove all bindings (keeping the table's storage for reuse)
+  void clear() { m_lookup_table.clear(); }
+
+  Environment *get_parent() const { return m_parent; }
+
+  // mark this Environment and its ancestors as shared; must be called
+  // by the owner, before the Environment becomes visible to a task
+  void share();
+  bool is_shared() const { return m_shared; }
+
+  // the task running on the calling thread (0 outside of tasks)
+  static unsigned get_current_task();
+  static void set_current_task(unsigned task_id);
+
+private:
+  bool lookup(const std::string &var, Value &val);
+  void check_writable(const std::string &var, const Location &loc) const;
 };
 
 #endif // ENVIRONMENT_H
@@ -45,6 +45,13 @@ const Location &BaseException::get_loc() const {
   return m_loc;
 }
 
+std::string BaseException::get_message() const {
+  if (has_location()) {
+    return cpputil::format("%s:%d:%d: Error: %s", m_loc.get_srcfile().c_str(), m_loc.get_line(), m_loc.get_col(), what());
+  }
+  return cpputil::format("Error: %s", what());
+}
+
 ////////////////////////////////////////////////////////////////////////
 // RuntimeError member functions
 ////////////////////////////////////////////////////////////////////////
@@ -140,3 +147,46 @@ void EvaluationError::raise(const Location &loc, const char *fmt, ...) {
 
   throw EvaluationError(loc, errmsg);
 }
+
+////////////////////////////////////////////////////////////////////////
+// BudgetError member functions
+////////////////////////////////////////////////////////////////////////
+
+BudgetError::BudgetError(const Location &loc, const std::string &desc)
+  : EvaluationError(loc, desc) {
+}
+
+BudgetError::BudgetError(const BudgetError &other)
+  : EvaluationError(other) {
+}
+
+BudgetError::~BudgetError() {
+}
+
+void BudgetError::raise(const Location &loc, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  std::string errmsg = cpputil::vformat(fmt, args);
+  va_end(args);
+
+  throw BudgetError(loc, errmsg);
+}
+
+////////////////////////////////////////////////////////////////////////
+// TimeLimitError member functions
+////////////////////////////////////////////////////////////////////////
+
+TimeLimitError::TimeLimitError(const Location &loc)
+  : BudgetError(loc, "Time limit exceeded") {
+}
+
+TimeLimitError::TimeLimitError(const TimeLimitError &other)
+  : BudgetError(other) {
+}
+
+TimeLimitError::~TimeLimitError() {
+}
+
+void TimeLimitError::raise(const Location &loc) {
+  throw TimeLimitError(loc);
+}
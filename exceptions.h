@@ -37,6 +37,9 @@ public:
   bool has_location() const { return m_loc.is_valid(); }
 
   const Location &get_loc() const;
+
+  // the message as reported to the user, prefixed by the location (if any)
+  std::string get_message() const;
 };
 
 #ifdef __GNUC__
@@ -89,4 +92,28 @@ public:
   static void raise(const Location &loc, const char *fmt, ...) EX_PRINTF_FORMAT;
 };
 
+// Exception type for a run that exceeded one of its budgets (fuel
+// or memory, see Interpreter), so that callers can tell it from
+// errors in the program itself
+class BudgetError : public EvaluationError {
+public:
+  BudgetError(const Location &loc, const std::string &desc);
+  BudgetError(const BudgetError &other);
+  virtual ~BudgetError();
+
+  static void raise(const Location &loc, const char *fmt, ...) EX_PRINTF_FORMAT;
+};
+
+// Exception type for a run that exceeded its deadline (see
+// Interpreter::set_deadline), so that callers can tell a timeout
+// from other evaluation errors
+class TimeLimitError : public BudgetError {
+public:
+  TimeLimitError(const Location &loc);
+  TimeLimitError(const TimeLimitError &other);
+  virtual ~TimeLimitError();
+
+  [[noreturn]] static void raise(const Location &loc);
+};
+
 #endif // EXCEPTIONS_H
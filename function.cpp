@@ -1,14 +1,17 @@
 #include "function.h"
+#include "counters.h"
 
 Function::Function(const std::string &name, const std::vector<std::string> &params, Environment *parent_env, Node *body)
   : ValRep(VALREP_FUNCTION)
   , m_name(name)
   , m_params(params)
   , m_parent_env(parent_env)
-  , m_body(body) {
+  , m_body(body)
+  , m_num_calls(0) {
 }
 
 Function::~Function() {
+  Counters::count_calls(m_name, m_num_calls.load(std::memory_order_relaxed));
 }
 
 // TODO: implement member functions
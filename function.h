@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include <atomic>
+#include <cstdint>
 #include "valrep.h"
 class Environment;
 class Node;
@@ -12,7 +14,8 @@ private:
   std::string m_name;
   std::vector<std::string> m_params;
   Environment *m_parent_env;
-  Node *m_body;
+  std::atomic<Node *> m_body;  // replaced when a lazy body is parsed
+  std::atomic<uint64_t> m_num_calls;  // passed to Counters when destroyed
 
   // value semantics prohibited
   Function(const Function &);
@@ -22,11 +25,13 @@ public:
   Function(const std::string &name, const std::vector<std::string> &params, Environment *parent_env, Node *body);
   virtual ~Function();
 
-  std::string get_name() const { return m_name; }
+  const std::string &get_name() const { return m_name; }
   const std::vector<std::string> &get_params() const { return m_params; }
   unsigned get_num_params() const { return unsigned(m_params.size()); }
   Environment *get_parent_env() const { return m_parent_env; }
-  Node *get_body() const { return m_body; }
+  Node *get_body() const { return m_body.load(std::memory_order_acquire); }
+  void set_body(Node *body) { m_body.store(body, std::memory_order_release); }
+  void count_call() { m_num_calls.fetch_add(1, std::memory_order_relaxed); }
 };
 
 #endif // FUNCTION_H
@@ -0,0 +1,294 @@
+// minilang-gen: writes a random, valid minilang program to standard
+// output, for testing how the front end scales (see `make bench-scaling`).
+//
+//   minilang-gen [-n stmts] [-e depth] [-b depth] [-v vars] [-f funcs] [-c percent] [-s seed]
+//
+// -n is the approximate number of statements (default 1000), counting
+// those in blocks and function bodies; -e is the maximum expression
+// depth (default 3); -b the maximum block nesting (default 2); -v the
+// number of global variables (default 20); -f the number of functions
+// (default 10), which hold about half of the statements; -c the
+// percentage of expression operands that are calls (default 10); and
+// -s the seed (default 1), so the same options always give the same
+// program. Every program passes semantic analysis and terminates: loops
+// run twice, and functions only call functions defined before them that
+// make no calls themselves, so the work done by a call is bounded.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+
+namespace {
+
+struct Options {
+  unsigned num_stmts, expr_depth, block_depth, num_vars, num_funcs, call_pct, seed;
+
+  Options()
+    : num_stmts(1000), expr_depth(3), block_depth(2), num_vars(20), num_funcs(10), call_pct(10), seed(1) { }
+};
+
+class ProgramGenerator {
+private:
+  struct Func {
+    std::string name;
+    unsigned num_params;
+    bool makes_calls;
+  };
+
+  Options m_opts;
+  std::mt19937 m_rand;
+  std::string m_out;
+  int m_budget;                                  // statements left to generate
+  std::vector<std::vector<std::string>> m_scopes; // variables visible, innermost last
+  std::vector<Func> m_funcs;                     // defined so far
+  enum { TOP_LEVEL, CALLING_FUNC, LEAF_FUNC } m_context;   // what is being generated
+  unsigned m_next_name;
+
+public:
+  ProgramGenerator(const Options &opts)
+    : m_opts(opts), m_rand(opts.seed), m_budget(int(opts.num_stmts)), m_context(TOP_LEVEL), m_next_name(0) { }
+
+  std::string generate() {
+    m_scopes.emplace_back();
+    for (unsigned i = 0; i < m_opts.num_vars; i++) {
+      std::string var = "v" + std::to_string(i);
+      m_out += "var " + var + ";\n" + var + " = " + std::to_string(pick(100)) + ";\n";
+      m_scopes.back().push_back(var);
+    }
+
+    // functions are spread through the top level
+    int func_size = m_opts.num_funcs > 0 ? std::max(1, int(m_opts.num_stmts) / int(2 * m_opts.num_funcs)) : 0;
+    int top_level = int(m_opts.num_stmts) - func_size * int(m_opts.num_funcs);
+    unsigned top_level_done = 0;
+    while (m_budget > 0 || m_funcs.size() < m_opts.num_funcs) {
+      if (m_funcs.size() < m_opts.num_funcs
+          && top_level_done * m_opts.num_funcs >= m_funcs.size() * unsigned(std::max(top_level, 1))) {
+        gen_func(func_size);
+      } else {
+        gen_stmt(0);
+        top_level_done++;
+      }
+    }
+    return m_out;
+  }
+
+private:
+  // a random number in [0, n)
+  unsigned pick(unsigned n) {
+    return std::uniform_int_distribution<unsigned>(0, n - 1)(m_rand);
+  }
+
+  bool percent(unsigned pct) {
+    return pick(100) < pct;
+  }
+
+  std::string fresh_name(const char *prefix) {
+    return prefix + std::to_string(m_next_name++);
+  }
+
+  void indent(unsigned depth) {
+    m_out.append(2 * depth, ' ');
+  }
+
+  const std::string &random_var() {
+    unsigned total = 0;
+    for (auto i = m_scopes.begin(); i != m_scopes.end(); ++i) {
+      total += unsigned(i->size());
+    }
+    unsigned n = pick(total);
+    for (auto i = m_scopes.begin(); ; ++i) {
+      if (n < i->size()) return (*i)[n];
+      n -= unsigned(i->size());
+    }
+  }
+
+  bool have_vars() const {
+    for (auto i = m_scopes.begin(); i != m_scopes.end(); ++i) {
+      if (!i->empty()) return true;
+    }
+    return false;
+  }
+
+  // a function that may be called from here, or nullptr
+  const Func *random_callee() {
+    std::vector<const Func *> callees;
+    for (auto i = m_funcs.begin(); i != m_funcs.end(); ++i) {
+      if (m_context == TOP_LEVEL || (m_context == CALLING_FUNC && !i->makes_calls)) callees.push_back(&*i);
+    }
+    return callees.empty() ? nullptr : callees[pick(unsigned(callees.size()))];
+  }
+
+  std::string gen_call(const Func &func, unsigned depth) {
+    std::string call = func.name + "(";
+    for (unsigned i = 0; i < func.num_params; i++) {
+      call += (i > 0 ? ", " : "") + gen_expr(depth > 0 ? depth - 1 : 0);
+    }
+    return call + ")";
+  }
+
+  std::string gen_leaf(unsigned depth) {
+    if (percent(m_opts.call_pct)) {
+      const Func *callee = random_callee();
+      if (callee != nullptr) return gen_call(*callee, depth);
+    }
+    if (have_vars() && percent(60)) {
+      return random_var();
+    }
+    return std::to_string(pick(100));
+  }
+
+  std::string gen_expr(unsigned depth) {
+    if (depth == 0 || percent(30)) {
+      return gen_leaf(depth);
+    }
+    static const char *const arith[] = { "+", "-", "+", "-", "*" };
+    static const char *const relational[] = { "<", "<=", ">", ">=", "==", "!=" };
+    static const char *const logical[] = { "&&", "||" };
+    unsigned kind = pick(100);
+    std::string left = gen_expr(depth - 1);
+    if (kind < 60) {
+      const char *op = arith[pick(5)];
+      // keep products small, so values don't overflow quickly in loops
+      std::string right = *op == '*' ? std::to_string(pick(4)) : gen_expr(depth - 1);
+      return "(" + left + " " + op + " " + right + ")";
+    }
+    std::string right = gen_expr(depth - 1);
+    const char *op = kind < 85 ? relational[pick(6)] : logical[pick(2)];
+    return "(" + left + " " + op + " " + right + ")";
+  }
+
+  // a nonempty block of statements in a new scope
+  void gen_block(unsigned depth, unsigned max_stmts) {
+    m_out += "{\n";
+    m_scopes.emplace_back();
+    unsigned n = 1 + pick(max_stmts);
+    for (unsigned i = 0; i < n && (i == 0 || m_budget > 0); i++) {
+      gen_stmt(depth + 1);
+    }
+    m_scopes.pop_back();
+    indent(depth);
+    m_out += "}";
+  }
+
+  void gen_stmt(unsigned depth) {
+    m_budget--;
+    indent(depth);
+    unsigned kind = pick(100);
+    bool can_nest = depth < m_opts.block_depth && m_budget > 0;
+    if (kind < 15 || !have_vars()) {
+      std::string var = fresh_name("t");
+      m_out += "var " + var + ";\n";
+      indent(depth);
+      m_out += var + " = " + gen_expr(m_opts.expr_depth) + ";\n";
+      m_scopes.back().push_back(var);
+    } else if (kind < 60 || (kind >= 70 && !can_nest)) {
+      m_out += random_var() + " = " + gen_expr(m_opts.expr_depth) + ";\n";
+    } else if (kind < 70) {
+      m_out += gen_expr(m_opts.expr_depth) + ";\n";
+    } else if (kind < 88) {
+      m_out += "if (" + gen_expr(m_opts.expr_depth) + ") ";
+      gen_block(depth, 4);
+      if (percent(50) && m_budget > 0) {
+        m_out += " else ";
+        gen_block(depth, 4);
+      }
+      m_out += "\n";
+    } else {
+      // a loop that runs twice, counting with a variable of its own
+      std::string counter = fresh_name("w");
+      m_out += "var " + counter + ";\n";
+      indent(depth);
+      m_out += counter + " = 0;\n";
+      m_scopes.back().push_back(counter);
+      indent(depth);
+      m_out += "while (" + counter + " < 2) {\n";
+      indent(depth + 1);
+      m_out += counter + " = " + counter + " + 1;\n";
+      // the body assigns to the counter first; don't let it again
+      m_scopes.back().pop_back();
+      m_scopes.emplace_back();
+      unsigned n = 1 + pick(4);
+      for (unsigned i = 0; i < n && m_budget > 0; i++) {
+        gen_stmt(depth + 1);
+      }
+      m_scopes.pop_back();
+      indent(depth);
+      m_out += "}\n";
+    }
+  }
+
+  void gen_func(int size) {
+    Func func;
+    func.name = "f" + std::to_string(m_funcs.size());
+    func.num_params = pick(4);
+    // every other function is a leaf, so there are leaves to call
+    func.makes_calls = m_funcs.size() % 2 == 1;
+
+    m_out += "function " + func.name + "(";
+    m_scopes.emplace_back();
+    for (unsigned i = 0; i < func.num_params; i++) {
+      std::string param = fresh_name("p");
+      m_out += (i > 0 ? ", " : "") + param;
+      m_scopes.back().push_back(param);
+    }
+    m_out += ") {\n";
+    m_context = func.makes_calls ? CALLING_FUNC : LEAF_FUNC;
+    int end_budget = m_budget - size;
+    do {
+      gen_stmt(1);
+    } while (m_budget > end_budget);
+    m_context = TOP_LEVEL;
+    m_scopes.pop_back();
+    m_out += "}\n";
+    m_funcs.push_back(func);
+  }
+};
+
+int usage() {
+  fprintf(stderr, "Usage: minilang-gen [-n stmts] [-e depth] [-b depth] [-v vars] [-f funcs] [-c percent] [-s seed]\n");
+  return 1;
+}
+
+}
+
+int main(int argc, char **argv) {
+  Options opts;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:e:b:v:f:c:s:")) != -1) {
+    unsigned value = unsigned(std::max(0, atoi(optarg)));
+    switch (opt) {
+    case 'n':
+      opts.num_stmts = value;
+      break;
+    case 'e':
+      opts.expr_depth = value;
+      break;
+    case 'b':
+      opts.block_depth = value;
+      break;
+    case 'v':
+      opts.num_vars = value;
+      break;
+    case 'f':
+      opts.num_funcs = value;
+      break;
+    case 'c':
+      opts.call_pct = std::min(value, 100u);
+      break;
+    case 's':
+      opts.seed = value;
+      break;
+    default:
+      return usage();
+    }
+  }
+
+  ProgramGenerator gen(opts);
+  std::string program = gen.generate();
+  fwrite(program.data(), 1, program.size(), stdout);
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include <cstring>
+#include "exceptions.h"
+#include "memstats.h"
+#include "inputlog.h"
+
+namespace {
+
+const char LOG_HEADER[8] = { 'M', 'L', 'I', 'N', 'P', 'U', 'T', 1 };
+
+}
+
+RecordingIOHandler::RecordingIOHandler(IOHandler *io, const char *path)
+  : m_io(io)
+  , m_log(fopen(path, "wb")) {
+  if (m_log == nullptr) {
+    RuntimeError::raise("Could not create input log '%s'", path);
+  }
+  fwrite(LOG_HEADER, 1, sizeof(LOG_HEADER), m_log);
+}
+
+RecordingIOHandler::~RecordingIOHandler() {
+  fclose(m_log);
+}
+
+void RecordingIOHandler::write(const std::string &text) {
+  m_io->write(text);
+}
+
+void RecordingIOHandler::flush() {
+  m_io->flush();
+}
+
+int RecordingIOHandler::read_int() {
+  int32_t value = m_io->read_int();
+  fwrite(&value, sizeof(value), 1, m_log);
+  return value;
+}
+
+ReplayIOHandler::ReplayIOHandler(IOHandler *io, const char *path)
+  : m_io(io)
+  , m_next(0) {
+  FILE *in = fopen(path, "rb");
+  if (in == nullptr) {
+    RuntimeError::raise("Could not open input log '%s'", path);
+  }
+  char header[sizeof(LOG_HEADER)];
+  long size = -1;
+  if (fread(header, 1, sizeof(header), in) == sizeof(header) && memcmp(header, LOG_HEADER, sizeof(header)) == 0
+      && fseek(in, 0, SEEK_END) == 0) {
+    size = ftell(in) - long(sizeof(header));
+  }
+  if (size < 0 || size % long(sizeof(int32_t)) != 0) {
+    fclose(in);
+    RuntimeError::raise("'%s' is not an input log", path);
+  }
+  {
+    MemoryScope scope(MEM_IO);
+    m_values.resize(size_t(size) / sizeof(int32_t));
+  }
+  fseek(in, long(sizeof(header)), SEEK_SET);
+  size_t num_read = fread(m_values.data(), sizeof(int32_t), m_values.size(), in);
+  fclose(in);
+  if (num_read != m_values.size()) {
+    RuntimeError::raise("Could not read input log '%s'", path);
+  }
+}
+
+ReplayIOHandler::~ReplayIOHandler() {
+}
+
+void ReplayIOHandler::write(const std::string &text) {
+  m_io->write(text);
+}
+
+void ReplayIOHandler::flush() {
+  m_io->flush();
+}
+
+int ReplayIOHandler::read_int() {
+  return m_next < m_values.size() ? m_values[m_next++] : 0;
+}
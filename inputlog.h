@@ -0,0 +1,51 @@
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include "io.h"
+
+// Input logs make runs that read input reproducible. readint is the
+// only intrinsic whose result isn't determined by the program, so a
+// log holds the values it returned, in order: an 8-byte header
+// ("MLINPUT" and a version byte) followed by each value as a 32-bit
+// integer in native byte order. Replaying a log reads it into memory
+// once, so readint then just takes the next value, with no parsing.
+// Output is passed through to the wrapped handler.
+
+// Records the values that another handler's read_int returns.
+class RecordingIOHandler : public IOHandler {
+private:
+  IOHandler *m_io;
+  FILE *m_log;
+
+public:
+  // raises a RuntimeError if the log can't be created
+  RecordingIOHandler(IOHandler *io, const char *path);
+  virtual ~RecordingIOHandler();
+
+  virtual void write(const std::string &text);
+  virtual void flush();
+  virtual int read_int();
+};
+
+// Returns the values recorded in a log (then 0, as at the end of
+// input), instead of reading input.
+class ReplayIOHandler : public IOHandler {
+private:
+  IOHandler *m_io;
+  std::vector<int32_t> m_values;
+  size_t m_next;
+
+public:
+  // raises a RuntimeError if the log can't be read
+  ReplayIOHandler(IOHandler *io, const char *path);
+  virtual ~ReplayIOHandler();
+
+  virtual void write(const std::string &text);
+  virtual void flush();
+  virtual int read_int();
+};
+
+#endif // INPUTLOG_H
@@ -1,24 +1,246 @@
 #include <cassert>
+#include <climits>
 #include <algorithm>
 #include <memory>
+#include <cstdint>
+#include <pthread.h>
+#include "arith.h"
 #include "ast.h"
 #include "node.h"
 #include "exceptions.h"
 #include "function.h"
 #include "interp.h"
+#include "parser2.h"
+#include "threadpool.h"
+#include "profiler.h"
+#include "counters.h"
+#include "tracer.h"
+#include "memstats.h"
 #include <unordered_set>
 #include <iostream>
+#include <thread>
+
+namespace {
+
+// the most fuel a thread takes at a time, and so the most loop
+// iterations and calls between checks of the clock
+const unsigned FUEL_SHARE = 1024;
+
+// the estimated size of a binding in an Environment's table: the name,
+// the Value, and the hash node
+const size_t BINDING_BYTES = 64;
+
+// the calling thread's unspent fuel, taken for the run identified by
+// run (see Interpreter::spend_fuel)
+struct FuelShare {
+  unsigned run;
+  unsigned units;
+};
+thread_local FuelShare t_fuel_share;
+std::atomic<unsigned> g_next_budget_run(1);
+
+// Calls to user functions active on the calling thread. Tasks run by a
+// thread waiting for them add to it, since they share its native stack.
+thread_local unsigned t_call_depth;
+
+// counts a call in t_call_depth while it is in scope
+struct CallDepth {
+  CallDepth() { t_call_depth++; }
+  ~CallDepth() { t_call_depth--; }
+};
+
+// Stack kept free below the deepest block or call evaluated with a
+// call depth limit, for the frames of the expressions within it.
+const uintptr_t STACK_RESERVE = 256 * 1024;
+
+// the lowest stack address at which the calling thread may start a
+// block or call (see Interpreter::check_nesting), found on first use
+thread_local uintptr_t t_stack_floor;
+
+uintptr_t get_stack_floor() {
+  if (t_stack_floor == 0) {
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+      return 0;
+    }
+    pthread_attr_getstack(&attr, &addr, &size);
+    pthread_attr_destroy(&attr);
+    t_stack_floor = reinterpret_cast<uintptr_t>(addr) + std::min<uintptr_t>(STACK_RESERVE, size / 2);
+  }
+  return t_stack_floor;
+}
+
+// The operand of a parallel evaluation (see Interpreter::eval_parallel)
+// being evaluated by the calling thread; group is null outside of one.
+struct ParallelGroup;
+struct Operand {
+  ParallelGroup *group;
+  unsigned index;
+};
+thread_local Operand t_operand = { nullptr, 0 };
+
+// the operands of one parallel evaluation (most have two, which are
+// kept without allocating)
+struct ParallelGroup {
+  struct State {
+    std::atomic<uint64_t> fuel;   // taken by the operand
+    std::atomic<bool> started;
+  };
+
+  Operand parent;                         // the operand it is nested in
+  std::atomic<unsigned> first_failed;     // operands after it are cancelled
+  State inline_operands[4];
+  std::unique_ptr<State[]> allocated;
+  State *operands;
+
+  ParallelGroup(Operand parent_, unsigned num_operands)
+    : parent(parent_)
+    , first_failed(UINT_MAX)
+    , inline_operands()
+    , allocated(num_operands > 4 ? new State[num_operands]() : nullptr)
+    , operands(allocated ? allocated.get() : inline_operands) { }
+
+  void fail(unsigned index) {
+    unsigned first = first_failed.load();
+    while (index < first && !first_failed.compare_exchange_weak(first, index)) { }
+  }
+};
+
+// an operand is cancelled if an earlier one in its group (or in the
+// groups it is nested in) has failed
+bool is_cancelled(Operand op) {
+  for (; op.group != nullptr; op = op.group->parent) {
+    if (op.group->first_failed.load(std::memory_order_relaxed) < op.index) return true;
+  }
+  return false;
+}
+
+// count fuel taken (or given back, if negative) by an operand, and by
+// the operands it is nested in
+void attribute_fuel(Operand op, int64_t units) {
+  for (; op.group != nullptr; op = op.group->parent) {
+    op.group->operands[op.index].fuel.fetch_add(uint64_t(units), std::memory_order_relaxed);
+  }
+}
+
+bool is_budget_error(std::exception_ptr error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (BudgetError &) {
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+// names bound in the global Environment
+const char *const INTRINSIC_NAMES[] = { "print", "println", "readint", "spawn", "join", "parfor" };
+
+// parfor splits its range into this many chunks per thread
+const unsigned CHUNKS_PER_THREAD = 4;
+
+// keeps the profiler's shadow stack in step with calls, including
+// calls left by an exception
+class ProfiledCall {
+private:
+  Profiler *m_profiler;
+
+public:
+  ProfiledCall(Profiler *profiler, const Node *call)
+    : m_profiler(profiler) {
+    if (m_profiler != nullptr) m_profiler->push_call(call);
+  }
+  ~ProfiledCall() {
+    if (m_profiler != nullptr) m_profiler->pop_call();
+  }
+};
+
+// records entering and leaving a call with the tracer
+class TracedCall {
+private:
+  Tracer *m_tracer;
+  const Node *m_call;
+
+public:
+  TracedCall(Tracer *tracer, const Node *call)
+    : m_tracer(tracer), m_call(call) {
+    if (m_tracer != nullptr) m_tracer->begin_call(m_call);
+  }
+  ~TracedCall() {
+    if (m_tracer != nullptr) m_tracer->end_call(m_call);
+  }
+};
+
+}
+
+thread_local std::vector<Interpreter::Task *> Interpreter::s_running_tasks;
 
 Interpreter::Interpreter(Node *ast_to_adopt)
-  : m_ast(ast_to_adopt) {
+  : m_ast(ast_to_adopt)
+  , m_owns_ast(true)
+  , m_io(IOHandler::get_stdio())
+  , m_counts_fuel(false)
+  , m_has_deadline(false)
+  , m_fuel_limit(0)
+  , m_fuel_taken(0)
+  , m_memory_limit(0)
+  , m_memory_used(0)
+  , m_max_call_depth(0)
+  , m_budget_run(0)
+  , m_num_task_threads(std::thread::hardware_concurrency())
+  , m_ordered_output(false)
+  , m_next_task_id(1)
+  , m_auto_parallel(false)
+  , m_auto_pending(0)
+  , m_profiler(nullptr)
+  , m_tracer(nullptr)
+  , m_checking_stmt(nullptr) {
+}
+
+Interpreter::Interpreter(const Node *ast, IOHandler *io)
+  : m_ast(const_cast<Node *>(ast))
+  , m_owns_ast(false)
+  , m_io(io)
+  , m_counts_fuel(false)
+  , m_has_deadline(false)
+  , m_fuel_limit(0)
+  , m_fuel_taken(0)
+  , m_memory_limit(0)
+  , m_memory_used(0)
+  , m_max_call_depth(0)
+  , m_budget_run(0)
+  , m_num_task_threads(std::thread::hardware_concurrency())
+  , m_ordered_output(false)
+  , m_next_task_id(1)
+  , m_auto_parallel(false)
+  , m_auto_pending(0)
+  , m_profiler(nullptr)
+  , m_tracer(nullptr)
+  , m_checking_stmt(nullptr) {
 }
 
 Interpreter::~Interpreter() {
-  delete m_ast;
+  // tasks still running (after a failed run) use the global
+  // Environment, and the pool, to which they report finishing
+  if (m_pool) {
+    m_pool->wait_idle();
+  }
+  m_pool.reset();
+  // Functions in the global Environment refer to the AST
+  m_global_env.reset();
+  if (m_owns_ast) {
+    delete m_ast;
+  }
 }
 
 // recursively ensures any varrefs are preceded by a vardef
 void Interpreter::check_vars(std::unordered_set<std::string>& var_set, Node* parent) {
+  if (parent->get_tag() == AST_LAZY_STMTS) { // checked when parsed, against the names visible here
+    m_lazy_scopes[parent] = m_checking_stmt;
+    return;
+  }
   if (parent->get_tag() == AST_VARDEF) { // new variable definition
     var_set.insert(parent->get_kid(0)->get_str());
   } else if (parent->get_tag() == AST_VARREF && var_set.find(parent->get_str()) == var_set.end()){ // undefined variable
@@ -44,59 +266,726 @@ void Interpreter::check_vars(std::unordered_set<std::string>& var_set, Node* par
 }
 
 void Interpreter::analyze() {
-  std::unordered_set<std::string> var_set = {"print", "println", "readint"}; // defined variables set
-  check_vars(var_set, m_ast);
+  std::unordered_set<std::string> var_set(std::begin(INTRINSIC_NAMES), std::end(INTRINSIC_NAMES)); // defined variables set
+  for (auto it = m_ast->cbegin(); it != m_ast->cend(); ++it) {
+    m_checking_stmt = *it;
+    check_vars(var_set, *it);
+  }
+  m_checking_stmt = nullptr;
+}
+
+// add the names that check_vars defines at the top level as it checks
+// a top-level statement (those of variables, and of functions and
+// their parameters), without checking the statement again
+void Interpreter::define_top_level_names(std::unordered_set<std::string> &var_set, Node *node) {
+  switch (node->get_tag()) {
+  case AST_VARDEF:
+    var_set.insert(node->get_kid(0)->get_str());
+    return;
+  case AST_FUNC:
+    var_set.insert(node->get_kid(0)->get_str());
+    if (node->get_num_kids() == 3) {
+      for (auto it = node->get_kid(1)->cbegin(); it != node->get_kid(1)->cend(); ++it) {
+        var_set.insert((*it)->get_str());
+      }
+    }
+    return;
+  case AST_STMTS:
+  case AST_LAZY_STMTS:
+    // blocks define names in a scope of their own
+    return;
+  default:
+    for (auto it = node->cbegin(); it != node->cend(); ++it) {
+      define_top_level_names(var_set, *it);
+    }
+  }
+}
+
+Environment *Interpreter::create_global_env() {
+  Environment *env = new Environment();
+  bind_intrinsics(*env);
+  return env;
+}
+
+void Interpreter::bind_intrinsics(Environment &env) {
+  env.bind_func("print", Value(&intrinsic_print), Location());
+  env.bind_func("println", Value(&intrinsic_println), Location());
+  env.bind_func("readint", Value(&intrinsic_readint), Location());
+  env.bind_func("spawn", Value(&intrinsic_spawn), Location());
+  env.bind_func("join", Value(&intrinsic_join), Location());
+  env.bind_func("parfor", Value(&intrinsic_parfor), Location());
+}
+
+void Interpreter::set_ast(const Node *ast) {
+  assert(!m_owns_ast);
+  if (ast == m_ast) {
+    return;
+  }
+  if (m_pool) {
+    m_pool->wait_idle();
+    std::lock_guard<std::mutex> guard(m_tasks_lock);
+    m_tasks.clear();
+  }
+  m_global_env.reset();
+  m_lazy_scopes.clear();
+  m_parsed_bodies.clear();
+  m_ast = const_cast<Node *>(ast);
 }
 
 Value Interpreter::execute() {
-  std::unique_ptr<Environment> env(new Environment());
-  // bind intrinsic functions
-  env->bind_func("print", Value(&intrinsic_print));
-  env->bind_func("println", Value(&intrinsic_println));
-  env->bind_func("readint", Value(&intrinsic_readint));
+  Counters::attach_thread();
+  // tasks left running by a failed run must finish before the global
+  // Environment is cleared
+  if (m_pool) {
+    m_pool->wait_idle();
+    std::lock_guard<std::mutex> guard(m_tasks_lock);
+    m_tasks.clear();
+  }
+
+  // each run has its own budget
+  m_fuel_taken = 0;
+  m_memory_used = 0;
+  m_budget_run = g_next_budget_run++;
+
+  // a previous run's global Environment is emptied and reused
+  if (m_global_env) {
+    m_global_env->clear();
+    bind_intrinsics(*m_global_env);
+  } else {
+    m_global_env.reset(create_global_env());
+  }
 
   Value result;
   // execute each statement node in the tree
   for (auto it = m_ast->cbegin(); it != m_ast->cend(); ++it) {
-    result = execute_node(*env, *it);
+    result = execute_node(*m_global_env, *it);
   }
+  finish_all_tasks();
   return result;
 }
 
+Value Interpreter::execute_next(Node *stmt_to_adopt) {
+  // the unit keeps the statement alive, since Functions defined by it
+  // refer to their bodies
+  m_ast->append_kid(stmt_to_adopt);
+  Counters::attach_thread();
+
+  if (!m_global_env) {
+    m_global_vars.insert(std::begin(INTRINSIC_NAMES), std::end(INTRINSIC_NAMES));
+    // the statements share one budget
+    m_budget_run = g_next_budget_run++;
+    m_global_env.reset(create_global_env());
+  }
+
+  // top-level statements share one set of defined names, so checking
+  // them one at a time is equivalent to analyzing the whole unit
+  m_checking_stmt = stmt_to_adopt;
+  check_vars(m_global_vars, stmt_to_adopt);
+  m_checking_stmt = nullptr;
+  return execute_node(*m_global_env, stmt_to_adopt);
+}
+
+// parse and analyze a lazily parsed function body on its first call
+Node *Interpreter::parse_lazy_body(Node *lazy_body) {
+  auto i = m_parsed_bodies.find(lazy_body);
+  if (i != m_parsed_bodies.end()) {
+    return i->second.get();
+  }
+  std::unique_ptr<Node> body(Parser2::parse_lazy_body(lazy_body));
+  auto j = m_lazy_scopes.find(lazy_body);
+  assert(j != m_lazy_scopes.end());
+  // functions are only defined at the top level, so the names visible
+  // to the body are those defined by the top-level statements up to
+  // and including its definition
+  std::unordered_set<std::string> var_set(std::begin(INTRINSIC_NAMES), std::end(INTRINSIC_NAMES));
+  for (auto it = m_ast->cbegin(); it != m_ast->cend(); ++it) {
+    define_top_level_names(var_set, *it);
+    if (*it == j->second) break;
+  }
+  check_vars(var_set, body.get());
+  m_lazy_scopes.erase(j);
+  return (m_parsed_bodies[lazy_body] = std::move(body)).get();
+}
+
+IntrinsicFn Interpreter::lookup_intrinsic(const std::string &name) {
+  if (name == "print") return &intrinsic_print;
+  if (name == "println") return &intrinsic_println;
+  if (name == "readint") return &intrinsic_readint;
+  if (name == "spawn") return &intrinsic_spawn;
+  if (name == "join") return &intrinsic_join;
+  if (name == "parfor") return &intrinsic_parfor;
+  return nullptr;
+}
+
+const std::string &Interpreter::get_intrinsic_name(IntrinsicFn fn) {
+  static const std::pair<IntrinsicFn, std::string> s_names[] = {
+    { &intrinsic_print, "print" }, { &intrinsic_println, "println" }, { &intrinsic_readint, "readint" },
+    { &intrinsic_spawn, "spawn" }, { &intrinsic_join, "join" }, { &intrinsic_parfor, "parfor" },
+  };
+  static const std::string s_unknown = "<intrinsic>";
+  for (auto i = std::begin(s_names); i != std::end(s_names); ++i) {
+    if (i->first == fn) return i->second;
+  }
+  return s_unknown;
+}
+
+void Interpreter::set_deadline(std::chrono::steady_clock::time_point deadline) {
+  m_has_deadline = true;
+  m_counts_fuel = true;
+  m_deadline = deadline;
+}
+
+// spend a unit of the calling thread's share of fuel, taking another
+// share when it has run out
+void Interpreter::spend_fuel(const Location &loc) {
+  FuelShare &share = t_fuel_share;
+  if (share.units > 0 && share.run == m_budget_run) {
+    share.units--;
+    return;
+  }
+  take_fuel(loc);
+}
+
+// take a share of the run's fuel (spending one unit of it), first
+// checking for cancellation and the deadline
+void Interpreter::take_fuel(const Location &loc) {
+  if (t_operand.group != nullptr && is_cancelled(t_operand)) {
+    EvaluationError::raise(loc, "Evaluation cancelled");
+  }
+  if (m_has_deadline && std::chrono::steady_clock::now() >= m_deadline) {
+    TimeLimitError::raise(loc);
+  }
+  unsigned units = FUEL_SHARE;
+  if (m_fuel_limit > 0) {
+    uint64_t taken = m_fuel_taken.fetch_add(units, std::memory_order_relaxed);
+    if (taken >= m_fuel_limit) {
+      m_fuel_taken.fetch_sub(units, std::memory_order_relaxed);
+      BudgetError::raise(loc, "Fuel exhausted");
+    }
+    if (m_fuel_limit - taken < units) {
+      m_fuel_taken.fetch_sub(units - (m_fuel_limit - taken), std::memory_order_relaxed);
+      units = unsigned(m_fuel_limit - taken);
+    }
+    attribute_fuel(t_operand, units);
+  }
+  t_fuel_share.run = m_budget_run;
+  t_fuel_share.units = units - 1;
+}
+
+// give back the calling thread's unspent share of fuel, so that the fuel
+// counted for an operand (see eval_parallel) is what it spent
+void Interpreter::return_fuel() {
+  FuelShare &share = t_fuel_share;
+  if (share.units > 0 && share.run == m_budget_run && m_fuel_limit > 0) {
+    m_fuel_taken.fetch_sub(share.units, std::memory_order_relaxed);
+    attribute_fuel(t_operand, -int64_t(share.units));
+  }
+  share.units = 0;
+}
+
+void Interpreter::charge_memory(size_t bytes, const Location &loc) {
+  if (m_memory_limit == 0) {
+    return;
+  }
+  if (m_memory_used.fetch_add(bytes, std::memory_order_relaxed) + bytes > m_memory_limit) {
+    m_memory_used.fetch_sub(bytes, std::memory_order_relaxed);
+    BudgetError::raise(loc, "Memory limit exceeded");
+  }
+}
+
+// give back the memory charged for an Environment about to be deleted
+void Interpreter::release_memory(Environment *env) {
+  if (m_memory_limit == 0) {
+    return;
+  }
+  m_memory_used.fetch_sub(sizeof(Environment) + env->get_num_bindings() * BINDING_BYTES, std::memory_order_relaxed);
+}
+
+// Intrinsics called without an Interpreter (e.g., from the VM) use
+// standard I/O. In ordered mode, a task's output goes to its buffer.
+void Interpreter::write_output(Interpreter *interp, const std::string &text, bool flush) {
+  MemoryScope scope(MEM_IO);
+  Counters::count_bytes_written(text.size());
+  if (interp == nullptr) {
+    IOHandler *io = IOHandler::get_stdio();
+    io->write(text);
+    if (flush) io->flush();
+    return;
+  }
+  if (interp->m_ordered_output && current_task() != nullptr) {
+    current_task()->output += text;
+    return;
+  }
+  std::lock_guard<std::mutex> guard(interp->m_io_lock);
+  interp->m_io->write(text);
+  if (flush) interp->m_io->flush();
+}
+
 Value Interpreter::intrinsic_print(Value args[], unsigned num_args, const Location &loc, Interpreter *interp) {
   if (num_args != 1) EvaluationError::raise(loc, "Intrinsic print function expected 1 argument");
-  std::cout << args[0].as_str();
+  MemoryScope scope(MEM_IO);
+  write_output(interp, args[0].as_str(), false);
   return Value(0);
 }
 
 Value Interpreter::intrinsic_println(Value args[], unsigned num_args,  const Location &loc, Interpreter *interp){
   if (num_args != 1) EvaluationError::raise(loc, "Intrinsic println expected 1 argument");
-  std::cout << args[0].as_str() << std::endl;
+  MemoryScope scope(MEM_IO);
+  write_output(interp, args[0].as_str() + "\n", true);
   return Value(0);
 }
 
 Value Interpreter::intrinsic_readint(Value args[], unsigned num_args, const Location &loc, Interpreter *interp){
   if (num_args != 0) EvaluationError::raise(loc, "Intrinsic readint function expected 0 arguments");
-  int i;
-  std::cin >> i;
-  return Value(i);
+  int n;
+  if (interp == nullptr) {
+    n = IOHandler::get_stdio()->read_int();
+  } else {
+    TraceSpan wait(interp->m_tracer, "readint", "io");
+    std::lock_guard<std::mutex> guard(interp->m_io_lock);
+    n = interp->m_io->read_int();
+  }
+  // IOHandlers return the value, not the text: count its digits
+  Counters::count_bytes_read(std::to_string(n).size());
+  return Value(n);
+}
+
+// spawn(f, args...): start a task calling f(args...), returning its handle
+Value Interpreter::intrinsic_spawn(Value args[], unsigned num_args, const Location &loc, Interpreter *interp) {
+  if (num_args < 1 || args[0].is_numeric()) EvaluationError::raise(loc, "Intrinsic spawn expected a function and its arguments");
+  if (interp == nullptr) EvaluationError::raise(loc, "Tasks require the tree-walking interpreter");
+  Value func = args[0];
+  std::vector<Value> call_args(args + 1, args + num_args);
+  Location call_loc(loc);
+  std::shared_ptr<Task> task = interp->create_task(func, [interp, func, call_args, call_loc]() mutable {
+    return interp->call_function(func, call_args.data(), unsigned(call_args.size()), call_loc);
+  });
+  unsigned handle;
+  {
+    std::lock_guard<std::mutex> guard(interp->m_tasks_lock);
+    interp->m_tasks.push_back(task);
+    handle = unsigned(interp->m_tasks.size());
+  }
+  interp->m_pool->submit([interp, task]() { interp->run_task(*task); });
+  return Value(int(handle));
+}
+
+// join(handle): wait for a task, returning its result
+Value Interpreter::intrinsic_join(Value args[], unsigned num_args, const Location &loc, Interpreter *interp) {
+  if (num_args != 1 || !args[0].is_numeric()) EvaluationError::raise(loc, "Intrinsic join expected 1 argument (a task handle)");
+  if (interp == nullptr) EvaluationError::raise(loc, "Tasks require the tree-walking interpreter");
+  int handle = args[0].get_ival();
+  std::shared_ptr<Task> task;
+  Task *self = current_task();
+  {
+    std::lock_guard<std::mutex> guard(interp->m_tasks_lock);
+    if (handle >= 1 && handle <= int(interp->m_tasks.size())) {
+      task = interp->m_tasks[handle - 1];
+    }
+    if (!task) EvaluationError::raise(loc, "Invalid task handle %d", handle);
+    // Joining the task itself, a task suspended beneath it on this
+    // thread, or a task joining one of those (on any thread) would
+    // never finish. Checking and recording the join under the lock
+    // keeps two tasks from joining each other.
+    for (Task *t = task.get(); t != nullptr; t = t->joining) {
+      if (is_running(t)) EvaluationError::raise(loc, "Task %d cannot be joined by itself or a task waiting for it", handle);
+    }
+    if (self != nullptr) {
+      self->joining = task.get();
+    }
+  }
+  try {
+    interp->wait_for({ task }, loc);
+  } catch (...) {
+    std::lock_guard<std::mutex> guard(interp->m_tasks_lock);
+    if (self != nullptr) self->joining = nullptr;
+    throw;
+  }
+  if (self != nullptr) {
+    std::lock_guard<std::mutex> guard(interp->m_tasks_lock);
+    self->joining = nullptr;
+  }
+  return interp->finish_task(*task);
+}
+
+// parfor(f, lo, hi): call f(i) for lo <= i < hi, in parallel
+Value Interpreter::intrinsic_parfor(Value args[], unsigned num_args, const Location &loc, Interpreter *interp) {
+  if (num_args != 3 || args[0].is_numeric() || !args[1].is_numeric() || !args[2].is_numeric()) {
+    EvaluationError::raise(loc, "Intrinsic parfor expected a function and an index range");
+  }
+  if (interp == nullptr) EvaluationError::raise(loc, "Tasks require the tree-walking interpreter");
+  Value func = args[0];
+  long long lo = args[1].get_ival(), hi = args[2].get_ival();
+  if (hi <= lo) {
+    return Value(0);
+  }
+
+  // the calling thread runs chunks while it waits, so it counts as one
+  // of the threads
+  std::vector<std::shared_ptr<Task>> chunks;
+  Location call_loc(loc);
+  long long num_chunks = std::max(1u, interp->m_num_task_threads) * CHUNKS_PER_THREAD;
+  num_chunks = std::min(num_chunks, hi - lo);
+  for (long long c = 0; c < num_chunks; c++) {
+    long long begin = lo + (hi - lo) * c / num_chunks, end = lo + (hi - lo) * (c + 1) / num_chunks;
+    chunks.push_back(interp->create_task(func, [interp, func, begin, end, call_loc]() {
+      for (long long i = begin; i < end; i++) {
+        Value arg = Value(int(i));
+        interp->call_function(func, &arg, 1, call_loc);
+      }
+      return Value(0);
+    }));
+    std::shared_ptr<Task> chunk = chunks.back();
+    interp->m_pool->submit([interp, chunk]() { interp->run_task(*chunk); });
+  }
+  interp->wait_for(chunks);
+  // output in index order; the error from the lowest index wins
+  for (auto i = chunks.begin(); i != chunks.end(); ++i) {
+    interp->finish_task(**i);
+  }
+  return Value(0);
+}
+
+std::shared_ptr<Interpreter::Task> Interpreter::create_task(const Value &func, std::function<Value()> body) {
+  if (!m_pool) {
+    m_pool.reset(new WorkStealingPool(std::max(1u, m_num_task_threads)));
+  }
+  std::shared_ptr<Task> task = std::make_shared<Task>();
+  task->id = m_next_task_id++;
+  task->body = body;
+  task->captured = func.get_kind() == VALUE_FUNCTION ? func.get_function()->get_parent_env() : nullptr;
+  task->started = false;
+  task->done = false;
+  task->joining = nullptr;
+  if (task->captured != nullptr) {
+    task->captured->share();
+  }
+  return task;
+}
+
+// run a task on the calling thread, unless it has already been claimed
+// (by a worker, or by a thread waiting for it)
+void Interpreter::run_task(Task &task) {
+  if (task.started.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+  // tasks can run nested, in a thread waiting for them
+  unsigned saved_id = Environment::get_current_task();
+  s_running_tasks.push_back(&task);
+  Environment::set_current_task(task.id);
+  Counters::attach_thread();
+  try {
+    task.result = task.body();
+  } catch (...) {
+    task.error = std::current_exception();
+  }
+  s_running_tasks.pop_back();
+  Environment::set_current_task(saved_id);
+  task.done.store(true, std::memory_order_release);
+  m_pool->notify();
+}
+
+// whether the task is running on this thread (possibly suspended,
+// waiting for the tasks above it)
+bool Interpreter::is_running(const Task *task) {
+  return std::find(s_running_tasks.begin(), s_running_tasks.end(), task) != s_running_tasks.end();
+}
+
+// Run the awaited tasks that haven't started on this thread, then block
+// until the rest finish. Only the awaited tasks are run, so a task
+// never runs above one on the stack that it might join.
+void Interpreter::wait_for(const std::vector<std::shared_ptr<Task>> &tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+  for (auto i = tasks.begin(); i != tasks.end(); ++i) {
+    run_task(**i);
+  }
+  m_pool->wait_until([&tasks]() { return all_done(tasks); });
+}
+
+// As above, but giving up at the run's deadline, raising "Time limit
+// exceeded" at loc. A join can wait for a task that never finishes
+// (one in a cycle of joins through parfor chunks, which join can't
+// detect), so only joins need this: the other waits are for tasks
+// that stop on their own once the deadline has passed.
+void Interpreter::wait_for(const std::vector<std::shared_ptr<Task>> &tasks, const Location &loc) {
+  if (!m_has_deadline) {
+    wait_for(tasks);
+    return;
+  }
+  for (auto i = tasks.begin(); i != tasks.end(); ++i) {
+    run_task(**i);
+  }
+  if (!m_pool->wait_until([&tasks]() { return all_done(tasks); }, m_deadline)) {
+    TimeLimitError::raise(loc);
+  }
+}
+
+bool Interpreter::all_done(const std::vector<std::shared_ptr<Task>> &tasks) {
+  for (auto i = tasks.begin(); i != tasks.end(); ++i) {
+    if (!(*i)->done.load(std::memory_order_acquire)) return false;
+  }
+  return true;
+}
+
+// pass on a finished task's buffered output, then its result or error
+Value Interpreter::finish_task(Task &task) {
+  std::string output;
+  {
+    std::lock_guard<std::mutex> guard(m_tasks_lock);
+    output.swap(task.output);
+  }
+  if (!output.empty()) {
+    write_output(this, output, true);
+  }
+  if (task.error) {
+    std::rethrow_exception(task.error);
+  }
+  return task.result;
+}
+
+// tasks that were never joined finish before the program does (their
+// output, in ordered mode, following the program's in spawn order)
+void Interpreter::finish_all_tasks() {
+  if (!m_pool) {
+    return;
+  }
+  m_pool->wait_idle();
+  std::vector<std::shared_ptr<Task>> tasks;
+  {
+    std::lock_guard<std::mutex> guard(m_tasks_lock);
+    tasks.swap(m_tasks);
+  }
+  for (auto i = tasks.begin(); i != tasks.end(); ++i) {
+    finish_task(**i);
+  }
+}
+
+// call an intrinsic or user-defined function with evaluated arguments
+Value Interpreter::call_function(const Value &func_val, Value args[], unsigned arg_ct, const Location &loc) {
+  if (m_counts_fuel) {
+    spend_fuel(loc);
+  }
+  if (func_val.get_kind() == VALUE_INTRINSIC_FN) {
+    IntrinsicFn intrin_func = func_val.get_intrinsic_fn();
+    Counters::count_calls(get_intrinsic_name(intrin_func));
+    return intrin_func(args, arg_ct, loc, this);
+  }
+  Function *func = func_val.get_function();
+  func->count_call();
+  Node* start = func->get_body();
+  if (start->get_tag() == AST_LAZY_STMTS) {
+    std::lock_guard<std::mutex> guard(m_lazy_lock);
+    start = func->get_body();
+    if (start->get_tag() == AST_LAZY_STMTS) {
+      start = parse_lazy_body(start);
+      func->set_body(start);
+    }
+  }
+  const std::vector<std::string> &params = func->get_params();
+  if (params.size() != arg_ct) {
+    EvaluationError::raise(loc, "Incorect number of function arguments.");
+  }
+  CallDepth depth;
+  if (m_max_call_depth > 0) {
+    check_nesting(loc);
+  }
+  charge_memory(sizeof(Environment) + arg_ct * BINDING_BYTES, loc);
+  ScopedEnv block_env(new Environment(func->get_parent_env()), EnvReleaser{ this });
+  for (unsigned i = 0; i < arg_ct; i++) {
+    block_env->create_var(params[i], loc);
+    block_env->set_var(params[i], args[i].get_ival(), loc);
+  }
+  return execute_node(*block_env, start);
+}
+
+// With a call depth limit, a call past the limit is an error, and so is
+// a block or call that would leave less than STACK_RESERVE of the
+// thread's native stack: calls whose bodies nest many blocks can
+// overflow it well within the limit.
+void Interpreter::check_nesting(const Location &loc) {
+  if (t_call_depth > m_max_call_depth) {
+    EvaluationError::raise(loc, "Call depth limit (%u) exceeded", m_max_call_depth);
+  }
+  char here;
+  if (reinterpret_cast<uintptr_t>(&here) < get_stack_floor()) {
+    EvaluationError::raise(loc, "Evaluation nested too deeply for the stack");
+  }
+}
+
+// evaluate a binary operator whose operands are marked as parallel
+Value Interpreter::execute_parallel(Environment &env, Node *node) {
+  int tag = node->get_tag();
+  // sequentially, the divisor is evaluated (and checked) first
+  bool divide = tag == AST_DIVIDE;
+  Node *exprs[2] = { node->get_kid(divide ? 1 : 0), node->get_kid(divide ? 0 : 1) };
+  Value vals[2];
+  std::exception_ptr errors[2];
+  eval_parallel(env, exprs, 2, vals, errors, divide);
+  if (errors[0]) std::rethrow_exception(errors[0]);
+  if (divide && vals[0].get_ival() == 0) EvaluationError::raise(node->get_loc(), "Division by zero");
+  if (errors[1]) std::rethrow_exception(errors[1]);
+
+  int lhs = vals[divide ? 1 : 0].get_ival(), rhs = vals[divide ? 0 : 1].get_ival();
+  switch (tag) {
+    case AST_ADD:           return Value(wrap_add(lhs, rhs));
+    case AST_SUB:           return Value(wrap_sub(lhs, rhs));
+    case AST_MULTIPLY:      return Value(wrap_mul(lhs, rhs));
+    case AST_DIVIDE:        return Value(wrap_div(lhs, rhs));
+    case AST_LESSER:        return Value(lhs < rhs);
+    case AST_LESSER_EQUAL:  return Value(lhs <= rhs);
+    case AST_GREATER:       return Value(lhs > rhs);
+    case AST_GREATER_EQUAL: return Value(lhs >= rhs);
+    case AST_EQUAL_EQUAL:   return Value(lhs == rhs);
+    case AST_NOT_EQUAL:     return Value(lhs != rhs);
+    default:
+      EvaluationError::raise(node->get_loc(), "Unrecognized node type");
+  }
+}
+
+// Evaluate pure expressions, all but the last as tasks while there
+// are idle threads, recording each one's value or error so that the
+// caller can report errors in sequential order. An operand that fails
+// (or, with first_nonzero, a first operand that is 0: a divisor)
+// cancels the operands after it, which are then abandoned; their
+// values and errors are never reported.
+void Interpreter::eval_parallel(Environment &env, Node *const exprs[], unsigned num_exprs, Value results[], std::exception_ptr errors[],
+                                bool first_nonzero) {
+  ParallelGroup group(t_operand, num_exprs);
+  // an operand run by a worker is as deep in calls as the caller
+  unsigned call_depth = t_call_depth;
+  auto evaluate = [this, &env, exprs, &group, first_nonzero, call_depth](unsigned i) -> Value {
+    // fuel the thread took before is not the operand's
+    Operand saved = t_operand;
+    unsigned saved_depth = t_call_depth;
+    return_fuel();
+    t_operand = Operand{ &group, i };
+    t_call_depth = std::max(saved_depth, call_depth);
+    group.operands[i].started = true;
+    try {
+      if (is_cancelled(t_operand)) EvaluationError::raise(exprs[i]->get_loc(), "Evaluation cancelled");
+      Value result = execute_node(env, exprs[i]);
+      if (i == 0 && first_nonzero && result.is_numeric() && result.get_ival() == 0) group.fail(0);
+      return_fuel();
+      t_operand = saved;
+      t_call_depth = saved_depth;
+      return result;
+    } catch (...) {
+      group.fail(i);
+      return_fuel();
+      t_operand = saved;
+      t_call_depth = saved_depth;
+      throw;
+    }
+  };
+
+  std::vector<std::shared_ptr<Task>> tasks(num_exprs);
+  unsigned max_pending = std::max(1u, m_num_task_threads);
+  env.share();
+  for (unsigned i = 0; i + 1 < num_exprs; i++) {
+    if (m_auto_pending.load(std::memory_order_relaxed) >= max_pending) {
+      break;
+    }
+    tasks[i] = create_task(Value(), [evaluate, i]() { return evaluate(i); });
+    m_auto_pending++;
+    std::shared_ptr<Task> task = tasks[i];
+    m_pool->submit([this, task]() { run_task(*task); });
+  }
+  for (unsigned i = 0; i < num_exprs; i++) {
+    if (tasks[i] || is_cancelled(Operand{ &group, i })) continue;
+    try {
+      results[i] = evaluate(i);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  }
+
+  std::vector<std::shared_ptr<Task>> started;
+  std::copy_if(tasks.begin(), tasks.end(), std::back_inserter(started), [](const std::shared_ptr<Task> &t) { return bool(t); });
+  wait_for(started);
+  for (unsigned i = 0; i < num_exprs; i++) {
+    if (!tasks[i]) continue;
+    results[i] = std::move(tasks[i]->result);
+    errors[i] = tasks[i]->error;
+    m_auto_pending--;
+  }
+
+  // Sequentially, the operands after one that ran out of fuel or
+  // memory would not have used any; if they ran, refund their fuel and
+  // the failed operand's (their memory was released as they finished),
+  // and evaluate again in order from the failed operand.
+  unsigned first_failed = group.first_failed.load();
+  if (first_failed >= num_exprs || !errors[first_failed] || !is_budget_error(errors[first_failed])) {
+    return;
+  }
+  uint64_t refund = group.operands[first_failed].fuel.load();
+  bool later_started = false;
+  for (unsigned i = first_failed + 1; i < num_exprs; i++) {
+    refund += group.operands[i].fuel.load();
+    later_started = later_started || group.operands[i].started.load();
+  }
+  if (!later_started) {
+    return;
+  }
+  if (m_fuel_limit > 0 && refund > 0) {
+    m_fuel_taken.fetch_sub(refund, std::memory_order_relaxed);
+    attribute_fuel(t_operand, -int64_t(refund));
+  }
+  for (unsigned i = first_failed; i < num_exprs; i++) {
+    results[i] = Value();
+    errors[i] = nullptr;
+  }
+  for (unsigned i = first_failed; i < num_exprs; i++) {
+    try {
+      results[i] = execute_node(env, exprs[i]);
+    } catch (...) {
+      errors[i] = std::current_exception();
+      break;
+    }
+    if (i == 0 && first_nonzero && results[0].is_numeric() && results[0].get_ival() == 0) break;
+  }
+}
+
+// delete a block's or call's Environment (see ScopedEnv), first
+// waiting for any tasks running functions that were defined in it
+void Interpreter::release_env(Environment *env) {
+  if (env->is_shared()) {
+    std::vector<std::shared_ptr<Task>> capturing;
+    {
+      std::lock_guard<std::mutex> guard(m_tasks_lock);
+      for (auto i = m_tasks.begin(); i != m_tasks.end(); ++i) {
+        if ((*i)->captured == env) capturing.push_back(*i);
+      }
+    }
+    wait_for(capturing);
+  }
+  release_memory(env);
+  delete env;
 }
 
 // recursively execute node based on its type, returning Value object to represent results
 Value Interpreter::execute_node(Environment& env, Node* node) {
+  if (m_profiler != nullptr) {
+    m_profiler->enter_node(node);
+  }
+  Counters::count_node(node->get_tag());
+  if (node->is_parallel_eval() && m_auto_parallel) {
+    return execute_parallel(env, node);
+  }
   int node_tag = node->get_tag();
   switch (node_tag) {
     // arithmetic operators
     case AST_ADD:
-      return Value(execute_node(env, node->get_kid(0)).get_ival() + execute_node(env, node->get_kid(1)).get_ival());
+      return Value(wrap_add(execute_node(env, node->get_kid(0)).get_ival(), execute_node(env, node->get_kid(1)).get_ival()));
     case AST_SUB:
-      return Value(execute_node(env, node->get_kid(0)).get_ival() - execute_node(env, node->get_kid(1)).get_ival());
+      return Value(wrap_sub(execute_node(env, node->get_kid(0)).get_ival(), execute_node(env, node->get_kid(1)).get_ival()));
     case AST_MULTIPLY:
-      return Value(execute_node(env, node->get_kid(0)).get_ival() * execute_node(env, node->get_kid(1)).get_ival());
+      return Value(wrap_mul(execute_node(env, node->get_kid(0)).get_ival(), execute_node(env, node->get_kid(1)).get_ival()));
     case AST_DIVIDE: {
       Value denominator = execute_node(env, node->get_kid(1));
       if (denominator.get_ival() == 0) EvaluationError::raise(node->get_loc(),"Division by zero");
-      return Value(execute_node(env, node->get_kid(0)).get_ival()/denominator.get_ival());
+      return Value(wrap_div(execute_node(env, node->get_kid(0)).get_ival(), denominator.get_ival()));
     }
     case AST_VARREF:
       return env.get_var(node->get_str());
@@ -112,10 +1001,11 @@ Value Interpreter::execute_node(Environment& env, Node* node) {
     case AST_STATEMENT:
       return execute_node(env, node->get_kid(0));
     case AST_VARDEF:
-      return env.create_var(node->get_kid(0)->get_str());
+      charge_memory(BINDING_BYTES, node->get_loc());
+      return env.create_var(node->get_kid(0)->get_str(), node->get_loc());
     // logical operators
     case AST_EQUAL:
-      return env.set_var(node->get_kid(0)->get_str(), execute_node(env, node->get_kid(1)).get_ival());
+      return env.set_var(node->get_kid(0)->get_str(), execute_node(env, node->get_kid(1)).get_ival(), node->get_loc());
     case AST_OR: 
       return Value(execute_node(env, node->get_kid(0)).get_ival() || execute_node(env, node->get_kid(1)).get_ival());
     case AST_AND:
@@ -149,22 +1039,29 @@ Value Interpreter::execute_node(Environment& env, Node* node) {
       if (!while_cond.is_numeric()) EvaluationError::raise(node->get_loc(), "Use of non-numeric value");
       while (while_cond.get_ival() != 0) {
         execute_node(env, node->get_kid(1));
+        if (m_counts_fuel) {
+          spend_fuel(node->get_loc());
+        }
         while_cond = execute_node(env, node->get_kid(0));
         if (!while_cond.is_numeric()) EvaluationError::raise(node->get_loc(), "Use of non-numeric value");
       }
       return Value(0);
     }
     case AST_STMTS: {
-      Environment* new_env = new Environment(&env); // block scope
+      if (m_max_call_depth > 0) {
+        check_nesting(node->get_loc());
+      }
+      charge_memory(sizeof(Environment), node->get_loc());
+      ScopedEnv new_env(new Environment(&env), EnvReleaser{ this }); // block scope
       Value res;
       for (auto it = node->cbegin(); it != node->cend(); ++it) {
         Node* child_node = *it;
         res = execute_node(*new_env, child_node);
       }
-      delete new_env;
       return res;
     }
     case AST_FUNC: {
+      MemoryScope scope(MEM_VALUES);
       std::string func_name = node->get_kid(0)->get_str();
       std::vector<std::string> params;
       if (node->get_num_kids() == 3) { // if function has params
@@ -174,38 +1071,37 @@ Value Interpreter::execute_node(Environment& env, Node* node) {
         }
       }
       Node* func_body = node->get_kid(node->get_num_kids() - 1);
+      charge_memory(BINDING_BYTES, node->get_loc());
       Value func = new Function(func_name, params, &env, func_body);
-      env.bind_func(func_name, func);
+      env.bind_func(func_name, std::move(func), node->get_loc());
       return Value(0);
     }
     case AST_FUNC_CALL: {
       Value func_val = env.retrieve_func(node->get_kid(0)->get_str());
-      Environment* new_env = new Environment(&env);
+      charge_memory(sizeof(Environment), node->get_loc());
+      ScopedEnv new_env(new Environment(&env), EnvReleaser{ this });
       Value result;
       // number of args, if there are args
       int arg_ct = node->get_num_kids() > 1 ? node->get_kid(1)->get_num_kids() : 0;
       Value args[arg_ct];
-      for (int i = 0; i < arg_ct; i++) {
-        args[i] = execute_node(*new_env, node->get_kid(1)->get_kid(i));
-      }
-      if (func_val.get_kind() == VALUE_INTRINSIC_FN) {
-        IntrinsicFn intrin_func = func_val.get_intrinsic_fn();
-        result = intrin_func(args, arg_ct, node->get_loc(), this);
-      } else {
-        Node* start = func_val.get_function()->get_body();
-        std::vector<std::string> params = func_val.get_function()->get_params();
-        if (static_cast<int>(params.size()) != arg_ct) {
-          EvaluationError::raise(node->get_loc(), "Incorect number of function arguments.");
+      if (arg_ct > 0 && node->get_kid(1)->is_parallel_eval() && m_auto_parallel) {
+        Node *args_node = node->get_kid(1);
+        std::vector<Node *> exprs(args_node->cbegin(), args_node->cend());
+        std::vector<std::exception_ptr> errors(arg_ct);
+        eval_parallel(*new_env, exprs.data(), arg_ct, args, errors.data(), false);
+        for (int i = 0; i < arg_ct; i++) {
+          if (errors[i]) std::rethrow_exception(errors[i]);
         }
-        Environment* block_env = new Environment(func_val.get_function()->get_parent_env());
+      } else {
         for (int i = 0; i < arg_ct; i++) {
-          block_env->create_var(params[i]);
-          block_env->set_var(params[i], args[i].get_ival());
+          args[i] = execute_node(*new_env, node->get_kid(1)->get_kid(i));
         }
-        result = execute_node(*block_env, start);
-        delete block_env;
       }
-      delete new_env;
+      {
+        ProfiledCall profiled(m_profiler != nullptr && current_task() == nullptr ? m_profiler : nullptr, node);
+        TracedCall traced(m_tracer, node);
+        result = call_function(func_val, args, arg_ct, node->get_loc());
+      }
       return result;
     }
     default:
@@ -3,27 +3,217 @@
 
 #include "value.h"
 #include "environment.h"
+#include "io.h"
 #include <unordered_set>
+#include <unordered_map>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <exception>
 class Node;
 class Location;
+class WorkStealingPool;
+class Profiler;
+class Tracer;
 
 class Interpreter {
 private:
+  // A call run in parallel, by spawn or parfor. Its function's
+  // defining Environment (and that Environment's ancestors) are shared
+  // with the task, read-only; its own locals are private to it.
+  struct Task {
+    unsigned id;                 // owner id of the Environments it creates
+    std::function<Value()> body;
+    Environment *captured;       // nullptr for an intrinsic
+    std::atomic<bool> started;   // claimed by a worker, or by a thread waiting for it
+    std::atomic<bool> done;
+    Value result;
+    std::exception_ptr error;
+    std::string output;          // buffered output, in ordered mode
+    Task *joining;               // the task it is joining, under m_tasks_lock
+  };
+
   Node *m_ast;
+  bool m_owns_ast;
+  IOHandler *m_io;
+  std::mutex m_io_lock;
+
+  // Optional budgets. Loop iterations and calls spend fuel: each
+  // thread takes a share of the run's fuel (up to FUEL_SHARE units) at
+  // a time, and the deadline is checked whenever it takes another, so
+  // fuel is counted (when either limit is set) with a decrement. The
+  // memory in use is charged as Environments and bindings are created.
+  bool m_counts_fuel;                   // a deadline or fuel limit is set, or auto-parallel
+                                        // operands may need to be cancelled
+  bool m_has_deadline;
+  std::chrono::steady_clock::time_point m_deadline;
+  uint64_t m_fuel_limit;                // 0 for none
+  std::atomic<uint64_t> m_fuel_taken;   // shares taken by threads, this run
+  size_t m_memory_limit;                // 0 for none
+  std::atomic<size_t> m_memory_used;    // estimated, this run
+  unsigned m_max_call_depth;            // 0 for none
+  unsigned m_budget_run;                // identifies the run's fuel shares
+
+  // tasks: the pool is created by the first spawn or parfor
+  unsigned m_num_task_threads;
+  bool m_ordered_output;
+  std::unique_ptr<WorkStealingPool> m_pool;
+  std::mutex m_tasks_lock;                  // protects m_tasks and Task::joining
+  std::vector<std::shared_ptr<Task>> m_tasks; // spawned tasks, by handle - 1
+  std::atomic<unsigned> m_next_task_id;
+  bool m_auto_parallel;
+  std::atomic<unsigned> m_auto_pending;     // subexpression tasks not yet finished
+  Profiler *m_profiler;
+  Tracer *m_tracer;
+  // the tasks running on this thread, innermost last: a thread waiting
+  // for tasks runs them above the task it is running
+  static thread_local std::vector<Task *> s_running_tasks;
+
+  // protects the lazy body tables below
+  std::mutex m_lazy_lock;
+
+  // state carried between calls to execute_next
+  std::unordered_set<std::string> m_global_vars;
+  std::unique_ptr<Environment> m_global_env;
+
+  // for lazily parsed function bodies (AST_LAZY_STMTS): the top-level
+  // statement defining each body, recorded by check_vars (the names
+  // visible to it are collected again when it is parsed), and the
+  // parsed bodies
+  Node *m_checking_stmt;   // the top-level statement check_vars is in
+  std::unordered_map<Node *, Node *> m_lazy_scopes;
+  std::unordered_map<Node *, std::unique_ptr<Node>> m_parsed_bodies;
 
 public:
   Interpreter(Node *ast_to_adopt);
+  // execute a (fully parsed, analyzed) AST owned by the caller, which
+  // is not modified, so it can be shared by many Interpreters
+  Interpreter(const Node *ast, IOHandler *io);
   ~Interpreter();
 
+  void set_io(IOHandler *io) { m_io = io; }
+
+  // Execute a different shared AST (see the constructor above) in
+  // subsequent runs, keeping the Interpreter's pool and storage. The
+  // previous run's tasks finish first, and its global Environment and
+  // lazily parsed bodies, which refer to the old AST, are dropped.
+  void set_ast(const Node *ast);
+
+  // Budgets for each run, which raise an EvaluationError at the node
+  // being executed when they are exceeded. Executing past the deadline
+  // raises "Time limit exceeded" (checked at least every FUEL_SHARE
+  // loop iterations and calls on each thread).
+  void set_deadline(std::chrono::steady_clock::time_point deadline);
+  void clear_deadline() { m_has_deadline = false; update_counts_fuel(); }
+  // Each loop iteration and call (including intrinsics) spends a unit
+  // of fuel; running out raises "Fuel exhausted". 0 means no limit.
+  void set_fuel_limit(uint64_t fuel) { m_fuel_limit = fuel; update_counts_fuel(); }
+  // Environments and the variables and functions bound in them are
+  // charged at an estimate of their size (the Values are in the
+  // bindings); going over the limit raises "Memory limit exceeded".
+  // 0 means no limit.
+  void set_memory_limit(size_t bytes) { m_memory_limit = bytes; }
+  // Calls nested deeper than this on a thread raise "Call depth limit
+  // exceeded" instead of overflowing its native stack. 0 means no limit.
+  void set_max_call_depth(unsigned depth) { m_max_call_depth = depth; }
+  IOHandler *get_io() const { return m_io; }
+
+  // Threads used to run tasks (spawn, parfor); the default is
+  // the number of CPUs. The calling thread also runs tasks while it
+  // waits for them.
+  void set_task_threads(unsigned num_threads) { m_num_task_threads = num_threads; }
+
+  // In ordered mode, the output of a task is held back until the task
+  // is joined (and for parfor, until the loop completes, in index
+  // order), so output doesn't depend on scheduling. Otherwise output
+  // appears as it is written.
+  void set_ordered_output(bool ordered) { m_ordered_output = ordered; }
+
+  // Evaluate the subexpressions marked by PurityAnalysis (purity.h)
+  // in parallel when there are idle task threads. Results, including
+  // which error is raised when several operands fail, are the same as
+  // for left-to-right evaluation: once an operand fails, those after
+  // it are cancelled (checked where fuel is taken), and if it failed
+  // for want of fuel or memory while later operands ran, they are
+  // refunded and it is evaluated again, followed by the rest in order.
+  void set_auto_parallel(bool auto_parallel) { m_auto_parallel = auto_parallel; update_counts_fuel(); }
+
+  // Report the executing node and calls to the profiler (which may be
+  // null). Only calls made by the thread running the program are
+  // tracked, so samples taken while tasks run are attributed to the
+  // most recently entered node, but not to a function in a task.
+  void set_profiler(Profiler *profiler) { m_profiler = profiler; }
+
+  // Record calls (at their AST_FUNC_CALL nodes, on any thread) and
+  // waits for input in readint with the tracer (which may be null).
+  void set_tracer(Tracer *tracer) { m_tracer = tracer; }
+
   void analyze();
+  // may be called repeatedly; the global Environment is reused
   Value execute();
 
+  // Streaming use: the Interpreter is created with an empty unit, and
+  // each top-level statement is appended to it, analyzed against the
+  // names defined by the statements before it, and executed in the
+  // global Environment they share.
+  Value execute_next(Node *stmt_to_adopt);
+
+  Node *get_ast() const { return m_ast; }
+
+  // find the intrinsic function with the given name (nullptr if none)
+  static IntrinsicFn lookup_intrinsic(const std::string &name);
+  static const std::string &get_intrinsic_name(IntrinsicFn fn);
+
 private:
+  // owns a block's or call's Environment, deleting it through
+  // release_env when it goes out of scope, including when an error
+  // unwinds the block
+  struct EnvReleaser {
+    Interpreter *interp;
+    void operator()(Environment *env) const { interp->release_env(env); }
+  };
+  typedef std::unique_ptr<Environment, EnvReleaser> ScopedEnv;
+
+  Environment *create_global_env();
+  static void bind_intrinsics(Environment &env);
+  static void write_output(Interpreter *interp, const std::string &text, bool flush);
   void check_vars(std::unordered_set<std::string>& var_set, Node* parent);
+  Node *parse_lazy_body(Node *lazy_body);
+  static void define_top_level_names(std::unordered_set<std::string> &var_set, Node *node);
   Value execute_node(Environment& env, Node* node);
+  Value call_function(const Value &func_val, Value args[], unsigned arg_ct, const Location &loc);
+  void release_env(Environment *env);
+  void check_nesting(const Location &loc);
+  void spend_fuel(const Location &loc);
+  void take_fuel(const Location &loc);
+  void return_fuel();
+  void update_counts_fuel() { m_counts_fuel = m_has_deadline || m_fuel_limit > 0 || m_auto_parallel; }
+  void charge_memory(size_t bytes, const Location &loc);
+  void release_memory(Environment *env);
+  Value execute_parallel(Environment &env, Node *node);
+  void eval_parallel(Environment &env, Node *const exprs[], unsigned num_exprs, Value results[], std::exception_ptr errors[],
+                     bool first_nonzero);
+
+  // tasks
+  std::shared_ptr<Task> create_task(const Value &func, std::function<Value()> body);
+  void run_task(Task &task);
+  static Task *current_task() { return s_running_tasks.empty() ? nullptr : s_running_tasks.back(); }
+  static bool is_running(const Task *task);
+  void wait_for(const std::vector<std::shared_ptr<Task>> &tasks);
+  void wait_for(const std::vector<std::shared_ptr<Task>> &tasks, const Location &loc);
+  static bool all_done(const std::vector<std::shared_ptr<Task>> &tasks);
+  Value finish_task(Task &task);
+  void finish_all_tasks();
+
   static Value intrinsic_readint(Value args[], unsigned arg_ct, const Location &loc, Interpreter *interp);
   static Value intrinsic_print(Value args[], unsigned arg_ct, const Location &loc, Interpreter *interp);
   static Value intrinsic_println(Value args[], unsigned arg_ct, const Location &loc, Interpreter *interp);
+  static Value intrinsic_spawn(Value args[], unsigned arg_ct, const Location &loc, Interpreter *interp);
+  static Value intrinsic_join(Value args[], unsigned arg_ct, const Location &loc, Interpreter *interp);
+  static Value intrinsic_parfor(Value args[], unsigned arg_ct, const Location &loc, Interpreter *interp);
 };
 
 #endif // INTERP_H
@@ -0,0 +1,69 @@
+#include <iostream>
+#include "io.h"
+#include "memstats.h"
+
+namespace {
+
+class StdIOHandler : public IOHandler {
+public:
+  virtual void write(const std::string &text) {
+    std::cout << text;
+  }
+
+  virtual void flush() {
+    std::cout.flush();
+  }
+
+  virtual int read_int() {
+    // a failed extraction stores 0
+    int i = 0;
+    std::cin >> i;
+    return i;
+  }
+};
+
+}
+
+IOHandler::IOHandler() {
+}
+
+IOHandler::~IOHandler() {
+}
+
+void IOHandler::flush() {
+}
+
+bool IOHandler::would_block() {
+  return false;
+}
+
+IOHandler *IOHandler::get_stdio() {
+  static StdIOHandler s_stdio;
+  return &s_stdio;
+}
+
+StringIOHandler::StringIOHandler(const std::string &input)
+  : m_input(input) {
+}
+
+StringIOHandler::~StringIOHandler() {
+}
+
+void StringIOHandler::reset(const std::string &input) {
+  MemoryScope scope(MEM_IO);
+  m_input.clear();
+  m_input.str(input);
+  m_output.clear();
+}
+
+void StringIOHandler::write(const std::string &text) {
+  MemoryScope scope(MEM_IO);
+  m_output += text;
+}
+
+// same parsing as standard input
+int StringIOHandler::read_int() {
+  int i = 0;
+  m_input >> i;
+  return i;
+}
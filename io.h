@@ -0,0 +1,59 @@
+#ifndef IO_H
+#define IO_H
+
+#include <string>
+#include <sstream>
+
+// Where the print, println, and readint intrinsics send output and
+// get input. Embedders supply their own implementation to capture
+// output or feed input (see minilang.h); the default uses the
+// process's standard output and input.
+class IOHandler {
+public:
+  IOHandler();
+  virtual ~IOHandler();
+
+  virtual void write(const std::string &text) = 0;
+
+  // called after println, so output is visible a line at a time
+  virtual void flush();
+
+  // 0 if there is no more (valid) input
+  virtual int read_int() = 0;
+
+  // true if read_int can't return yet because the input it needs
+  // hasn't arrived; a suspendable VM then suspends instead of calling
+  // it (see VM::resume). Blocking handlers return false.
+  virtual bool would_block();
+
+  // the handler for standard output and input
+  static IOHandler *get_stdio();
+
+private:
+  // value semantics prohibited
+  IOHandler(const IOHandler &);
+  IOHandler &operator=(const IOHandler &);
+};
+
+// Reads input from, and collects output in, strings: for running
+// programs whose I/O isn't the process's own (batch jobs, servers).
+class StringIOHandler : public IOHandler {
+private:
+  std::istringstream m_input;
+  std::string m_output;
+
+public:
+  StringIOHandler(const std::string &input = "");
+  virtual ~StringIOHandler();
+
+  // start over with new input and no output
+  void reset(const std::string &input);
+
+  const std::string &get_output() const { return m_output; }
+  std::string &get_output() { return m_output; }
+
+  virtual void write(const std::string &text);
+  virtual int read_int();
+};
+
+#endif // IO_H
@@ -0,0 +1,354 @@
+#include <cassert>
+#include <algorithm>
+#include "cpputil.h"
+#include "exceptions.h"
+#include "ir.h"
+
+namespace {
+
+const char *opcode_to_str(IROpcode opcode) {
+  switch (opcode) {
+    case IR_CONST:   return "const";
+    case IR_PARAM:   return "param";
+    case IR_COPY:    return "copy";
+    case IR_PHI:     return "phi";
+    case IR_ADD:     return "add";
+    case IR_SUB:     return "sub";
+    case IR_MUL:     return "mul";
+    case IR_DIV:     return "div";
+    case IR_SHL:     return "shl";
+    case IR_LT:      return "lt";
+    case IR_LE:      return "le";
+    case IR_GT:      return "gt";
+    case IR_GE:      return "ge";
+    case IR_EQ:      return "eq";
+    case IR_NE:      return "ne";
+    case IR_CHKZERO: return "chkzero";
+    case IR_LOADG:   return "loadg";
+    case IR_STOREG:  return "storeg";
+    case IR_CALL:    return "call";
+    case IR_CALLI:   return "calli";
+    case IR_JUMP:    return "jump";
+    case IR_BRANCH:  return "branch";
+    case IR_RET:     return "ret";
+    default:
+      RuntimeError::raise("Unknown IR opcode %d", int(opcode));
+  }
+}
+
+// follow a chain of replacements to its final value
+IRInstr *resolve(std::vector<IRInstr *> &repl, IRInstr *ins) {
+  IRInstr *res = ins;
+  while (repl[res->get_id()] != nullptr) {
+    res = repl[res->get_id()];
+  }
+  // path compression
+  while (ins != res) {
+    IRInstr *next = repl[ins->get_id()];
+    repl[ins->get_id()] = res;
+    ins = next;
+  }
+  return res;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// IRInstr member functions
+////////////////////////////////////////////////////////////////////////
+
+IRInstr::IRInstr(int id, IROpcode opcode, int imm)
+  : m_id(id)
+  , m_opcode(opcode)
+  , m_imm(imm)
+  , m_block(nullptr)
+  , m_intrinsic(nullptr) {
+}
+
+IRInstr::~IRInstr() {
+}
+
+bool IRInstr::is_pure() const {
+  switch (m_opcode) {
+    case IR_CONST: case IR_PARAM: case IR_COPY: case IR_PHI:
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_SHL:
+    case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+    case IR_LOADG:
+      return true;
+    case IR_DIV:
+      // the divisor is always guarded by a chkzero (or proven nonzero),
+      // so an unused division can be dropped
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IRInstr::is_binary() const {
+  return (m_opcode >= IR_ADD && m_opcode <= IR_DIV) || (m_opcode >= IR_LT && m_opcode <= IR_NE);
+}
+
+////////////////////////////////////////////////////////////////////////
+// IRBlock member functions
+////////////////////////////////////////////////////////////////////////
+
+IRBlock::IRBlock(int id)
+  : m_id(id) {
+}
+
+IRBlock::~IRBlock() {
+}
+
+void IRBlock::append_instr(IRInstr *ins) {
+  assert(m_instrs.empty() || !m_instrs.back()->is_terminator());
+  ins->set_block(this);
+  m_instrs.push_back(ins);
+}
+
+void IRBlock::insert_before_terminator(IRInstr *ins) {
+  assert(!m_instrs.empty() && m_instrs.back()->is_terminator());
+  ins->set_block(this);
+  m_instrs.insert(m_instrs.end() - 1, ins);
+}
+
+void IRBlock::insert_after_phis(IRInstr *ins) {
+  auto i = m_instrs.begin();
+  while (i != m_instrs.end() && (*i)->get_opcode() == IR_PHI) {
+    ++i;
+  }
+  ins->set_block(this);
+  m_instrs.insert(i, ins);
+}
+
+IRInstr *IRBlock::get_terminator() const {
+  if (m_instrs.empty() || !m_instrs.back()->is_terminator()) {
+    return nullptr;
+  }
+  return m_instrs.back();
+}
+
+int IRBlock::get_pred_index(IRBlock *pred) const {
+  for (unsigned i = 0; i < m_preds.size(); i++) {
+    if (m_preds[i] == pred) {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+void IRBlock::replace_succ(IRBlock *old_succ, IRBlock *new_succ) {
+  std::replace(m_succs.begin(), m_succs.end(), old_succ, new_succ);
+}
+
+void IRBlock::replace_pred(IRBlock *old_pred, IRBlock *new_pred) {
+  std::replace(m_preds.begin(), m_preds.end(), old_pred, new_pred);
+}
+
+void IRBlock::remove_pred(unsigned index) {
+  m_preds.erase(m_preds.begin() + index);
+  for (auto i = m_instrs.begin(); i != m_instrs.end() && (*i)->get_opcode() == IR_PHI; ++i) {
+    std::vector<IRInstr *> operands = (*i)->get_operands();
+    operands.erase(operands.begin() + index);
+    (*i)->clear_operands();
+    for (auto j = operands.begin(); j != operands.end(); ++j) {
+      (*i)->append_operand(*j);
+    }
+  }
+}
+
+void IRBlock::remove_succ(unsigned index) {
+  IRBlock *succ = m_succs.at(index);
+  m_succs.erase(m_succs.begin() + index);
+  succ->remove_pred(unsigned(succ->get_pred_index(this)));
+}
+
+void IRBlock::add_succ(IRBlock *succ) {
+  m_succs.push_back(succ);
+  succ->m_preds.push_back(this);
+}
+
+////////////////////////////////////////////////////////////////////////
+// IRFunction member functions
+////////////////////////////////////////////////////////////////////////
+
+IRFunction::IRFunction(const std::string &name, unsigned num_params)
+  : m_name(name)
+  , m_num_params(num_params)
+  , m_next_block_id(0) {
+}
+
+IRFunction::~IRFunction() {
+  for (auto i = m_blocks.begin(); i != m_blocks.end(); ++i) {
+    delete *i;
+  }
+  for (auto i = m_all_instrs.begin(); i != m_all_instrs.end(); ++i) {
+    delete *i;
+  }
+}
+
+IRBlock *IRFunction::create_block() {
+  IRBlock *block = new IRBlock(m_next_block_id++);
+  m_blocks.push_back(block);
+  return block;
+}
+
+IRInstr *IRFunction::create_instr(IROpcode opcode, int imm) {
+  IRInstr *ins = new IRInstr(int(m_all_instrs.size()), opcode, imm);
+  m_all_instrs.push_back(ins);
+  return ins;
+}
+
+unsigned IRFunction::count_instrs() const {
+  unsigned count = 0;
+  for (auto i = m_blocks.begin(); i != m_blocks.end(); ++i) {
+    count += unsigned((*i)->get_instrs().size());
+  }
+  return count;
+}
+
+void IRFunction::apply_replacements(std::vector<IRInstr *> &repl) {
+  repl.resize(m_all_instrs.size(), nullptr);
+  for (auto b = m_blocks.begin(); b != m_blocks.end(); ++b) {
+    std::vector<IRInstr *> &instrs = (*b)->get_instrs();
+    std::vector<IRInstr *> kept;
+    kept.reserve(instrs.size());
+    for (auto i = instrs.begin(); i != instrs.end(); ++i) {
+      IRInstr *ins = *i;
+      if (repl[ins->get_id()] != nullptr) {
+        ins->set_block(nullptr);
+        continue;
+      }
+      for (unsigned j = 0; j < ins->get_num_operands(); j++) {
+        ins->set_operand(j, resolve(repl, ins->get_operand(j)));
+      }
+      kept.push_back(ins);
+    }
+    instrs.swap(kept);
+  }
+}
+
+void IRFunction::remove_unreachable_blocks() {
+  std::vector<bool> reached(m_next_block_id, false);
+  std::vector<IRBlock *> worklist = { get_entry() };
+  reached[get_entry()->get_id()] = true;
+  while (!worklist.empty()) {
+    IRBlock *block = worklist.back();
+    worklist.pop_back();
+    for (auto s = block->get_succs().begin(); s != block->get_succs().end(); ++s) {
+      if (!reached[(*s)->get_id()]) {
+        reached[(*s)->get_id()] = true;
+        worklist.push_back(*s);
+      }
+    }
+  }
+
+  std::vector<IRBlock *> kept;
+  for (auto b = m_blocks.begin(); b != m_blocks.end(); ++b) {
+    if (reached[(*b)->get_id()]) {
+      kept.push_back(*b);
+    }
+  }
+
+  // detach edges from unreachable predecessors before deleting them
+  for (auto b = kept.begin(); b != kept.end(); ++b) {
+    for (int i = int((*b)->get_preds().size()) - 1; i >= 0; i--) {
+      if (!reached[(*b)->get_preds()[i]->get_id()]) {
+        (*b)->remove_pred(unsigned(i));
+      }
+    }
+  }
+  for (auto b = m_blocks.begin(); b != m_blocks.end(); ++b) {
+    if (!reached[(*b)->get_id()]) {
+      delete *b;
+    }
+  }
+  m_blocks.swap(kept);
+}
+
+void IRFunction::print(FILE *out) const {
+  fprintf(out, "function %s(%u params)\n", m_name.c_str(), m_num_params);
+  for (auto b = m_blocks.begin(); b != m_blocks.end(); ++b) {
+    const IRBlock *block = *b;
+    fprintf(out, "b%d:", block->get_id());
+    if (!block->get_preds().empty()) {
+      fprintf(out, "  ; preds");
+      for (auto p = block->get_preds().begin(); p != block->get_preds().end(); ++p) {
+        fprintf(out, " b%d", (*p)->get_id());
+      }
+    }
+    fprintf(out, "\n");
+
+    for (auto i = block->get_instrs().begin(); i != block->get_instrs().end(); ++i) {
+      const IRInstr *ins = *i;
+      IROpcode opcode = ins->get_opcode();
+
+      // collect the instruction's arguments, then print them comma-separated
+      std::vector<std::string> args;
+      if (opcode == IR_CONST || opcode == IR_PARAM) {
+        args.push_back(cpputil::format("%d", ins->get_imm()));
+      } else if (opcode == IR_LOADG || opcode == IR_STOREG) {
+        args.push_back(cpputil::format("@%d", ins->get_imm()));
+      } else if (opcode == IR_CALL || opcode == IR_CALLI) {
+        args.push_back(ins->get_name());
+      }
+      for (unsigned j = 0; j < ins->get_num_operands(); j++) {
+        if (opcode == IR_PHI) {
+          args.push_back(cpputil::format("%%%d [b%d]", ins->get_operand(j)->get_id(), block->get_preds().at(j)->get_id()));
+        } else {
+          args.push_back(cpputil::format("%%%d", ins->get_operand(j)->get_id()));
+        }
+      }
+      if (opcode == IR_SHL) {
+        args.push_back(cpputil::format("%d", ins->get_imm()));
+      } else if (opcode == IR_JUMP || opcode == IR_BRANCH) {
+        for (auto s = block->get_succs().begin(); s != block->get_succs().end(); ++s) {
+          args.push_back(cpputil::format("b%d", (*s)->get_id()));
+        }
+      }
+
+      fprintf(out, "  ");
+      if (!ins->is_terminator()) {
+        fprintf(out, "%%%d = ", ins->get_id());
+      }
+      fprintf(out, "%s", opcode_to_str(opcode));
+      for (unsigned j = 0; j < args.size(); j++) {
+        fprintf(out, "%s %s", j == 0 ? "" : ",", args[j].c_str());
+      }
+      fprintf(out, "\n");
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// IRModule member functions
+////////////////////////////////////////////////////////////////////////
+
+IRModule::IRModule()
+  : m_main(-1) {
+}
+
+IRModule::~IRModule() {
+  for (auto i = m_functions.begin(); i != m_functions.end(); ++i) {
+    delete *i;
+  }
+}
+
+int IRModule::add_function(IRFunction *fn) {
+  m_functions.push_back(fn);
+  return int(m_functions.size()) - 1;
+}
+
+int IRModule::add_global(const std::string &name) {
+  m_globals.push_back(name);
+  return int(m_globals.size()) - 1;
+}
+
+void IRModule::print(FILE *out) const {
+  for (unsigned i = 0; i < m_globals.size(); i++) {
+    fprintf(out, "global @%u %s\n", i, m_globals[i].c_str());
+  }
+  for (auto i = m_functions.begin(); i != m_functions.end(); ++i) {
+    fprintf(out, "\n");
+    (*i)->print(out);
+  }
+}
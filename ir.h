@@ -0,0 +1,214 @@
+#ifndef IR_H
+#define IR_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "location.h"
+#include "value.h"
+
+// Mid-level intermediate representation: each function is a
+// control flow graph of basic blocks, and each instruction
+// defines (at most) one SSA value. Variables declared with "var"
+// become SSA values, except for top-level variables that are
+// visible to functions, which are kept in global slots and
+// accessed with explicit loads and stores.
+
+enum IROpcode {
+  IR_CONST,    // integer constant (m_imm)
+  IR_PARAM,    // function parameter (m_imm is the index)
+  IR_COPY,     // copy of operand 0
+  IR_PHI,      // one operand per predecessor block, in predecessor order
+  IR_ADD,
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,
+  IR_SHL,      // operand 0 shifted left by m_imm bits
+  IR_LT,
+  IR_LE,
+  IR_GT,
+  IR_GE,
+  IR_EQ,
+  IR_NE,
+  IR_CHKZERO,  // raises "Division by zero" if operand 0 is 0, otherwise yields it
+  IR_LOADG,    // load global slot m_imm
+  IR_STOREG,   // store operand 0 to global slot m_imm, yields the stored value
+  IR_CALL,     // call user function m_imm, operands are the arguments
+  IR_CALLI,    // call intrinsic function m_intrinsic, operands are the arguments
+  IR_JUMP,     // unconditional branch to the block's only successor
+  IR_BRANCH,   // branch to successor 0 if operand 0 is nonzero, else successor 1
+  IR_RET,      // return operand 0
+};
+
+class IRBlock;
+
+class IRInstr {
+private:
+  int m_id;
+  IROpcode m_opcode;
+  int m_imm;
+  std::vector<IRInstr *> m_operands;
+  IRBlock *m_block;
+  std::string m_name;        // callee name (calls only)
+  IntrinsicFn m_intrinsic;   // IR_CALLI only
+  Location m_loc;
+
+  // value semantics prohibited
+  IRInstr(const IRInstr &);
+  IRInstr &operator=(const IRInstr &);
+
+public:
+  IRInstr(int id, IROpcode opcode, int imm = 0);
+  ~IRInstr();
+
+  int get_id() const { return m_id; }
+  IROpcode get_opcode() const { return m_opcode; }
+  void set_opcode(IROpcode opcode) { m_opcode = opcode; }
+  int get_imm() const { return m_imm; }
+  void set_imm(int imm) { m_imm = imm; }
+
+  unsigned get_num_operands() const { return unsigned(m_operands.size()); }
+  IRInstr *get_operand(unsigned index) const { return m_operands.at(index); }
+  void set_operand(unsigned index, IRInstr *val) { m_operands.at(index) = val; }
+  void append_operand(IRInstr *val) { m_operands.push_back(val); }
+  void clear_operands() { m_operands.clear(); }
+  const std::vector<IRInstr *> &get_operands() const { return m_operands; }
+
+  IRBlock *get_block() const { return m_block; }
+  void set_block(IRBlock *block) { m_block = block; }
+
+  const std::string &get_name() const { return m_name; }
+  void set_name(const std::string &name) { m_name = name; }
+
+  IntrinsicFn get_intrinsic() const { return m_intrinsic; }
+  void set_intrinsic(IntrinsicFn fn) { m_intrinsic = fn; }
+
+  const Location &get_loc() const { return m_loc; }
+  void set_loc(const Location &loc) { m_loc = loc; }
+
+  bool is_terminator() const { return m_opcode >= IR_JUMP; }
+  bool is_const() const { return m_opcode == IR_CONST; }
+
+  // true if the instruction has no effect other than computing its
+  // value, so it can be removed when unused or merged with an
+  // identical instruction
+  bool is_pure() const;
+
+  // true for binary arithmetic and comparison instructions
+  bool is_binary() const;
+};
+
+class IRBlock {
+private:
+  int m_id;
+  std::vector<IRInstr *> m_instrs;
+  std::vector<IRBlock *> m_preds;
+  std::vector<IRBlock *> m_succs;
+
+  // value semantics prohibited
+  IRBlock(const IRBlock &);
+  IRBlock &operator=(const IRBlock &);
+
+public:
+  IRBlock(int id);
+  ~IRBlock();
+
+  int get_id() const { return m_id; }
+
+  std::vector<IRInstr *> &get_instrs() { return m_instrs; }
+  const std::vector<IRInstr *> &get_instrs() const { return m_instrs; }
+  void append_instr(IRInstr *ins);
+  // insert before the block's terminator
+  void insert_before_terminator(IRInstr *ins);
+  // insert after the block's phi instructions
+  void insert_after_phis(IRInstr *ins);
+  IRInstr *get_terminator() const;
+
+  const std::vector<IRBlock *> &get_preds() const { return m_preds; }
+  const std::vector<IRBlock *> &get_succs() const { return m_succs; }
+  int get_pred_index(IRBlock *pred) const;
+  void replace_succ(IRBlock *old_succ, IRBlock *new_succ);
+  void replace_pred(IRBlock *old_pred, IRBlock *new_pred);
+  // remove a predecessor edge, along with the matching phi operands
+  void remove_pred(unsigned index);
+  // remove a successor edge (and the corresponding predecessor edge)
+  void remove_succ(unsigned index);
+
+  // add a control flow edge from this block to succ
+  void add_succ(IRBlock *succ);
+};
+
+class IRFunction {
+private:
+  std::string m_name;
+  unsigned m_num_params;
+  std::vector<IRBlock *> m_blocks;   // m_blocks[0] is the entry block
+  std::vector<IRInstr *> m_all_instrs;
+  int m_next_block_id;
+
+  // value semantics prohibited
+  IRFunction(const IRFunction &);
+  IRFunction &operator=(const IRFunction &);
+
+public:
+  IRFunction(const std::string &name, unsigned num_params);
+  ~IRFunction();
+
+  const std::string &get_name() const { return m_name; }
+  unsigned get_num_params() const { return m_num_params; }
+
+  IRBlock *create_block();
+  // create an instruction owned by this function (but not yet
+  // placed in any block)
+  IRInstr *create_instr(IROpcode opcode, int imm = 0);
+
+  IRBlock *get_entry() const { return m_blocks.at(0); }
+  std::vector<IRBlock *> &get_blocks() { return m_blocks; }
+  const std::vector<IRBlock *> &get_blocks() const { return m_blocks; }
+
+  // upper bound on instruction ids, for indexing per-value tables
+  int get_num_ids() const { return int(m_all_instrs.size()); }
+
+  // number of instructions currently placed in blocks
+  unsigned count_instrs() const;
+
+  // replace every operand that appears as a key in repl
+  // (following chains of replacements) and drop replaced
+  // instructions from their blocks
+  void apply_replacements(std::vector<IRInstr *> &repl);
+
+  // remove blocks not reachable from the entry block
+  void remove_unreachable_blocks();
+
+  void print(FILE *out) const;
+};
+
+class IRModule {
+private:
+  std::vector<IRFunction *> m_functions;
+  std::vector<std::string> m_globals;
+  int m_main;
+
+  // value semantics prohibited
+  IRModule(const IRModule &);
+  IRModule &operator=(const IRModule &);
+
+public:
+  IRModule();
+  ~IRModule();
+
+  int add_function(IRFunction *fn);
+  IRFunction *get_function(int index) const { return m_functions.at(index); }
+  unsigned get_num_functions() const { return unsigned(m_functions.size()); }
+
+  int add_global(const std::string &name);
+  unsigned get_num_globals() const { return unsigned(m_globals.size()); }
+  const std::string &get_global_name(int index) const { return m_globals.at(index); }
+
+  void set_main(int index) { m_main = index; }
+  IRFunction *get_main() const { return m_functions.at(m_main); }
+
+  void print(FILE *out) const;
+};
+
+#endif // IR_H
@@ -0,0 +1,441 @@
+#include <cassert>
+#include <memory>
+#include "ast.h"
+#include "node.h"
+#include "exceptions.h"
+#include "interp.h"
+#include "irbuilder.h"
+
+////////////////////////////////////////////////////////////////////////
+// IRBuilder implementation
+////////////////////////////////////////////////////////////////////////
+
+// Scope layout: m_scopes[0] holds the intrinsic functions,
+// m_scopes[1] holds top-level definitions, and each function
+// body or statement list pushes a further scope.
+
+IRBuilder::IRBuilder()
+  : m_module(nullptr)
+  , m_state(nullptr)
+  , m_next_var(0) {
+}
+
+IRBuilder::~IRBuilder() {
+}
+
+IRModule *IRBuilder::build(Node *unit) {
+  std::unique_ptr<IRModule> module(new IRModule());
+  m_module = module.get();
+
+  m_scopes.clear();
+  m_scopes.push_back(Scope());
+  const char *intrinsics[] = { "print", "println", "readint" };
+  for (const char *name : intrinsics) {
+    define(name, { BINDING_INTRINSIC, -1, Interpreter::lookup_intrinsic(name) });
+  }
+  m_scopes.push_back(Scope());
+
+  prescan(unit);
+
+  // the top-level statements become the body of the main function
+  FnState state;
+  state.fn = new IRFunction("<main>", 0);
+  module->set_main(module->add_function(state.fn));
+  state.scope_base = 1;
+  m_state = &state;
+  state.cur = new_block(true);
+
+  IRInstr *result = emit_const(0);
+  for (auto i = unit->cbegin(); i != unit->cend(); ++i) {
+    result = lower(*i);
+  }
+  emit(IR_RET, result);
+
+  m_state = nullptr;
+  m_module = nullptr;
+  return module.release();
+}
+
+// Determine which top-level variables must live in global slots
+// (those whose names are mentioned in function bodies), and
+// check that function bindings are never changed at runtime,
+// so calls can be bound statically.
+void IRBuilder::prescan(Node *unit) {
+  std::unordered_set<std::string> func_names, var_names;
+  for (auto i = unit->cbegin(); i != unit->cend(); ++i) {
+    Node *stmt = *i;
+    if (stmt->get_tag() == AST_FUNC) {
+      std::string name = stmt->get_kid(0)->get_str();
+      if (!func_names.insert(name).second) {
+        RuntimeError::raise("IR lowering does not support redefinition of function '%s'", name.c_str());
+      }
+      stmt->get_last_kid()->preorder([this](Node *n) {
+        if (n->get_tag() == AST_VARREF) {
+          m_names_used_in_functions.insert(n->get_str());
+        }
+      });
+    } else if (stmt->get_kid(0)->get_tag() == AST_VARDEF) {
+      var_names.insert(stmt->get_kid(0)->get_kid(0)->get_str());
+    }
+  }
+  for (auto i = func_names.begin(); i != func_names.end(); ++i) {
+    if (var_names.count(*i) > 0) {
+      RuntimeError::raise("IR lowering does not support rebinding function '%s' as a variable", i->c_str());
+    }
+  }
+}
+
+void IRBuilder::lower_function(Node *func) {
+  std::string name = func->get_kid(0)->get_str();
+  Node *params = func->get_num_kids() == 3 ? func->get_kid(1) : nullptr;
+  unsigned num_params = params ? params->get_num_kids() : 0;
+
+  // bind the name before lowering the body, so recursive calls resolve
+  FnState state;
+  state.fn = new IRFunction(name, num_params);
+  int index = m_module->add_function(state.fn);
+  m_func_index[name] = index;
+  define(name, { BINDING_FUNC, index, nullptr });
+
+  FnState *saved_state = m_state;
+  m_state = &state;
+  state.cur = new_block(true);
+
+  // parameters live in their own scope, enclosing the body's scope
+  state.scope_base = unsigned(m_scopes.size());
+  m_scopes.push_back(Scope());
+  for (unsigned i = 0; i < num_params; i++) {
+    int var = m_next_var++;
+    define(params->get_kid(i)->get_str(), { BINDING_LOCAL, var, nullptr });
+    write_var(var, state.cur, emit(IR_PARAM, int(i)));
+  }
+  IRInstr *result = lower_stmts(func->get_last_kid());
+  emit(IR_RET, result);
+  m_scopes.pop_back();
+
+  m_state = saved_state;
+}
+
+IRInstr *IRBuilder::lower(Node *node) {
+  switch (node->get_tag()) {
+    case AST_ADD:
+      return lower_binary(node, IR_ADD);
+    case AST_SUB:
+      return lower_binary(node, IR_SUB);
+    case AST_MULTIPLY:
+      return lower_binary(node, IR_MUL);
+    case AST_LESSER:
+      return lower_binary(node, IR_LT);
+    case AST_LESSER_EQUAL:
+      return lower_binary(node, IR_LE);
+    case AST_GREATER:
+      return lower_binary(node, IR_GT);
+    case AST_GREATER_EQUAL:
+      return lower_binary(node, IR_GE);
+    case AST_EQUAL_EQUAL:
+      return lower_binary(node, IR_EQ);
+    case AST_NOT_EQUAL:
+      return lower_binary(node, IR_NE);
+    case AST_DIVIDE: {
+      // the interpreter evaluates (and checks) the denominator first
+      IRInstr *denominator = lower(node->get_kid(1));
+      IRInstr *checked = emit(IR_CHKZERO, denominator);
+      checked->set_loc(node->get_loc());
+      IRInstr *numerator = lower(node->get_kid(0));
+      return emit(IR_DIV, numerator, checked);
+    }
+    case AST_OR:
+      return lower_short_circuit(node, true);
+    case AST_AND:
+      return lower_short_circuit(node, false);
+    case AST_INT_LITERAL:
+      return emit_const(std::stoi(node->get_str()));
+    case AST_VARREF: {
+      const Binding &b = lookup(node);
+      if (b.kind == BINDING_LOCAL) {
+        return read_var(b.index, m_state->cur);
+      } else if (b.kind == BINDING_GLOBAL) {
+        return emit(IR_LOADG, b.index);
+      }
+      RuntimeError::raise("IR lowering does not support function '%s' used as a value", node->get_str().c_str());
+    }
+    case AST_STATEMENT:
+      return lower(node->get_kid(0));
+    case AST_VARDEF: {
+      std::string name = node->get_kid(0)->get_str();
+      bool top_level = m_scopes.size() == 2;
+      if (top_level && m_names_used_in_functions.count(name) > 0) {
+        // reuse the slot if the variable is redefined
+        auto i = m_scopes[1].find(name);
+        int slot = i != m_scopes[1].end() && i->second.kind == BINDING_GLOBAL ? i->second.index : m_module->add_global(name);
+        define(name, { BINDING_GLOBAL, slot, nullptr });
+        emit(IR_STOREG, slot)->append_operand(emit_const(0));
+      } else {
+        int var = m_next_var++;
+        define(name, { BINDING_LOCAL, var, nullptr });
+        write_var(var, m_state->cur, emit_const(0));
+      }
+      return emit_const(0);
+    }
+    case AST_EQUAL: {
+      IRInstr *val = lower(node->get_kid(1));
+      const Binding &b = lookup(node->get_kid(0));
+      if (b.kind == BINDING_LOCAL) {
+        IRInstr *copy = emit(IR_COPY, val);
+        write_var(b.index, m_state->cur, copy);
+        return copy;
+      } else if (b.kind == BINDING_GLOBAL) {
+        IRInstr *store = emit(IR_STOREG, b.index);
+        store->append_operand(val);
+        return store;
+      }
+      RuntimeError::raise("IR lowering does not support assignment to function '%s'", node->get_kid(0)->get_str().c_str());
+    }
+    case AST_IF: {
+      IRInstr *cond = lower(node->get_kid(0));
+      bool has_else = node->get_num_kids() == 3;
+      IRBlock *then_block = new_block(false);
+      IRBlock *else_block = has_else ? new_block(false) : nullptr;
+      IRBlock *join_block = new_block(false);
+      emit_branch(cond, then_block, has_else ? else_block : join_block);
+      seal_block(then_block);
+
+      m_state->cur = then_block;
+      lower(node->get_kid(1));
+      emit_jump(join_block);
+
+      if (has_else) {
+        seal_block(else_block);
+        m_state->cur = else_block;
+        lower(node->get_kid(2)->get_kid(0));
+        emit_jump(join_block);
+      }
+
+      seal_block(join_block);
+      m_state->cur = join_block;
+      return emit_const(0);
+    }
+    case AST_WHILE: {
+      IRBlock *header = new_block(false);
+      emit_jump(header);
+      m_state->cur = header;
+      IRInstr *cond = lower(node->get_kid(0));
+
+      IRBlock *body = new_block(false);
+      IRBlock *exit = new_block(false);
+      emit_branch(cond, body, exit);
+      seal_block(body);
+      seal_block(exit);
+
+      m_state->cur = body;
+      lower(node->get_kid(1));
+      emit_jump(header);
+      // all predecessors of the loop header are now known
+      seal_block(header);
+
+      m_state->cur = exit;
+      return emit_const(0);
+    }
+    case AST_STMTS:
+      return lower_stmts(node);
+    case AST_FUNC:
+      lower_function(node);
+      return emit_const(0);
+    case AST_FUNC_CALL: {
+      const Binding &b = lookup(node->get_kid(0));
+      if (b.kind != BINDING_FUNC && b.kind != BINDING_INTRINSIC) {
+        RuntimeError::raise("IR lowering does not support calling variable '%s'", node->get_kid(0)->get_str().c_str());
+      }
+      // copy the binding: lowering the arguments may grow the scope tables
+      Binding callee = b;
+      std::vector<IRInstr *> args;
+      if (node->get_num_kids() > 1) {
+        Node *arg_list = node->get_kid(1);
+        for (auto i = arg_list->cbegin(); i != arg_list->cend(); ++i) {
+          args.push_back(lower(*i));
+        }
+      }
+      IRInstr *call;
+      if (callee.kind == BINDING_FUNC) {
+        call = emit(IR_CALL, callee.index);
+      } else {
+        call = emit(IR_CALLI);
+        call->set_intrinsic(callee.fn);
+      }
+      call->set_name(node->get_kid(0)->get_str());
+      call->set_loc(node->get_loc());
+      for (auto i = args.begin(); i != args.end(); ++i) {
+        call->append_operand(*i);
+      }
+      return call;
+    }
+    default:
+      RuntimeError::raise("IR lowering: unexpected node type %d", node->get_tag());
+  }
+}
+
+IRInstr *IRBuilder::lower_stmts(Node *stmts) {
+  m_scopes.push_back(Scope());
+  IRInstr *result = nullptr;
+  for (auto i = stmts->cbegin(); i != stmts->cend(); ++i) {
+    result = lower(*i);
+  }
+  m_scopes.pop_back();
+  return result != nullptr ? result : emit_const(0);
+}
+
+// The interpreter evaluates || and && with C++ short-circuit
+// semantics, producing 0 or 1, so the right operand is lowered
+// into its own block.
+IRInstr *IRBuilder::lower_short_circuit(Node *node, bool is_or) {
+  IRInstr *left = lower(node->get_kid(0));
+  IRBlock *short_block = new_block(false);
+  IRBlock *right_block = new_block(false);
+  IRBlock *join_block = new_block(false);
+  if (is_or) {
+    emit_branch(left, short_block, right_block);
+  } else {
+    emit_branch(left, right_block, short_block);
+  }
+  seal_block(short_block);
+  seal_block(right_block);
+
+  m_state->cur = short_block;
+  IRInstr *short_val = emit_const(is_or ? 1 : 0);
+  emit_jump(join_block);
+
+  m_state->cur = right_block;
+  IRInstr *right = lower(node->get_kid(1));
+  IRInstr *right_val = emit(IR_NE, right, emit_const(0));
+  emit_jump(join_block);
+
+  seal_block(join_block);
+  m_state->cur = join_block;
+  IRInstr *phi = new_phi(join_block);
+  phi->append_operand(short_val);
+  phi->append_operand(right_val);
+  return phi;
+}
+
+IRInstr *IRBuilder::lower_binary(Node *node, IROpcode opcode) {
+  IRInstr *left = lower(node->get_kid(0));
+  IRInstr *right = lower(node->get_kid(1));
+  return emit(opcode, left, right);
+}
+
+IRInstr *IRBuilder::emit(IROpcode opcode, int imm) {
+  IRInstr *ins = m_state->fn->create_instr(opcode, imm);
+  m_state->cur->append_instr(ins);
+  return ins;
+}
+
+IRInstr *IRBuilder::emit(IROpcode opcode, IRInstr *op1, IRInstr *op2) {
+  IRInstr *ins = emit(opcode);
+  ins->append_operand(op1);
+  if (op2 != nullptr) {
+    ins->append_operand(op2);
+  }
+  return ins;
+}
+
+IRInstr *IRBuilder::emit_const(int ival) {
+  return emit(IR_CONST, ival);
+}
+
+IRBlock *IRBuilder::new_block(bool sealed) {
+  IRBlock *block = m_state->fn->create_block();
+  unsigned size = unsigned(block->get_id()) + 1;
+  m_state->current_def.resize(size);
+  m_state->sealed.resize(size, false);
+  m_state->incomplete_phis.resize(size);
+  m_state->sealed[block->get_id()] = sealed;
+  return block;
+}
+
+void IRBuilder::emit_jump(IRBlock *target) {
+  emit(IR_JUMP);
+  m_state->cur->add_succ(target);
+}
+
+void IRBuilder::emit_branch(IRInstr *cond, IRBlock *if_true, IRBlock *if_false) {
+  emit(IR_BRANCH, cond);
+  m_state->cur->add_succ(if_true);
+  m_state->cur->add_succ(if_false);
+}
+
+const IRBuilder::Binding &IRBuilder::lookup(Node *ref) {
+  const std::string &name = ref->get_str();
+  for (int i = int(m_scopes.size()) - 1; i >= 0; i--) {
+    auto j = m_scopes[i].find(name);
+    if (j != m_scopes[i].end()) {
+      // a local variable of an enclosing function is not visible
+      if (j->second.kind == BINDING_LOCAL && unsigned(i) < m_state->scope_base) {
+        break;
+      }
+      return j->second;
+    }
+  }
+  RuntimeError::raise("IR lowering: unresolved name '%s'", name.c_str());
+}
+
+void IRBuilder::define(const std::string &name, const Binding &binding) {
+  m_scopes.back()[name] = binding;
+}
+
+void IRBuilder::write_var(int var, IRBlock *block, IRInstr *val) {
+  m_state->current_def[block->get_id()][var] = val;
+}
+
+IRInstr *IRBuilder::read_var(int var, IRBlock *block) {
+  std::unordered_map<int, IRInstr *> &defs = m_state->current_def[block->get_id()];
+  auto i = defs.find(var);
+  if (i != defs.end()) {
+    return i->second;
+  }
+  return read_var_recursive(var, block);
+}
+
+IRInstr *IRBuilder::read_var_recursive(int var, IRBlock *block) {
+  IRInstr *val;
+  if (!m_state->sealed[block->get_id()]) {
+    // operands are filled in when the block is sealed
+    val = new_phi(block);
+    m_state->incomplete_phis[block->get_id()].push_back({ var, val });
+  } else if (block->get_preds().empty()) {
+    // not reachable from a definition: semantic analysis rules this
+    // out, but variables are 0 when created anyway
+    val = m_state->fn->create_instr(IR_CONST, 0);
+    m_state->fn->get_entry()->insert_after_phis(val);
+  } else if (block->get_preds().size() == 1) {
+    val = read_var(var, block->get_preds()[0]);
+  } else {
+    // break potential cycles with an operandless phi
+    val = new_phi(block);
+    write_var(var, block, val);
+    add_phi_operands(var, val);
+  }
+  write_var(var, block, val);
+  return val;
+}
+
+IRInstr *IRBuilder::new_phi(IRBlock *block) {
+  IRInstr *phi = m_state->fn->create_instr(IR_PHI);
+  block->insert_after_phis(phi);
+  return phi;
+}
+
+void IRBuilder::add_phi_operands(int var, IRInstr *phi) {
+  IRBlock *block = phi->get_block();
+  for (auto i = block->get_preds().begin(); i != block->get_preds().end(); ++i) {
+    phi->append_operand(read_var(var, *i));
+  }
+}
+
+void IRBuilder::seal_block(IRBlock *block) {
+  std::vector<std::pair<int, IRInstr *>> &incomplete = m_state->incomplete_phis[block->get_id()];
+  for (auto i = incomplete.begin(); i != incomplete.end(); ++i) {
+    add_phi_operands(i->first, i->second);
+  }
+  incomplete.clear();
+  m_state->sealed[block->get_id()] = true;
+}
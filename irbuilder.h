@@ -0,0 +1,93 @@
+#ifndef IRBUILDER_H
+#define IRBUILDER_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "ir.h"
+class Node;
+
+// Lowers an analyzed AST (an AST_UNIT node that has passed
+// Interpreter::analyze()) to an SSA-form IRModule.
+// SSA form is constructed on the fly while walking the AST, using
+// the algorithm of Braun et al., "Simple and Efficient Construction
+// of Static Single Assignment Form" (CC 2013).
+class IRBuilder {
+private:
+  enum BindingKind {
+    BINDING_LOCAL,      // SSA variable of the current function
+    BINDING_GLOBAL,     // global slot
+    BINDING_FUNC,       // user-defined function
+    BINDING_INTRINSIC,  // intrinsic function
+  };
+
+  struct Binding {
+    BindingKind kind;
+    int index;          // variable number, global slot, or function index
+    IntrinsicFn fn;
+  };
+
+  typedef std::unordered_map<std::string, Binding> Scope;
+
+  // per-function SSA construction state
+  struct FnState {
+    IRFunction *fn;
+    IRBlock *cur;
+    unsigned scope_base; // first scope belonging to this function
+    std::vector<std::unordered_map<int, IRInstr *>> current_def; // by block id
+    std::vector<bool> sealed;                                    // by block id
+    std::vector<std::vector<std::pair<int, IRInstr *>>> incomplete_phis;
+  };
+
+  IRModule *m_module;
+  FnState *m_state;
+  std::vector<Scope> m_scopes;
+  std::unordered_set<std::string> m_names_used_in_functions;
+  std::unordered_map<std::string, int> m_func_index;
+  int m_next_var;
+
+  // value semantics prohibited
+  IRBuilder(const IRBuilder &);
+  IRBuilder &operator=(const IRBuilder &);
+
+public:
+  IRBuilder();
+  ~IRBuilder();
+
+  // Lower the unit to IR; the caller takes ownership of the
+  // returned module. Raises RuntimeError if the program uses
+  // constructs the IR cannot represent (e.g., function values
+  // used as data, or functions that are redefined).
+  IRModule *build(Node *unit);
+
+private:
+  void prescan(Node *unit);
+  void lower_function(Node *func);
+  IRInstr *lower(Node *node);
+  IRInstr *lower_stmts(Node *stmts);
+  IRInstr *lower_short_circuit(Node *node, bool is_or);
+  IRInstr *lower_binary(Node *node, IROpcode opcode);
+
+  // instruction and block creation helpers
+  IRInstr *emit(IROpcode opcode, int imm = 0);
+  IRInstr *emit(IROpcode opcode, IRInstr *op1, IRInstr *op2 = nullptr);
+  IRInstr *emit_const(int ival);
+  IRBlock *new_block(bool sealed);
+  void emit_jump(IRBlock *target);
+  void emit_branch(IRInstr *cond, IRBlock *if_true, IRBlock *if_false);
+
+  // name resolution
+  const Binding &lookup(Node *ref);
+  void define(const std::string &name, const Binding &binding);
+
+  // SSA construction
+  void write_var(int var, IRBlock *block, IRInstr *val);
+  IRInstr *read_var(int var, IRBlock *block);
+  IRInstr *read_var_recursive(int var, IRBlock *block);
+  IRInstr *new_phi(IRBlock *block);
+  void add_phi_operands(int var, IRInstr *phi);
+  void seal_block(IRBlock *block);
+};
+
+#endif // IRBUILDER_H
@@ -0,0 +1,112 @@
+#include <cassert>
+#include "arith.h"
+#include "exceptions.h"
+#include "irinterp.h"
+
+////////////////////////////////////////////////////////////////////////
+// IRInterpreter implementation
+////////////////////////////////////////////////////////////////////////
+
+IRInterpreter::IRInterpreter(IRModule *module, Interpreter *interp)
+  : m_module(module)
+  , m_interp(interp)
+  , m_globals(module->get_num_globals(), 0) {
+}
+
+IRInterpreter::~IRInterpreter() {
+}
+
+Value IRInterpreter::execute() {
+  return Value(call(m_module->get_main(), nullptr, 0));
+}
+
+int IRInterpreter::call(IRFunction *fn, const int *args, unsigned num_args) {
+  std::vector<int> regs(fn->get_num_ids());
+  std::vector<int> phi_vals;
+  IRBlock *block = fn->get_entry();
+  IRBlock *pred = nullptr;
+
+  for (;;) {
+    const std::vector<IRInstr *> &instrs = block->get_instrs();
+    unsigned i = 0;
+
+    // phis are evaluated in parallel on entry to the block
+    if (pred != nullptr) {
+      int pred_index = block->get_pred_index(pred);
+      phi_vals.clear();
+      unsigned num_phis = 0;
+      while (num_phis < instrs.size() && instrs[num_phis]->get_opcode() == IR_PHI) {
+        phi_vals.push_back(regs[instrs[num_phis]->get_operand(pred_index)->get_id()]);
+        num_phis++;
+      }
+      for (; i < num_phis; i++) {
+        regs[instrs[i]->get_id()] = phi_vals[i];
+      }
+    }
+
+    for (; i < instrs.size(); i++) {
+      IRInstr *ins = instrs[i];
+      int a = 0, b = 0;
+      if (ins->get_num_operands() >= 1) a = regs[ins->get_operand(0)->get_id()];
+      if (ins->get_num_operands() >= 2) b = regs[ins->get_operand(1)->get_id()];
+      int &dest = regs[ins->get_id()];
+
+      switch (ins->get_opcode()) {
+        case IR_CONST:   dest = ins->get_imm(); break;
+        case IR_PARAM:   dest = args[ins->get_imm()]; break;
+        case IR_COPY:    dest = a; break;
+        case IR_ADD:     dest = wrap_add(a, b); break;
+        case IR_SUB:     dest = wrap_sub(a, b); break;
+        case IR_MUL:     dest = wrap_mul(a, b); break;
+        case IR_DIV:     dest = wrap_div(a, b); break;
+        case IR_SHL:     dest = int(unsigned(a) << ins->get_imm()); break;
+        case IR_LT:      dest = a < b; break;
+        case IR_LE:      dest = a <= b; break;
+        case IR_GT:      dest = a > b; break;
+        case IR_GE:      dest = a >= b; break;
+        case IR_EQ:      dest = a == b; break;
+        case IR_NE:      dest = a != b; break;
+        case IR_CHKZERO:
+          if (a == 0) EvaluationError::raise(ins->get_loc(), "Division by zero");
+          dest = a;
+          break;
+        case IR_LOADG:   dest = m_globals[ins->get_imm()]; break;
+        case IR_STOREG:  dest = m_globals[ins->get_imm()] = a; break;
+        case IR_CALL: {
+          IRFunction *callee = m_module->get_function(ins->get_imm());
+          if (callee->get_num_params() != ins->get_num_operands()) {
+            EvaluationError::raise(ins->get_loc(), "Incorect number of function arguments.");
+          }
+          std::vector<int> call_args(ins->get_num_operands());
+          for (unsigned j = 0; j < call_args.size(); j++) {
+            call_args[j] = regs[ins->get_operand(j)->get_id()];
+          }
+          dest = call(callee, call_args.data(), unsigned(call_args.size()));
+          break;
+        }
+        case IR_CALLI: {
+          unsigned arg_ct = ins->get_num_operands();
+          std::vector<Value> call_args(arg_ct);
+          for (unsigned j = 0; j < arg_ct; j++) {
+            call_args[j] = Value(regs[ins->get_operand(j)->get_id()]);
+          }
+          Value result = ins->get_intrinsic()(call_args.data(), arg_ct, ins->get_loc(), m_interp);
+          dest = result.get_ival();
+          break;
+        }
+        case IR_JUMP:
+          pred = block;
+          block = block->get_succs()[0];
+          break;
+        case IR_BRANCH:
+          pred = block;
+          block = block->get_succs()[a != 0 ? 0 : 1];
+          break;
+        case IR_RET:
+          return a;
+        default:
+          RuntimeError::raise("IR interpreter: unexpected opcode %d", int(ins->get_opcode()));
+      }
+    }
+  }
+}
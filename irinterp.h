@@ -0,0 +1,32 @@
+#ifndef IRINTERP_H
+#define IRINTERP_H
+
+#include <vector>
+#include "value.h"
+#include "ir.h"
+class Interpreter;
+
+// Executes an IRModule directly, so the effect of the IR
+// optimization passes can be measured without a native backend.
+class IRInterpreter {
+private:
+  IRModule *m_module;
+  Interpreter *m_interp;
+  std::vector<int> m_globals;
+
+  // value semantics prohibited
+  IRInterpreter(const IRInterpreter &);
+  IRInterpreter &operator=(const IRInterpreter &);
+
+public:
+  // the Interpreter is passed to intrinsic functions
+  IRInterpreter(IRModule *module, Interpreter *interp);
+  ~IRInterpreter();
+
+  Value execute();
+
+private:
+  int call(IRFunction *fn, const int *args, unsigned num_args);
+};
+
+#endif // IRINTERP_H
@@ -0,0 +1,855 @@
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <tuple>
+#include "arith.h"
+#include "iropt.h"
+
+////////////////////////////////////////////////////////////////////////
+// IROptimizer implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Evaluate a binary operation on constants, returning false if
+// the operation can't be folded (e.g., division by 0).
+bool fold_binary(IROpcode opcode, int a, int b, int &result) {
+  switch (opcode) {
+    case IR_ADD: result = wrap_add(a, b); return true;
+    case IR_SUB: result = wrap_sub(a, b); return true;
+    case IR_MUL: result = wrap_mul(a, b); return true;
+    case IR_DIV:
+      if (b == 0) return false;
+      result = wrap_div(a, b);
+      return true;
+    case IR_LT: result = a < b; return true;
+    case IR_LE: result = a <= b; return true;
+    case IR_GT: result = a > b; return true;
+    case IR_GE: result = a >= b; return true;
+    case IR_EQ: result = a == b; return true;
+    case IR_NE: result = a != b; return true;
+    default:
+      return false;
+  }
+}
+
+bool is_commutative(IROpcode opcode) {
+  return opcode == IR_ADD || opcode == IR_MUL || opcode == IR_EQ || opcode == IR_NE;
+}
+
+// exact base-2 logarithm of a positive power of 2, or -1
+int log2_exact(int val) {
+  if (val <= 1 || (val & (val - 1)) != 0) return -1;
+  int k = 0;
+  while ((1 << k) != val) k++;
+  return k;
+}
+
+IRInstr *resolve(const std::vector<IRInstr *> &repl, IRInstr *ins) {
+  while (unsigned(ins->get_id()) < repl.size() && repl[ins->get_id()] != nullptr) {
+    ins = repl[ins->get_id()];
+  }
+  return ins;
+}
+
+void resolve_operands(const std::vector<IRInstr *> &repl, IRInstr *ins) {
+  for (unsigned i = 0; i < ins->get_num_operands(); i++) {
+    ins->set_operand(i, resolve(repl, ins->get_operand(i)));
+  }
+}
+
+// Integer interval used by range analysis. Arithmetic wraps on
+// overflow (arith.h), so an interval whose bounds leave int32 can wrap
+// to any value, and becomes the full range.
+struct Range {
+  int64_t lo, hi;
+  bool known;
+
+  Range() : lo(INT_MIN), hi(INT_MAX), known(false) { }
+  Range(int64_t lo_, int64_t hi_)
+    : lo(lo_), hi(hi_), known(true) {
+    if (lo < INT_MIN || hi > INT_MAX) {
+      lo = INT_MIN;
+      hi = INT_MAX;
+    }
+  }
+
+  static Range full() { return Range(INT_MIN, INT_MAX); }
+
+  bool contains(int64_t val) const { return !known || (lo <= val && val <= hi); }
+  bool operator!=(const Range &rhs) const { return known != rhs.known || lo != rhs.lo || hi != rhs.hi; }
+};
+
+Range range_from_corners(int64_t a, int64_t b, int64_t c, int64_t d) {
+  return Range(std::min({ a, b, c, d }), std::max({ a, b, c, d }));
+}
+
+Range eval_range(IRInstr *ins, const std::vector<Range> &ranges) {
+  auto op = [&](unsigned i) -> const Range & { return ranges[ins->get_operand(i)->get_id()]; };
+
+  switch (ins->get_opcode()) {
+    case IR_CONST:
+      return Range(ins->get_imm(), ins->get_imm());
+    case IR_COPY:
+    case IR_STOREG:
+      return op(0);
+    case IR_PHI: {
+      Range res;
+      for (unsigned i = 0; i < ins->get_num_operands(); i++) {
+        const Range &r = op(i);
+        if (!r.known) continue;
+        res = res.known ? Range(std::min(res.lo, r.lo), std::max(res.hi, r.hi)) : r;
+      }
+      return res;
+    }
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: {
+      const Range &a = op(0), &b = op(1);
+      if (!a.known || !b.known) return Range();
+      switch (ins->get_opcode()) {
+        case IR_ADD: return Range(a.lo + b.lo, a.hi + b.hi);
+        case IR_SUB: return Range(a.lo - b.hi, a.hi - b.lo);
+        case IR_MUL: return range_from_corners(a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi);
+        default:
+          if (b.contains(0)) return Range::full();
+          return range_from_corners(a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi);
+      }
+    }
+    case IR_SHL: {
+      const Range &a = op(0);
+      if (!a.known) return Range();
+      return Range(a.lo * (int64_t(1) << ins->get_imm()), a.hi * (int64_t(1) << ins->get_imm()));
+    }
+    case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+      return Range(0, 1);
+    case IR_CHKZERO: {
+      // execution only continues past the check if the value is nonzero
+      Range r = op(0);
+      if (!r.known) return r;
+      if (r.lo == 0) r.lo = 1;
+      if (r.hi == 0) r.hi = -1;
+      return r.lo <= r.hi ? r : Range::full();
+    }
+    default:
+      return Range::full();
+  }
+}
+
+}
+
+IROptimizer::IROptimizer()
+  : m_fn(nullptr) {
+}
+
+IROptimizer::~IROptimizer() {
+}
+
+void IROptimizer::optimize(IRModule *module) {
+  for (unsigned i = 0; i < module->get_num_functions(); i++) {
+    optimize(module->get_function(i));
+  }
+}
+
+void IROptimizer::optimize(IRFunction *fn) {
+  m_fn = fn;
+  m_fn->remove_unreachable_blocks();
+
+  run_pass("copy propagation", &IROptimizer::copy_propagate);
+  run_pass("simplification", &IROptimizer::simplify);
+  run_pass("common subexpression elimination", &IROptimizer::eliminate_common_subexpressions);
+  run_pass("copy propagation", &IROptimizer::copy_propagate);
+  run_pass("loop-invariant code motion", &IROptimizer::hoist_loop_invariants);
+  run_pass("strength reduction", &IROptimizer::reduce_strength);
+  run_pass("copy propagation", &IROptimizer::copy_propagate);
+  run_pass("simplification", &IROptimizer::simplify);
+  run_pass("common subexpression elimination", &IROptimizer::eliminate_common_subexpressions);
+  run_pass("division check elimination", &IROptimizer::eliminate_division_checks);
+  run_pass("dead code elimination", &IROptimizer::eliminate_dead_code);
+
+  m_fn = nullptr;
+}
+
+void IROptimizer::print_stats(FILE *out) const {
+  for (auto i = m_stats.begin(); i != m_stats.end(); ++i) {
+    fprintf(out, "; %s: %u\n", i->name.c_str(), i->count);
+  }
+}
+
+void IROptimizer::run_pass(const char *name, unsigned (IROptimizer::*pass)()) {
+  unsigned count = (this->*pass)();
+  for (auto i = m_stats.begin(); i != m_stats.end(); ++i) {
+    if (i->name == name) {
+      i->count += count;
+      return;
+    }
+  }
+  m_stats.push_back({ name, count });
+}
+
+// Remove copies and trivial phis (phis whose operands are all the
+// same value, ignoring the phi itself).
+unsigned IROptimizer::copy_propagate() {
+  unsigned count = 0;
+  for (;;) {
+    std::vector<IRInstr *> repl(m_fn->get_num_ids(), nullptr);
+    unsigned round = 0;
+    for (auto b = m_fn->get_blocks().begin(); b != m_fn->get_blocks().end(); ++b) {
+      for (auto i = (*b)->get_instrs().begin(); i != (*b)->get_instrs().end(); ++i) {
+        IRInstr *ins = *i;
+        if (ins->get_opcode() == IR_COPY) {
+          replace(repl, ins, resolve(repl, ins->get_operand(0)));
+          round++;
+        } else if (ins->get_opcode() == IR_PHI) {
+          IRInstr *same = nullptr;
+          bool trivial = true;
+          for (unsigned j = 0; j < ins->get_num_operands() && trivial; j++) {
+            IRInstr *op = resolve(repl, ins->get_operand(j));
+            if (op == ins || op == same) continue;
+            if (same != nullptr) trivial = false;
+            same = op;
+          }
+          if (trivial && same != nullptr) {
+            replace(repl, ins, same);
+            round++;
+          }
+        }
+      }
+    }
+    if (round == 0) {
+      return count;
+    }
+    m_fn->apply_replacements(repl);
+    count += round;
+  }
+}
+
+// Constant folding, algebraic simplification, replacement of
+// multiplications by powers of 2 with shifts, and removal of
+// branches on constant conditions.
+unsigned IROptimizer::simplify() {
+  compute_dominators();
+  unsigned count = 0;
+  std::vector<IRInstr *> repl(m_fn->get_num_ids(), nullptr);
+
+  for (auto b = m_rpo.begin(); b != m_rpo.end(); ++b) {
+    for (auto i = (*b)->get_instrs().begin(); i != (*b)->get_instrs().end(); ++i) {
+      IRInstr *ins = *i;
+      resolve_operands(repl, ins);
+      IROpcode opcode = ins->get_opcode();
+
+      if (opcode == IR_CHKZERO && ins->get_operand(0)->is_const() && ins->get_operand(0)->get_imm() != 0) {
+        replace(repl, ins, ins->get_operand(0));
+        count++;
+        continue;
+      }
+      if (!ins->is_binary()) {
+        continue;
+      }
+
+      IRInstr *left = ins->get_operand(0), *right = ins->get_operand(1);
+      int result;
+      if (left->is_const() && right->is_const() && fold_binary(opcode, left->get_imm(), right->get_imm(), result)) {
+        ins->set_opcode(IR_CONST);
+        ins->set_imm(result);
+        ins->clear_operands();
+        count++;
+        continue;
+      }
+
+      // put the constant operand of a commutative operation on the right
+      if (is_commutative(opcode) && left->is_const() && !right->is_const()) {
+        std::swap(left, right);
+        ins->set_operand(0, left);
+        ins->set_operand(1, right);
+      }
+      int c = right->is_const() ? right->get_imm() : -1;
+      if (right->is_const() && c == 0 && (opcode == IR_ADD || opcode == IR_SUB)) {
+        replace(repl, ins, left);
+        count++;
+      } else if (right->is_const() && c == 1 && (opcode == IR_MUL || opcode == IR_DIV)) {
+        replace(repl, ins, left);
+        count++;
+      } else if (right->is_const() && c == 0 && opcode == IR_MUL) {
+        ins->set_opcode(IR_CONST);
+        ins->set_imm(0);
+        ins->clear_operands();
+        count++;
+      } else if (opcode == IR_MUL && right->is_const() && log2_exact(c) > 0) {
+        // x * 2^k => x << k
+        ins->set_opcode(IR_SHL);
+        ins->set_imm(log2_exact(c));
+        ins->clear_operands();
+        ins->append_operand(left);
+        count++;
+      } else if (left == right && (opcode == IR_SUB || opcode == IR_NE || opcode == IR_LT || opcode == IR_GT)) {
+        ins->set_opcode(IR_CONST);
+        ins->set_imm(0);
+        ins->clear_operands();
+        count++;
+      } else if (left == right && (opcode == IR_EQ || opcode == IR_LE || opcode == IR_GE)) {
+        ins->set_opcode(IR_CONST);
+        ins->set_imm(1);
+        ins->clear_operands();
+        count++;
+      }
+    }
+  }
+  m_fn->apply_replacements(repl);
+
+  // branches on constants become jumps
+  bool cfg_changed = false;
+  for (auto b = m_fn->get_blocks().begin(); b != m_fn->get_blocks().end(); ++b) {
+    IRInstr *term = (*b)->get_terminator();
+    if (term != nullptr && term->get_opcode() == IR_BRANCH && term->get_operand(0)->is_const()) {
+      unsigned not_taken = term->get_operand(0)->get_imm() != 0 ? 1 : 0;
+      (*b)->remove_succ(not_taken);
+      term->set_opcode(IR_JUMP);
+      term->clear_operands();
+      cfg_changed = true;
+      count++;
+    }
+  }
+  if (cfg_changed) {
+    m_fn->remove_unreachable_blocks();
+  }
+  return count;
+}
+
+// Dominator-based value numbering: a pure instruction is replaced
+// by an identical instruction in a dominating position.
+unsigned IROptimizer::eliminate_common_subexpressions() {
+  compute_dominators();
+  typedef std::tuple<int, int, int, int> Key; // opcode, imm, operand ids
+  std::map<Key, IRInstr *> available;
+  std::vector<IRInstr *> repl(m_fn->get_num_ids(), nullptr);
+  unsigned count = 0;
+
+  // walk the dominator tree, with scoped availability
+  struct Frame { IRBlock *block; unsigned next_kid; std::vector<Key> added; };
+  std::vector<Frame> stack;
+  stack.push_back({ m_fn->get_entry(), 0, {} });
+  bool entered = false;
+  while (!stack.empty()) {
+    Frame &top = stack.back();
+    if (!entered) {
+      for (auto i = top.block->get_instrs().begin(); i != top.block->get_instrs().end(); ++i) {
+        IRInstr *ins = *i;
+        resolve_operands(repl, ins);
+        IROpcode opcode = ins->get_opcode();
+        if (!ins->is_pure() || opcode == IR_PHI || opcode == IR_PARAM || opcode == IR_COPY || opcode == IR_LOADG) {
+          continue;
+        }
+        int op0 = ins->get_num_operands() > 0 ? ins->get_operand(0)->get_id() : -1;
+        int op1 = ins->get_num_operands() > 1 ? ins->get_operand(1)->get_id() : -1;
+        if (is_commutative(opcode) && op0 > op1) {
+          std::swap(op0, op1);
+        }
+        Key key(int(opcode), ins->get_imm(), op0, op1);
+        auto found = available.find(key);
+        if (found != available.end()) {
+          replace(repl, ins, found->second);
+          count++;
+        } else {
+          available[key] = ins;
+          top.added.push_back(key);
+        }
+      }
+    }
+
+    std::vector<IRBlock *> &kids = m_dom_kids[top.block->get_id()];
+    if (top.next_kid < kids.size()) {
+      IRBlock *kid = kids[top.next_kid++];
+      stack.push_back({ kid, 0, {} });
+      entered = false;
+    } else {
+      for (auto k = top.added.begin(); k != top.added.end(); ++k) {
+        available.erase(*k);
+      }
+      stack.pop_back();
+      entered = true;
+    }
+  }
+
+  m_fn->apply_replacements(repl);
+  return count;
+}
+
+// Move computations whose operands are defined outside a loop
+// into the loop's preheader.
+unsigned IROptimizer::hoist_loop_invariants() {
+  compute_dominators();
+  std::vector<Loop> loops = find_loops();
+  unsigned count = 0;
+
+  for (auto l = loops.begin(); l != loops.end(); ++l) {
+    const Loop &loop = *l;
+    if (loop.preheader == nullptr) {
+      continue;
+    }
+
+    // global loads are invariant unless the loop might store to the global
+    bool has_call = false;
+    std::set<int> stored;
+    for (auto b = m_rpo.begin(); b != m_rpo.end(); ++b) {
+      if (!loop.blocks[(*b)->get_id()]) continue;
+      for (auto i = (*b)->get_instrs().begin(); i != (*b)->get_instrs().end(); ++i) {
+        IROpcode opcode = (*i)->get_opcode();
+        if (opcode == IR_CALL || opcode == IR_CALLI) has_call = true;
+        if (opcode == IR_STOREG) stored.insert((*i)->get_imm());
+      }
+    }
+
+    auto hoistable = [&](IRInstr *ins) {
+      switch (ins->get_opcode()) {
+        case IR_CONST: case IR_ADD: case IR_SUB: case IR_MUL: case IR_SHL:
+        case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+          break;
+        case IR_DIV: {
+          // only safe to execute speculatively if the divisor can't trap
+          IRInstr *divisor = ins->get_operand(1);
+          if (!divisor->is_const() || divisor->get_imm() == 0 || divisor->get_imm() == -1) return false;
+          break;
+        }
+        case IR_LOADG:
+          if (has_call || stored.count(ins->get_imm()) > 0) return false;
+          break;
+        default:
+          return false;
+      }
+      for (unsigned j = 0; j < ins->get_num_operands(); j++) {
+        IRBlock *def_block = ins->get_operand(j)->get_block();
+        if (loop.blocks[def_block->get_id()]) return false;
+      }
+      return true;
+    };
+
+    // hoisting one instruction can make its users invariant
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto b = m_rpo.begin(); b != m_rpo.end(); ++b) {
+        if (!loop.blocks[(*b)->get_id()]) continue;
+        std::vector<IRInstr *> &instrs = (*b)->get_instrs();
+        std::vector<IRInstr *> kept;
+        for (auto i = instrs.begin(); i != instrs.end(); ++i) {
+          if (hoistable(*i)) {
+            loop.preheader->insert_before_terminator(*i);
+            changed = true;
+            count++;
+          } else {
+            kept.push_back(*i);
+          }
+        }
+        instrs.swap(kept);
+      }
+    }
+  }
+  return count;
+}
+
+// Replace multiplications of a basic induction variable
+// (i = phi(init, i + c)) by a loop-invariant value with a new
+// induction variable that is incremented on each iteration.
+unsigned IROptimizer::reduce_strength() {
+  compute_dominators();
+  std::vector<Loop> loops = find_loops();
+  std::vector<IRInstr *> repl(m_fn->get_num_ids(), nullptr);
+  unsigned count = 0;
+
+  for (auto l = loops.begin(); l != loops.end(); ++l) {
+    const Loop &loop = *l;
+    IRBlock *header = loop.header;
+    if (loop.preheader == nullptr || loop.latch == nullptr || header->get_preds().size() != 2) {
+      continue;
+    }
+    int pre_index = header->get_pred_index(loop.preheader);
+    int latch_index = header->get_pred_index(loop.latch);
+
+    // find basic induction variables: phi -> step
+    std::map<IRInstr *, int> steps;
+    for (auto i = header->get_instrs().begin(); i != header->get_instrs().end() && (*i)->get_opcode() == IR_PHI; ++i) {
+      IRInstr *phi = *i;
+      IRInstr *next = phi->get_operand(latch_index);
+      if ((next->get_opcode() != IR_ADD && next->get_opcode() != IR_SUB) || next->get_num_operands() != 2) continue;
+      IRInstr *left = next->get_operand(0), *right = next->get_operand(1);
+      if (next->get_opcode() == IR_ADD && right == phi) std::swap(left, right);
+      if (left != phi || !right->is_const()) continue;
+      int step = right->get_imm();
+      steps[phi] = next->get_opcode() == IR_ADD ? step : int(0u - unsigned(step));
+    }
+    if (steps.empty()) continue;
+
+    // find multiplications of an induction variable by an invariant
+    std::vector<IRInstr *> candidates;
+    for (auto b = m_rpo.begin(); b != m_rpo.end(); ++b) {
+      if (!loop.blocks[(*b)->get_id()]) continue;
+      for (auto i = (*b)->get_instrs().begin(); i != (*b)->get_instrs().end(); ++i) {
+        IRInstr *ins = *i;
+        if (ins->get_opcode() == IR_SHL && steps.count(ins->get_operand(0)) > 0) {
+          candidates.push_back(ins);
+        } else if (ins->get_opcode() == IR_MUL) {
+          IRInstr *left = ins->get_operand(0), *right = ins->get_operand(1);
+          if (steps.count(right) > 0) std::swap(left, right);
+          if (steps.count(left) > 0 && !loop.blocks[right->get_block()->get_id()]) {
+            candidates.push_back(ins);
+          }
+        }
+      }
+    }
+
+    for (auto c = candidates.begin(); c != candidates.end(); ++c) {
+      IRInstr *mul = *c;
+      IRInstr *iv = mul->get_operand(0), *factor = nullptr;
+      if (mul->get_opcode() == IR_MUL) {
+        factor = mul->get_operand(1);
+        if (steps.count(iv) == 0) std::swap(iv, factor);
+      } else {
+        factor = create_const(1 << mul->get_imm());
+        loop.preheader->insert_before_terminator(factor);
+      }
+      int step = steps[iv];
+
+      // initial value and increment are computed in the preheader
+      IRInstr *init = m_fn->create_instr(IR_MUL);
+      init->append_operand(iv->get_operand(pre_index));
+      init->append_operand(factor);
+      loop.preheader->insert_before_terminator(init);
+      IRInstr *increment;
+      if (factor->is_const()) {
+        increment = create_const(int(unsigned(step) * unsigned(factor->get_imm())));
+        loop.preheader->insert_before_terminator(increment);
+      } else {
+        IRInstr *step_val = create_const(step);
+        loop.preheader->insert_before_terminator(step_val);
+        increment = m_fn->create_instr(IR_MUL);
+        increment->append_operand(step_val);
+        increment->append_operand(factor);
+        loop.preheader->insert_before_terminator(increment);
+      }
+
+      IRInstr *next = m_fn->create_instr(IR_ADD);
+      IRInstr *phi = m_fn->create_instr(IR_PHI);
+      next->append_operand(phi);
+      next->append_operand(increment);
+      loop.latch->insert_before_terminator(next);
+      for (unsigned j = 0; j < 2; j++) {
+        phi->append_operand(int(j) == pre_index ? init : next);
+      }
+      header->insert_after_phis(phi);
+
+      replace(repl, mul, phi);
+      count++;
+    }
+  }
+
+  m_fn->apply_replacements(repl);
+  return count;
+}
+
+// Range analysis over SSA values; division checks on values whose
+// range excludes 0, or that are guarded by a dominating test
+// against 0, are removed.
+unsigned IROptimizer::eliminate_division_checks() {
+  compute_dominators();
+  std::vector<Range> ranges(m_fn->get_num_ids());
+  std::vector<unsigned> updates(m_fn->get_num_ids(), 0);
+  const unsigned WIDEN_AFTER = 3;
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto b = m_rpo.begin(); b != m_rpo.end(); ++b) {
+      for (auto i = (*b)->get_instrs().begin(); i != (*b)->get_instrs().end(); ++i) {
+        IRInstr *ins = *i;
+        if (ins->is_terminator()) continue;
+        Range old_range = ranges[ins->get_id()];
+        Range new_range = eval_range(ins, ranges);
+        if (!new_range.known) continue;
+        if (old_range.known) {
+          // ranges only grow; widen ranges that keep growing (in loops)
+          // to guarantee termination
+          new_range = Range(std::min(old_range.lo, new_range.lo), std::max(old_range.hi, new_range.hi));
+          if (!(new_range != old_range)) continue;
+          if (++updates[ins->get_id()] > WIDEN_AFTER) {
+            if (new_range.lo < old_range.lo) new_range.lo = INT_MIN;
+            if (new_range.hi > old_range.hi) new_range.hi = INT_MAX;
+          }
+        }
+        ranges[ins->get_id()] = new_range;
+        changed = true;
+      }
+    }
+  }
+
+  std::vector<IRInstr *> repl(m_fn->get_num_ids(), nullptr);
+  unsigned count = 0;
+  for (auto b = m_rpo.begin(); b != m_rpo.end(); ++b) {
+    for (auto i = (*b)->get_instrs().begin(); i != (*b)->get_instrs().end(); ++i) {
+      IRInstr *ins = *i;
+      if (ins->get_opcode() != IR_CHKZERO) continue;
+      const Range &r = ranges[ins->get_operand(0)->get_id()];
+      if ((r.known && !r.contains(0)) || proven_nonzero_by_branch(ins)) {
+        replace(repl, ins, ins->get_operand(0));
+        count++;
+      }
+    }
+  }
+  m_fn->apply_replacements(repl);
+  return count;
+}
+
+unsigned IROptimizer::eliminate_dead_code() {
+  std::vector<bool> live(m_fn->get_num_ids(), false);
+  std::vector<IRInstr *> worklist;
+  for (auto b = m_fn->get_blocks().begin(); b != m_fn->get_blocks().end(); ++b) {
+    for (auto i = (*b)->get_instrs().begin(); i != (*b)->get_instrs().end(); ++i) {
+      if (!(*i)->is_pure()) {
+        live[(*i)->get_id()] = true;
+        worklist.push_back(*i);
+      }
+    }
+  }
+  while (!worklist.empty()) {
+    IRInstr *ins = worklist.back();
+    worklist.pop_back();
+    for (unsigned j = 0; j < ins->get_num_operands(); j++) {
+      IRInstr *op = ins->get_operand(j);
+      if (!live[op->get_id()]) {
+        live[op->get_id()] = true;
+        worklist.push_back(op);
+      }
+    }
+  }
+
+  unsigned count = 0;
+  for (auto b = m_fn->get_blocks().begin(); b != m_fn->get_blocks().end(); ++b) {
+    std::vector<IRInstr *> &instrs = (*b)->get_instrs();
+    std::vector<IRInstr *> kept;
+    for (auto i = instrs.begin(); i != instrs.end(); ++i) {
+      if (live[(*i)->get_id()]) {
+        kept.push_back(*i);
+      } else {
+        (*i)->set_block(nullptr);
+        count++;
+      }
+    }
+    instrs.swap(kept);
+  }
+  return count;
+}
+
+// Compute the dominator tree using the algorithm of Cooper, Harvey,
+// and Kennedy, "A Simple, Fast Dominance Algorithm".
+void IROptimizer::compute_dominators() {
+  int num_ids = 0;
+  for (auto b = m_fn->get_blocks().begin(); b != m_fn->get_blocks().end(); ++b) {
+    num_ids = std::max(num_ids, (*b)->get_id() + 1);
+  }
+
+  // reverse postorder
+  m_rpo.clear();
+  std::vector<int> rpo_index(num_ids, -1);
+  std::vector<bool> visited(num_ids, false);
+  std::vector<std::pair<IRBlock *, unsigned>> stack;
+  stack.push_back({ m_fn->get_entry(), 0 });
+  visited[m_fn->get_entry()->get_id()] = true;
+  while (!stack.empty()) {
+    IRBlock *block = stack.back().first;
+    unsigned next = stack.back().second;
+    if (next < block->get_succs().size()) {
+      stack.back().second++;
+      IRBlock *succ = block->get_succs()[next];
+      if (!visited[succ->get_id()]) {
+        visited[succ->get_id()] = true;
+        stack.push_back({ succ, 0 });
+      }
+    } else {
+      m_rpo.push_back(block);
+      stack.pop_back();
+    }
+  }
+  std::reverse(m_rpo.begin(), m_rpo.end());
+  for (unsigned i = 0; i < m_rpo.size(); i++) {
+    rpo_index[m_rpo[i]->get_id()] = int(i);
+  }
+
+  m_idom.assign(num_ids, nullptr);
+  m_idom[m_fn->get_entry()->get_id()] = m_fn->get_entry();
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto b = m_rpo.begin() + 1; b != m_rpo.end(); ++b) {
+      IRBlock *new_idom = nullptr;
+      for (auto p = (*b)->get_preds().begin(); p != (*b)->get_preds().end(); ++p) {
+        IRBlock *pred = *p;
+        if (m_idom[pred->get_id()] == nullptr) continue;
+        if (new_idom == nullptr) {
+          new_idom = pred;
+          continue;
+        }
+        // intersect
+        IRBlock *f1 = pred, *f2 = new_idom;
+        while (f1 != f2) {
+          while (rpo_index[f1->get_id()] > rpo_index[f2->get_id()]) f1 = m_idom[f1->get_id()];
+          while (rpo_index[f2->get_id()] > rpo_index[f1->get_id()]) f2 = m_idom[f2->get_id()];
+        }
+        new_idom = f1;
+      }
+      if (m_idom[(*b)->get_id()] != new_idom) {
+        m_idom[(*b)->get_id()] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  // dominator tree children, and pre/post numbering for O(1) dominance queries
+  m_dom_kids.assign(num_ids, std::vector<IRBlock *>());
+  for (auto b = m_rpo.begin() + 1; b != m_rpo.end(); ++b) {
+    m_dom_kids[m_idom[(*b)->get_id()]->get_id()].push_back(*b);
+  }
+  m_dom_pre.assign(num_ids, -1);
+  m_dom_post.assign(num_ids, -1);
+  int counter = 0;
+  stack.clear();
+  stack.push_back({ m_fn->get_entry(), 0 });
+  m_dom_pre[m_fn->get_entry()->get_id()] = counter++;
+  while (!stack.empty()) {
+    IRBlock *block = stack.back().first;
+    unsigned next = stack.back().second;
+    std::vector<IRBlock *> &kids = m_dom_kids[block->get_id()];
+    if (next < kids.size()) {
+      stack.back().second++;
+      m_dom_pre[kids[next]->get_id()] = counter++;
+      stack.push_back({ kids[next], 0 });
+    } else {
+      m_dom_post[block->get_id()] = counter++;
+      stack.pop_back();
+    }
+  }
+}
+
+bool IROptimizer::dominates(IRBlock *a, IRBlock *b) const {
+  return m_dom_pre[a->get_id()] <= m_dom_pre[b->get_id()] && m_dom_post[b->get_id()] <= m_dom_post[a->get_id()];
+}
+
+// Find natural loops, innermost (smallest) first.
+std::vector<IROptimizer::Loop> IROptimizer::find_loops() {
+  std::map<IRBlock *, std::vector<IRBlock *>> back_edges; // header -> latches
+  for (auto b = m_rpo.begin(); b != m_rpo.end(); ++b) {
+    for (auto s = (*b)->get_succs().begin(); s != (*b)->get_succs().end(); ++s) {
+      if (dominates(*s, *b)) {
+        back_edges[*s].push_back(*b);
+      }
+    }
+  }
+
+  std::vector<Loop> loops;
+  for (auto e = back_edges.begin(); e != back_edges.end(); ++e) {
+    Loop loop;
+    loop.header = e->first;
+    loop.latch = e->second.size() == 1 ? e->second[0] : nullptr;
+    loop.blocks.assign(m_dom_pre.size(), false);
+    loop.blocks[loop.header->get_id()] = true;
+    loop.size = 1;
+
+    // the loop body is everything that reaches a latch without passing the header
+    std::vector<IRBlock *> worklist(e->second.begin(), e->second.end());
+    while (!worklist.empty()) {
+      IRBlock *block = worklist.back();
+      worklist.pop_back();
+      if (loop.blocks[block->get_id()]) continue;
+      loop.blocks[block->get_id()] = true;
+      loop.size++;
+      for (auto p = block->get_preds().begin(); p != block->get_preds().end(); ++p) {
+        worklist.push_back(*p);
+      }
+    }
+
+    loop.preheader = nullptr;
+    for (auto p = loop.header->get_preds().begin(); p != loop.header->get_preds().end(); ++p) {
+      if (loop.blocks[(*p)->get_id()]) continue;
+      if (loop.preheader != nullptr) {
+        loop.preheader = nullptr;
+        break;
+      }
+      loop.preheader = *p;
+    }
+    if (loop.preheader != nullptr && loop.preheader->get_succs().size() != 1) {
+      loop.preheader = nullptr;
+    }
+    loops.push_back(loop);
+  }
+
+  std::sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b) { return a.size < b.size; });
+  return loops;
+}
+
+// Determine whether the operand of a division check is known
+// to be nonzero because the check is only reachable through
+// a branch that tested it.
+bool IROptimizer::proven_nonzero_by_branch(IRInstr *chk) const {
+  IRInstr *val = chk->get_operand(0);
+  IRBlock *block = chk->get_block();
+  while (block != m_fn->get_entry()) {
+    IRBlock *dom = m_idom[block->get_id()];
+    IRInstr *term = dom->get_terminator();
+    if (term->get_opcode() == IR_BRANCH && block->get_preds().size() == 1 && block->get_preds()[0] == dom
+        && dom->get_succs()[0] != dom->get_succs()[1]) {
+      bool taken = dom->get_succs()[0] == block;
+      IRInstr *cond = term->get_operand(0);
+      if (cond == val && taken) {
+        return true;
+      }
+      if (cond->get_opcode() >= IR_LT && cond->get_opcode() <= IR_NE) {
+        IROpcode opcode = cond->get_opcode();
+        IRInstr *left = cond->get_operand(0), *right = cond->get_operand(1);
+        // normalize to "val OP c"
+        if (right == val && left->is_const()) {
+          std::swap(left, right);
+          switch (opcode) {
+            case IR_LT: opcode = IR_GT; break;
+            case IR_LE: opcode = IR_GE; break;
+            case IR_GT: opcode = IR_LT; break;
+            case IR_GE: opcode = IR_LE; break;
+            default: break;
+          }
+        }
+        if (left == val && right->is_const()) {
+          int c = right->get_imm();
+          if (!taken) {
+            // the negated condition holds
+            switch (opcode) {
+              case IR_LT: opcode = IR_GE; break;
+              case IR_LE: opcode = IR_GT; break;
+              case IR_GT: opcode = IR_LE; break;
+              case IR_GE: opcode = IR_LT; break;
+              case IR_EQ: opcode = IR_NE; break;
+              case IR_NE: opcode = IR_EQ; break;
+              default: break;
+            }
+          }
+          if ((opcode == IR_NE && c == 0) || (opcode == IR_EQ && c != 0)
+              || (opcode == IR_GT && c >= 0) || (opcode == IR_GE && c > 0)
+              || (opcode == IR_LT && c <= 0) || (opcode == IR_LE && c < 0)) {
+            return true;
+          }
+        }
+      }
+    }
+    block = dom;
+  }
+  return false;
+}
+
+IRInstr *IROptimizer::create_const(int ival) {
+  return m_fn->create_instr(IR_CONST, ival);
+}
+
+void IROptimizer::replace(std::vector<IRInstr *> &repl, IRInstr *old_val, IRInstr *new_val) {
+  if (repl.size() < unsigned(m_fn->get_num_ids())) {
+    repl.resize(m_fn->get_num_ids(), nullptr);
+  }
+  repl[old_val->get_id()] = new_val;
+}
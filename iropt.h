@@ -0,0 +1,66 @@
+#ifndef IROPT_H
+#define IROPT_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "ir.h"
+
+// Scalar optimization passes over SSA-form IR.
+class IROptimizer {
+private:
+  struct Loop {
+    IRBlock *header;
+    IRBlock *preheader;       // nullptr if the loop has no usable preheader
+    IRBlock *latch;           // source of the back edge (nullptr if several)
+    std::vector<bool> blocks; // membership, by block id
+    unsigned size;
+  };
+
+  struct PassStats {
+    std::string name;
+    unsigned count;
+  };
+
+  IRFunction *m_fn;
+  std::vector<PassStats> m_stats;
+
+  // dominator tree, indexed by block id
+  std::vector<IRBlock *> m_rpo;
+  std::vector<IRBlock *> m_idom;
+  std::vector<std::vector<IRBlock *>> m_dom_kids;
+  std::vector<int> m_dom_pre, m_dom_post;
+
+  // value semantics prohibited
+  IROptimizer(const IROptimizer &);
+  IROptimizer &operator=(const IROptimizer &);
+
+public:
+  IROptimizer();
+  ~IROptimizer();
+
+  void optimize(IRModule *module);
+  void optimize(IRFunction *fn);
+
+  // print the number of changes made by each pass
+  void print_stats(FILE *out) const;
+
+private:
+  unsigned copy_propagate();
+  unsigned simplify();
+  unsigned eliminate_common_subexpressions();
+  unsigned hoist_loop_invariants();
+  unsigned reduce_strength();
+  unsigned eliminate_division_checks();
+  unsigned eliminate_dead_code();
+
+  void run_pass(const char *name, unsigned (IROptimizer::*pass)());
+  void compute_dominators();
+  bool dominates(IRBlock *a, IRBlock *b) const;
+  std::vector<Loop> find_loops();
+  bool proven_nonzero_by_branch(IRInstr *chk) const;
+  IRInstr *create_const(int ival);
+  void replace(std::vector<IRInstr *> &repl, IRInstr *old_val, IRInstr *new_val);
+};
+
+#endif // IROPT_H
@@ -6,6 +6,7 @@
 #include "token.h"
 #include "exceptions.h"
 #include "lexer.h"
+#include "memstats.h"
 
 ////////////////////////////////////////////////////////////////////////
 // Lexer implementation
@@ -13,18 +14,41 @@
 
 Lexer::Lexer(FILE *in, const std::string &filename)
   : m_in(in)
+  , m_after(nullptr)
   , m_filename(filename)
   , m_line(1)
   , m_col(1)
   , m_eof(false) {
 }
 
+Lexer::Lexer(const std::deque<Node *> &tokens_to_adopt, const Location &end_loc)
+  : m_in(nullptr)
+  , m_lookahead(tokens_to_adopt)
+  , m_after(nullptr)
+  , m_filename(end_loc.get_srcfile())
+  , m_line(end_loc.get_line())
+  , m_col(end_loc.get_col())
+  , m_eof(true) {
+}
+
+Lexer::Lexer(FILE *in, const Location &start, Node *after_to_adopt)
+  : m_in(in)
+  , m_after(after_to_adopt)
+  , m_filename(start.get_srcfile())
+  , m_line(start.get_line())
+  , m_col(start.get_col())
+  , m_eof(false) {
+}
+
 Lexer::~Lexer() {
   // delete any cached lookahead tokens
   for (auto i = m_lookahead.begin(); i != m_lookahead.end(); ++i) {
     delete *i;
   }
-  fclose(m_in);
+  delete m_after;
+  if (m_in) {
+    fclose(m_in);
+  }
 }
 
 Node *Lexer::next() {
@@ -55,6 +79,26 @@ Location Lexer::get_current_loc() const {
   return Location(m_filename, m_line, m_col);
 }
 
+bool Lexer::skip_block(std::string &text) {
+  assert(m_lookahead.empty());
+  // there are no comments or string literals, so every brace
+  // character is a brace token
+  int depth = 1;
+  while (depth > 0) {
+    int c = read();
+    if (c < 0) {
+      return false;
+    }
+    if (c == '{') {
+      depth++;
+    } else if (c == '}') {
+      depth--;
+    }
+    text.push_back(char(c));
+  }
+  return true;
+}
+
 // Read the next character of input, returning -1 (and setting m_eof to true)
 // if the end of input has been reached.
 int Lexer::read() {
@@ -87,12 +131,17 @@ void Lexer::unread(int c) {
 
 void Lexer::fill(int how_many) {
   assert(how_many > 0);
+  MemoryScope scope(MEM_TOKENS);
   while (!m_eof && int(m_lookahead.size()) < how_many) {
     Node *tok = read_token();
     if (tok != nullptr) {
       m_lookahead.push_back(tok);
     }
   }
+  if (m_eof && m_after && int(m_lookahead.size()) < how_many) {
+    m_lookahead.push_back(m_after);
+    m_after = nullptr;
+  }
 }
 
 Node *Lexer::read_token() {
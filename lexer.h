@@ -10,12 +10,22 @@ class Lexer {
 private:
   FILE *m_in;
   std::deque<Node *> m_lookahead;
+  Node *m_after;
   std::string m_filename;
   int m_line, m_col;
   bool m_eof;
 
 public:
   Lexer(FILE *in, const std::string &filename);
+
+  // Replay previously scanned tokens (which the Lexer adopts).
+  // end_loc is reported as the current location once they run out.
+  Lexer(const std::deque<Node *> &tokens_to_adopt, const Location &end_loc);
+
+  // Scan a range of a larger input: in holds the range's text, which
+  // begins at start. Once it is exhausted, after_to_adopt (if not null)
+  // is produced as the final token.
+  Lexer(FILE *in, const Location &start, Node *after_to_adopt);
   ~Lexer();
 
   // Consume the next token.
@@ -32,6 +42,11 @@ public:
 
   Location get_current_loc() const;
 
+  // Append the raw text through the brace matching an already consumed
+  // '{' (inclusive) to text, without creating tokens. There must be no
+  // lookahead tokens. Returns false if the input ends first.
+  bool skip_block(std::string &text);
+
 private:
   int read();
   void unread(int c);
@@ -1,25 +1,122 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h> // for getopt
 #include <memory>
+#include <iostream>
 #include "lexer.h"
 #include "parser2.h"
 #include "ast.h"
 #include "exceptions.h"
 #include "treeprint.h"
 #include "interp.h"
+#include "ir.h"
+#include "irbuilder.h"
+#include "iropt.h"
+#include "irinterp.h"
+#include "bytecode.h"
+#include "onepass.h"
+#include "vm.h"
+#include "stmtstream.h"
+#include "treeshake.h"
+#include "purity.h"
+#include "profiler.h"
+#include "counters.h"
+#include "tracer.h"
+#include "memstats.h"
+#include "astcache.h"
+#include "bundle.h"
+#include "batch.h"
+#include "daemon.h"
+#include "sessions.h"
+#include "inputlog.h"
+#include "cost.h"
+#include <thread>
+#include <deque>
+#include <chrono>
 
 enum {
   PRINT_TOKENS,
   PRINT_AST,
+  CHECK,
+  ESTIMATE_COST,
   EXECUTE,
+  PRINT_IR,
+  EXECUTE_IR,
+  PRINT_BYTECODE,
+  EXECUTE_BYTECODE,
+  EXECUTE_STREAMING,
+  WRITE_BUNDLE,
+  SERVE_SESSIONS,
+};
+
+// prints the execution counters and memory report (if enabled) when
+// it goes out of scope, so they are reported whether or not the
+// program succeeds
+class ExitReport {
+private:
+  bool m_counters, m_memory;
+
+public:
+  ExitReport() : m_counters(false), m_memory(false) { }
+  ~ExitReport() {
+    fflush(stdout);
+    if (m_memory) {
+      MemoryStats::stop_sampling();
+      MemoryStats::print_report(stderr);
+    }
+    if (m_counters) {
+      Counters::print_json(stderr);
+    }
+  }
+  void enable_counters() { m_counters = true; }
+  void enable_memory() { m_memory = true; }
+  bool counters_enabled() const { return m_counters; }
+  bool memory_enabled() const { return m_memory; }
+};
+
+// times a phase of the run for the counters report, and traces it
+class Phase {
+private:
+  TraceSpan m_span;
+  const char *m_name;
+  std::chrono::steady_clock::time_point m_start;
+
+public:
+  Phase(Tracer *tracer, const char *name)
+    : m_span(tracer, name, "phase"), m_name(name), m_start(std::chrono::steady_clock::now()) { }
+  ~Phase() {
+    Counters::record_phase(m_name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count());
+  }
 };
 
 // The execute function orchestrates the overall program logic,
 // but could throw an exception if an error occurs
 int execute(int argc, char **argv) {
+  // a bundled executable just runs the program embedded in it
+  std::unique_ptr<Node> bundled(Bundle::load_embedded());
+  if (bundled) {
+    Interpreter interp(bundled.release());
+    Value result = interp.execute();
+    printf("Result: %s\n", result.as_str().c_str());
+    return 0;
+  }
+
   // handle command line options
   int mode = EXECUTE, opt;
-  while ((opt = getopt(argc, argv, "lp")) != -1) {
+  bool optimize_ir = true, lazy_functions = false, tree_shake = false;
+  const char *bundle_path = nullptr, *profile_path = nullptr, *trace_path = nullptr;
+  const char *manifest_path = nullptr, *socket_path = nullptr, *session_socket_path = nullptr;
+  unsigned num_threads = std::thread::hardware_concurrency();
+  unsigned cache_capacity = 64;
+  int timeout_ms = -1;  // -1 for the mode's default
+  bool isolate = false, ordered_output = false, auto_parallel = false;
+  const char *memory_samples_path = nullptr;
+  const char *record_path = nullptr, *replay_path = nullptr;
+  const char *cache_dir = nullptr;
+  unsigned long long fuel_limit = 0, memory_limit_kb = 0;   // 0 for none
+  // declared before everything it reports on, so it is destroyed last
+  ExitReport exit_report;
+  while ((opt = getopt(argc, argv, "lpkArinbcsLtdaSmo:B:j:FD:C:T:E:P:X:M:R:I:f:e:K:")) != -1) {
     switch (opt) {
     case 'l':
       mode = PRINT_TOKENS;
@@ -27,11 +124,162 @@ int execute(int argc, char **argv) {
     case 'p':
       mode = PRINT_AST;
       break;
+    case 'k':
+      mode = CHECK;
+      break;
+    case 'A':
+      mode = ESTIMATE_COST;
+      break;
+    case 'r':
+      mode = PRINT_IR;
+      break;
+    case 'i':
+      mode = EXECUTE_IR;
+      break;
+    case 'n':
+      optimize_ir = false;
+      break;
+    case 'b':
+      mode = PRINT_BYTECODE;
+      break;
+    case 'c':
+      mode = EXECUTE_BYTECODE;
+      break;
+    case 's':
+      mode = EXECUTE_STREAMING;
+      break;
+    case 'L':
+      lazy_functions = true;
+      break;
+    case 't':
+      tree_shake = true;
+      break;
+    case 'd':
+      ordered_output = true;
+      break;
+    case 'a':
+      auto_parallel = true;
+      break;
+    case 'S':
+      exit_report.enable_counters();
+      break;
+    case 'M':
+      memory_samples_path = optarg;
+      // fall through
+    case 'm':
+      if (!MemoryStats::is_hooked()) {
+        RuntimeError::raise("-m and -M need minilang-memprof (minilang doesn't account for memory)");
+      }
+      exit_report.enable_memory();
+      break;
+    case 'o':
+      mode = WRITE_BUNDLE;
+      bundle_path = optarg;
+      break;
+    case 'B':
+      manifest_path = optarg;
+      break;
+    case 'j':
+      num_threads = unsigned(atoi(optarg));
+      break;
+    case 'F':
+      isolate = true;
+      break;
+    case 'D':
+      socket_path = optarg;
+      break;
+    case 'C':
+      cache_capacity = unsigned(atoi(optarg));
+      break;
+    case 'T':
+      timeout_ms = atoi(optarg);
+      break;
+    case 'P':
+      profile_path = optarg;
+      break;
+    case 'X':
+      trace_path = optarg;
+      break;
+    case 'E':
+      mode = SERVE_SESSIONS;
+      session_socket_path = optarg;
+      break;
+    case 'R':
+      record_path = optarg;
+      break;
+    case 'I':
+      replay_path = optarg;
+      break;
+    case 'f':
+      fuel_limit = strtoull(optarg, nullptr, 10);
+      break;
+    case 'e':
+      memory_limit_kb = strtoull(optarg, nullptr, 10);
+      break;
+    case 'K':
+      cache_dir = optarg;
+      break;
     default:
       RuntimeError::raise("Unknown option: %c", opt);
     }
   }
 
+  // the budgets are enforced only by the tree-walking interpreter (and
+  // the deadline also by batch mode and the daemon), so reject them
+  // rather than run without them
+  bool server = socket_path != nullptr || manifest_path != nullptr;
+  bool tree_walking = !server && (mode == EXECUTE || mode == EXECUTE_STREAMING);
+  if ((fuel_limit > 0 || memory_limit_kb > 0) && !tree_walking) {
+    RuntimeError::raise("-f and -e apply only to the default mode and -s");
+  }
+  if (timeout_ms > 0 && !tree_walking && !server) {
+    RuntimeError::raise("-T applies only to the default mode, -s, batch mode, and the daemon");
+  }
+
+  if (exit_report.memory_enabled()) {
+    MemoryStats::enable();
+  }
+  if (memory_samples_path != nullptr) {
+    // live bytes by category, every 10 ms
+    MemoryStats::start_sampling(memory_samples_path, 10);
+  }
+
+  if (socket_path != nullptr) {
+    // daemon mode: serve requests from minilang-client
+    Daemon daemon(socket_path, cache_capacity, timeout_ms >= 0 ? unsigned(timeout_ms) : 10000);
+    daemon.serve();
+    return 0;
+  }
+
+  if (manifest_path != nullptr) {
+    // batch mode: the jobs are listed in the manifest
+    BatchRunner batch(num_threads > 0 ? num_threads : 1);
+    batch.set_process_isolation(isolate);
+    batch.set_timeout(timeout_ms >= 0 ? unsigned(timeout_ms) : 0);
+    batch.load_manifest(manifest_path);
+    batch.run();
+    return batch.print_report(stderr) > 0 ? 1 : 0;
+  }
+
+  // budgets for a run of the tree-walking interpreter (the deadline is
+  // set when the run starts)
+  auto set_budgets = [=](Interpreter &interp) {
+    if (timeout_ms > 0) {
+      interp.set_deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms));
+    }
+    interp.set_fuel_limit(fuel_limit);
+    interp.set_memory_limit(size_t(memory_limit_kb * 1024));
+  };
+
+  // readint's values can be recorded, or replayed instead of read
+  std::unique_ptr<IOHandler> input_log;
+  if (record_path != nullptr) {
+    input_log.reset(new RecordingIOHandler(IOHandler::get_stdio(), record_path));
+  } else if (replay_path != nullptr) {
+    input_log.reset(new ReplayIOHandler(IOHandler::get_stdio(), replay_path));
+  }
+  IOHandler *io = input_log ? input_log.get() : IOHandler::get_stdio();
+
   // determine source of input
 
   FILE *in;
@@ -61,22 +309,158 @@ int execute(int argc, char **argv) {
       printf("%d:%s\n", kind, lexeme.c_str());
       delete tok;
     }
-  } else if (mode == PRINT_AST || mode == EXECUTE) {
-    // Create parser and parse the input
-    std::unique_ptr<Parser2> parser2(new Parser2(lexer.release()));
-    std::unique_ptr<Node> ast(parser2->parse());
+  } else if (mode == PRINT_BYTECODE || mode == EXECUTE_BYTECODE || mode == SERVE_SESSIONS) {
+    // compile straight from the token stream, without building an AST
+    OnePassCompiler compiler(lexer.release());
+    std::unique_ptr<Bytecode> code(compiler.compile());
+    if (mode == PRINT_BYTECODE) {
+      code->print(stdout);
+    } else if (mode == SERVE_SESSIONS) {
+      // each connection runs the program, suspending while it waits for input
+      SessionServer server(code.get(), session_socket_path);
+      server.run();
+    } else {
+      // the context passes io to the intrinsics
+      Interpreter context(nullptr, io);
+      VM vm(code.get(), &context);
+      Value result = vm.execute();
+      printf("Result: %s\n", result.as_str().c_str());
+    }
+  } else if (mode == EXECUTE_STREAMING) {
+    // execute each top-level statement as soon as it has been parsed,
+    // while the following statements are parsed in the background
+    StatementStream stmts(lexer.release(), lazy_functions);
+    Interpreter interp(new Node(AST_UNIT));
+    interp.set_io(io);
+    interp.set_task_threads(num_threads);
+    interp.set_ordered_output(ordered_output);
+    set_budgets(interp);
+    Value result;
+    while (Node *stmt = stmts.next()) {
+      result = interp.execute_next(stmt);
+      std::cout.flush();
+    }
+    printf("Result: %s\n", result.as_str().c_str());
+  } else {
+    // function bodies are only parsed on demand by the tree-walking interpreter
+    bool lazy = lazy_functions && mode == EXECUTE;
+
+    // runs of the tree-walking interpreter can be traced
+    std::unique_ptr<Tracer> tracer;
+    if (trace_path != nullptr && mode == EXECUTE) {
+      tracer.reset(new Tracer());
+    }
+
+    // with -K, use the cached AST if the source file hasn't changed
+    // since it was written (a pipe can't be read twice, so isn't cached)
+    std::unique_ptr<ASTCache> cache;
+    std::unique_ptr<Node> ast;
+    if (cache_dir != nullptr && in != stdin && ASTCache::can_cache(in)) {
+      cache.reset(new ASTCache(cache_dir, filename, in, lazy ? ASTCache::LAZY_FUNCTIONS : 0));
+      ast.reset(cache->load());
+    }
+    bool cache_stale = cache && !ast;
+
+    if (!ast) {
+      if (tracer || exit_report.counters_enabled()) {
+        // lex all of the input first, so that lexing and parsing are
+        // timed separately
+        Phase phase(tracer.get(), "lex");
+        std::deque<Node *> tokens;
+        while (lexer->peek() != nullptr) {
+          tokens.push_back(lexer->next());
+        }
+        lexer.reset(new Lexer(tokens, lexer->get_current_loc()));
+      }
+      // Create parser and parse the input
+      Phase phase(tracer.get(), "parse");
+      std::unique_ptr<Parser2> parser2(new Parser2(lexer.release()));
+      parser2->set_lazy_functions(lazy);
+      ast.reset(parser2->parse());
+    }
 
     if (mode == PRINT_AST) {
       // Print a text representation of the AST
+      Phase phase(tracer.get(), "print");
       ASTTreePrint tp;
       tp.print(ast.get());
     } else {
       // Execute the program: note that the Interpreter assumes responsibility
       // for deleting the AST
       Interpreter interp(ast.release());
-      interp.analyze();
-      Value result = interp.execute();
-      printf("Result: %s\n", result.as_str().c_str());
+      interp.set_io(io);
+      interp.set_task_threads(num_threads);
+      interp.set_ordered_output(ordered_output);
+      interp.set_tracer(tracer.get());
+      {
+        Phase phase(tracer.get(), "analyze");
+        interp.analyze();
+      }
+      if (cache_stale) {
+        // only ASTs that pass semantic analysis are cached
+        cache->store(interp.get_ast());
+      }
+      if (tree_shake) {
+        // drop unreachable functions before execution or lowering
+        TreeShaker shaker;
+        shaker.shake(interp.get_ast());
+        shaker.print_report(stderr);
+      }
+      if (mode == CHECK) {
+        // the program passed semantic analysis: nothing more to do
+      } else if (mode == ESTIMATE_COST) {
+        CostEstimator estimator;
+        estimator.estimate(interp.get_ast());
+        estimator.print_json(stdout);
+      } else if (mode == EXECUTE) {
+        if (auto_parallel) {
+          // evaluate independent pure subexpressions in parallel
+          PurityAnalysis purity;
+          purity.analyze(interp.get_ast());
+          interp.set_auto_parallel(true);
+        }
+        // the profile and trace are written even if the program fails
+        std::unique_ptr<Profiler> profiler;
+        if (profile_path != nullptr) {
+          profiler.reset(new Profiler());
+          interp.set_profiler(profiler.get());
+          profiler->start();
+        }
+        Value result;
+        set_budgets(interp);
+        try {
+          Phase phase(tracer.get(), "execute");
+          result = interp.execute();
+        } catch (BaseException &ex) {
+          if (profiler) profiler->finish(stderr, profile_path);
+          if (tracer) tracer->write(trace_path);
+          throw;
+        }
+        if (profiler) profiler->finish(stderr, profile_path);
+        if (tracer) tracer->write(trace_path);
+        printf("Result: %s\n", result.as_str().c_str());
+      } else if (mode == WRITE_BUNDLE) {
+        Bundle::write(bundle_path, interp.get_ast(), filename);
+      } else {
+        // lower to SSA IR, optimize (unless -n), then dump or run it
+        IRBuilder builder;
+        std::unique_ptr<IRModule> module(builder.build(interp.get_ast()));
+        IROptimizer optimizer;
+        if (optimize_ir) {
+          optimizer.optimize(module.get());
+        }
+        if (mode == PRINT_IR) {
+          module->print(stdout);
+          if (optimize_ir) {
+            printf("\n");
+            optimizer.print_stats(stdout);
+          }
+        } else {
+          IRInterpreter ir_interp(module.get(), &interp);
+          Value result = ir_interp.execute();
+          printf("Result: %s\n", result.as_str().c_str());
+        }
+      }
     }
   }
 
@@ -87,14 +471,8 @@ int main(int argc, char **argv) {
   try {
     return execute(argc, argv);
   } catch (BaseException &ex) {
-    if (ex.has_location()) {
-      // the exception has Location information
-      const Location &loc = ex.get_loc();
-      fprintf(stderr, "%s:%d:%d: Error: %s\n", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col(), ex.what());
-    } else {
-      // no Location
-      fprintf(stderr, "Error: %s\n", ex.what());
-    }
+    // the message includes the Location, if the exception has one
+    fprintf(stderr, "%s\n", ex.get_message().c_str());
     return 1;
   }
 }
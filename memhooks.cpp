@@ -0,0 +1,47 @@
+#include <cstdlib>
+#include <new>
+#include "memstats.h"
+
+// Replacements for the global allocation functions that record each
+// allocation with MemoryStats. Each block is preceded by a header
+// holding its size and category, so that it is freed from the right
+// category whichever thread frees it (and isn't counted as freed if
+// it was allocated before accounting was enabled). (The array and nothrow forms
+// call these; over-aligned allocations aren't counted.)
+
+namespace {
+
+struct alignas(alignof(std::max_align_t)) Header {
+  size_t size;
+  MemCategory category;
+};
+
+// tells MemoryStats that the hooks are linked in
+struct Installer {
+  Installer() { MemoryStats::set_hooked(); }
+} g_installer;
+
+}
+
+void *operator new(size_t size) {
+  Header *header = static_cast<Header *>(malloc(sizeof(Header) + size));
+  if (header == nullptr) {
+    throw std::bad_alloc();
+  }
+  header->size = size;
+  header->category = MemoryStats::record_alloc(size);
+  return header + 1;
+}
+
+void operator delete(void *p) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  Header *header = static_cast<Header *>(p) - 1;
+  MemoryStats::record_free(header->category, header->size);
+  free(header);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  operator delete(p);
+}
@@ -0,0 +1,146 @@
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "exceptions.h"
+#include "memstats.h"
+
+namespace {
+
+const char *const CATEGORY_NAMES[NUM_MEM_CATEGORIES] = {
+  "other", "tokens", "ast", "environments", "values", "io"
+};
+
+// zero-initialized before any allocation can be recorded
+std::atomic<uint64_t> g_live[NUM_MEM_CATEGORIES];
+std::atomic<uint64_t> g_peak[NUM_MEM_CATEGORIES];
+std::atomic<uint64_t> g_num_allocs[NUM_MEM_CATEGORIES];
+std::atomic<uint64_t> g_total_live, g_total_peak;
+std::atomic<bool> g_enabled;
+std::atomic<bool> g_hooked;
+
+thread_local MemCategory t_category = MEM_OTHER;
+
+// the sampling thread
+std::mutex g_sampler_lock;
+std::condition_variable g_sampler_wake;
+bool g_sampler_stopping;
+std::thread g_sampler;
+
+void update_peak(std::atomic<uint64_t> &peak, uint64_t live) {
+  uint64_t old_peak = peak.load(std::memory_order_relaxed);
+  while (live > old_peak && !peak.compare_exchange_weak(old_peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+void sample(FILE *out, unsigned interval_ms) {
+  auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> guard(g_sampler_lock);
+  for (;;) {
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    fprintf(out, "%.1f", ms);
+    for (unsigned i = 0; i < NUM_MEM_CATEGORIES; i++) {
+      fprintf(out, ",%llu", static_cast<unsigned long long>(g_live[i].load(std::memory_order_relaxed)));
+    }
+    fprintf(out, ",%llu\n", static_cast<unsigned long long>(g_total_live.load(std::memory_order_relaxed)));
+    if (g_sampler_stopping) {
+      break;
+    }
+    g_sampler_wake.wait_for(guard, std::chrono::milliseconds(interval_ms));
+  }
+  fclose(out);
+}
+
+}
+
+void MemoryStats::enable() {
+  g_enabled.store(true, std::memory_order_relaxed);
+}
+
+void MemoryStats::set_hooked() {
+  g_hooked.store(true, std::memory_order_relaxed);
+}
+
+bool MemoryStats::is_hooked() {
+  return g_hooked.load(std::memory_order_relaxed);
+}
+
+MemCategory MemoryStats::get_category() {
+  return t_category;
+}
+
+MemCategory MemoryStats::set_category(MemCategory category) {
+  MemCategory saved = t_category;
+  t_category = category;
+  return saved;
+}
+
+MemCategory MemoryStats::record_alloc(size_t size) {
+  if (!g_enabled.load(std::memory_order_relaxed)) {
+    return NUM_MEM_CATEGORIES;
+  }
+  MemCategory category = t_category;
+  uint64_t live = g_live[category].fetch_add(size, std::memory_order_relaxed) + size;
+  update_peak(g_peak[category], live);
+  g_num_allocs[category].fetch_add(1, std::memory_order_relaxed);
+  update_peak(g_total_peak, g_total_live.fetch_add(size, std::memory_order_relaxed) + size);
+  return category;
+}
+
+void MemoryStats::record_free(MemCategory category, size_t size) {
+  if (category == NUM_MEM_CATEGORIES) {
+    return;
+  }
+  g_live[category].fetch_sub(size, std::memory_order_relaxed);
+  g_total_live.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void MemoryStats::print_report(FILE *out) {
+  fprintf(out, "Memory by category:\n");
+  fprintf(out, "  %-14s %14s %14s %12s\n", "category", "live bytes", "peak bytes", "allocations");
+  uint64_t total_allocs = 0;
+  for (unsigned i = 0; i < NUM_MEM_CATEGORIES; i++) {
+    uint64_t num_allocs = g_num_allocs[i].load(std::memory_order_relaxed);
+    total_allocs += num_allocs;
+    fprintf(out, "  %-14s %14llu %14llu %12llu\n", CATEGORY_NAMES[i],
+            static_cast<unsigned long long>(g_live[i].load(std::memory_order_relaxed)),
+            static_cast<unsigned long long>(g_peak[i].load(std::memory_order_relaxed)),
+            static_cast<unsigned long long>(num_allocs));
+  }
+  fprintf(out, "  %-14s %14llu %14llu %12llu\n", "total",
+          static_cast<unsigned long long>(g_total_live.load(std::memory_order_relaxed)),
+          static_cast<unsigned long long>(g_total_peak.load(std::memory_order_relaxed)),
+          static_cast<unsigned long long>(total_allocs));
+}
+
+void MemoryStats::start_sampling(const char *path, unsigned interval_ms) {
+  if (g_sampler.joinable()) {
+    RuntimeError::raise("Memory sampling has already started");
+  }
+  FILE *out = fopen(path, "w");
+  if (out == nullptr) {
+    RuntimeError::raise("Could not write memory samples to '%s'", path);
+  }
+  fprintf(out, "ms");
+  for (unsigned i = 0; i < NUM_MEM_CATEGORIES; i++) {
+    fprintf(out, ",%s", CATEGORY_NAMES[i]);
+  }
+  fprintf(out, ",total\n");
+  g_sampler_stopping = false;
+  g_sampler = std::thread(sample, out, interval_ms > 0 ? interval_ms : 1);
+}
+
+// takes a last sample
+void MemoryStats::stop_sampling() {
+  if (!g_sampler.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(g_sampler_lock);
+    g_sampler_stopping = true;
+  }
+  g_sampler_wake.notify_one();
+  g_sampler.join();
+}
@@ -0,0 +1,70 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <cstdio>
+#include <cstddef>
+
+// what an allocation is for
+enum MemCategory {
+  MEM_OTHER,
+  MEM_TOKENS,        // tokens, their lexemes and Locations
+  MEM_AST,           // AST nodes built by the parser (or loaded)
+  MEM_ENVIRONMENTS,  // Environments and their tables
+  MEM_VALUES,        // ValReps (Functions)
+  MEM_IO,            // output and input buffers of the intrinsics
+  NUM_MEM_CATEGORIES
+};
+
+// Heap accounting by category. Code that allocates for one of the
+// categories sets the calling thread's current category with a
+// MemoryScope, and the allocation functions (memhooks.cpp, which
+// replaces the global operator new and delete) record each allocation
+// against the category that was current when it was made: live bytes,
+// peak live bytes, and the number of allocations. Accounting starts
+// when enable() is called (only later allocations are counted); without
+// memhooks.o linked in (as in minilang and libminilang), nothing is
+// recorded.
+class MemoryStats {
+public:
+  static void enable();
+
+  // memhooks.o calls set_hooked() during static initialization, so
+  // is_hooked() tells whether allocations can be recorded at all
+  static void set_hooked();
+  static bool is_hooked();
+
+  static MemCategory get_category();
+  // returns the previous category
+  static MemCategory set_category(MemCategory category);
+
+  // Called by the allocation functions: record_alloc returns the
+  // category to pass to record_free when the block is freed
+  // (NUM_MEM_CATEGORIES if it wasn't counted).
+  static MemCategory record_alloc(size_t size);
+  static void record_free(MemCategory category, size_t size);
+
+  // print live bytes, peak bytes, and allocations by category
+  static void print_report(FILE *out);
+
+  // Write the live bytes of each category to a CSV file every
+  // interval_ms milliseconds, from a background thread, until
+  // stop_sampling() is called.
+  static void start_sampling(const char *path, unsigned interval_ms);
+  static void stop_sampling();
+};
+
+// sets the calling thread's allocation category while it is in scope
+class MemoryScope {
+private:
+  MemCategory m_saved;
+
+  // value semantics prohibited
+  MemoryScope(const MemoryScope &);
+  MemoryScope &operator=(const MemoryScope &);
+
+public:
+  MemoryScope(MemCategory category) : m_saved(MemoryStats::set_category(category)) { }
+  ~MemoryScope() { MemoryStats::set_category(m_saved); }
+};
+
+#endif // MEMSTATS_H
@@ -0,0 +1,544 @@
+// minilang-microbench: microbenchmarks of the interpreter's components,
+// linked from the library's object files.
+//
+//   minilang-microbench [-p] [-r reps] [-f filter]
+//
+// Each benchmark is calibrated so that one repetition takes at least
+// 20 ms, then repeated (default 11 times); the median time per
+// operation is reported with the median absolute deviation (as a
+// percentage of the median) and the rate. -p also reads the hardware
+// counters (cycles, instructions, cache misses, branch misses) with
+// perf_event_open, reported per operation (medians over the
+// repetitions); -f runs only the benchmarks whose names contain the
+// filter string.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "node.h"
+#include "ast.h"
+#include "lexer.h"
+#include "parser2.h"
+#include "value.h"
+#include "function.h"
+#include "environment.h"
+#include "interp.h"
+#include "io.h"
+#include "exceptions.h"
+
+namespace {
+
+const double MIN_REP_NS = 20e6;
+
+////////////////////////////////////////////////////////////////////////
+// Hardware counters
+////////////////////////////////////////////////////////////////////////
+
+// A group of hardware counters, read together with perf_event_open.
+class PerfCounters {
+public:
+  enum { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, NUM_COUNTERS };
+
+private:
+  int m_fds[NUM_COUNTERS];
+  std::string m_error;
+
+public:
+  PerfCounters() {
+    for (int i = 0; i < NUM_COUNTERS; i++) m_fds[i] = -1;
+  }
+  ~PerfCounters() {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      if (m_fds[i] >= 0) close(m_fds[i]);
+    }
+  }
+
+  bool open() {
+    static const uint64_t configs[NUM_COUNTERS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.disabled = i == 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      m_fds[i] = int(syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : m_fds[0], 0));
+      if (m_fds[i] < 0) {
+        m_error = strerror(errno);
+        return false;
+      }
+    }
+    return true;
+  }
+  const std::string &get_error() const { return m_error; }
+  bool is_open() const { return m_fds[0] >= 0 && m_error.empty(); }
+
+  void start() {
+    ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+  void stop(uint64_t counts[NUM_COUNTERS]) {
+    ioctl(m_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t buf[1 + NUM_COUNTERS];
+    if (read(m_fds[0], buf, sizeof(buf)) != ssize_t(sizeof(buf))) {
+      memset(buf, 0, sizeof(buf));
+    }
+    for (int i = 0; i < NUM_COUNTERS; i++) counts[i] += buf[1 + i];
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+// Timing
+////////////////////////////////////////////////////////////////////////
+
+// Accumulates the time (and hardware counts) of the measured parts of
+// a repetition; a benchmark brackets the work it measures with start()
+// and stop(), leaving out its setup.
+class Timer {
+private:
+  PerfCounters *m_perf;
+  std::chrono::steady_clock::time_point m_start;
+  double m_ns;
+  uint64_t m_counts[PerfCounters::NUM_COUNTERS];
+
+public:
+  Timer(PerfCounters *perf) : m_perf(perf), m_ns(0.0) {
+    memset(m_counts, 0, sizeof(m_counts));
+  }
+
+  void start() {
+    if (m_perf != nullptr) m_perf->start();
+    m_start = std::chrono::steady_clock::now();
+  }
+  void stop() {
+    m_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count();
+    if (m_perf != nullptr) m_perf->stop(m_counts);
+  }
+
+  // subtract another Timer's measurements (of overhead)
+  void discount(const Timer &other) {
+    m_ns = std::max(0.0, m_ns - other.m_ns);
+    for (int i = 0; i < PerfCounters::NUM_COUNTERS; i++) {
+      m_counts[i] = m_counts[i] > other.m_counts[i] ? m_counts[i] - other.m_counts[i] : 0;
+    }
+  }
+
+  PerfCounters *get_perf() const { return m_perf; }
+  double get_ns() const { return m_ns; }
+  uint64_t get_count(int i) const { return m_counts[i]; }
+};
+
+// performs n iterations, returning the number of operations done
+typedef std::function<uint64_t(uint64_t n, Timer &timer)> BenchFn;
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 == 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+class MicroBench {
+private:
+  PerfCounters *m_perf;
+  unsigned m_reps;
+  std::string m_filter;
+  std::string m_section;   // printed before its first benchmark that runs
+
+public:
+  MicroBench(PerfCounters *perf, unsigned reps, const std::string &filter)
+    : m_perf(perf), m_reps(reps), m_filter(filter) { }
+
+  void section(const char *title) {
+    m_section = title;
+  }
+
+  // unit names an operation; bytes_per_op (if nonzero) adds MB/s
+  void run(const std::string &name, const char *unit, const BenchFn &fn, double bytes_per_op = 0.0) {
+    if (!m_filter.empty() && name.find(m_filter) == std::string::npos) {
+      return;
+    }
+    if (!m_section.empty()) {
+      printf("\n%s\n", m_section.c_str());
+      m_section.clear();
+    }
+
+    // calibrate: grow n until one repetition (including its setup,
+    // which may dominate when the measured part is tiny) takes long
+    // enough
+    uint64_t n = 1;
+    for (;;) {
+      Timer timer(nullptr);
+      auto start = std::chrono::steady_clock::now();
+      fn(n, timer);
+      double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      if (ns >= MIN_REP_NS) break;
+      n *= std::max<uint64_t>(2, uint64_t(MIN_REP_NS / std::max(ns, 1.0) * 1.2));
+    }
+
+    std::vector<double> ns_per_op;
+    std::vector<double> per_op[PerfCounters::NUM_COUNTERS];
+    for (unsigned r = 0; r < m_reps; r++) {
+      Timer timer(m_perf);
+      double ops = double(fn(n, timer));
+      ns_per_op.push_back(timer.get_ns() / ops);
+      for (int i = 0; i < PerfCounters::NUM_COUNTERS; i++) {
+        per_op[i].push_back(double(timer.get_count(i)) / ops);
+      }
+    }
+    double med = median(ns_per_op);
+    std::vector<double> deviations;
+    for (auto i = ns_per_op.begin(); i != ns_per_op.end(); ++i) {
+      deviations.push_back(std::abs(*i - med));
+    }
+    double mad_pct = 100.0 * median(deviations) / med;
+
+    std::string rate;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%8.2f M %s/s", 1e3 / med, unit);
+    rate = buf;
+    if (bytes_per_op > 0.0) {
+      snprintf(buf, sizeof(buf), "  %7.1f MB/s", bytes_per_op * 1e3 / med);
+      rate += buf;
+    }
+    printf("  %-40s %10.1f ns/%-9s ±%5.1f%%  %s\n", name.c_str(), med, unit, mad_pct, rate.c_str());
+    if (m_perf != nullptr) {
+      printf("  %-40s %10.1f cycles  %10.1f instrs  %8.3f cache misses  %8.3f branch misses\n", "",
+             median(per_op[PerfCounters::CYCLES]), median(per_op[PerfCounters::INSTRUCTIONS]),
+             median(per_op[PerfCounters::CACHE_MISSES]), median(per_op[PerfCounters::BRANCH_MISSES]));
+    }
+    fflush(stdout);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+// Synthetic inputs
+////////////////////////////////////////////////////////////////////////
+
+// a program mixing functions, declarations, arithmetic, and control
+std::string synthetic_program(unsigned num_units) {
+  std::string src;
+  char buf[512];
+  for (unsigned i = 0; i < num_units; i++) {
+    snprintf(buf, sizeof(buf),
+             "function f%u(a, b) {\n"
+             "  var t;\n"
+             "  t = a * %u + b / 2 - (a - 7);\n"
+             "  if (t > 10 && b < %u) { t = t - 1; } else { t = t + 1; }\n"
+             "  while (t > 100) { t = t / 2; }\n"
+             "  t;\n"
+             "}\n"
+             "var x%u;\n"
+             "x%u = f%u(12, 34) + 5 * (6 - 2);\n",
+             i, i % 13 + 1, i * 7, i, i, i);
+    src += buf;
+  }
+  return src;
+}
+
+unsigned count_nodes(const Node *node) {
+  unsigned n = 1;
+  for (auto i = node->cbegin(); i != node->cend(); ++i) {
+    n += count_nodes(*i);
+  }
+  return n;
+}
+
+Lexer *string_lexer(const std::string &src) {
+  FILE *in = fmemopen(const_cast<char *>(src.data()), src.size(), "r");
+  if (in == nullptr) {
+    RuntimeError::raise("fmemopen failed");
+  }
+  return new Lexer(in, "<synthetic>");
+}
+
+// copies of tokens, for a Lexer to replay (and adopt)
+std::deque<Node *> copy_tokens(const std::vector<Node *> &tokens) {
+  std::deque<Node *> copies;
+  for (auto i = tokens.begin(); i != tokens.end(); ++i) {
+    Node *copy = new Node((*i)->get_tag(), (*i)->get_str());
+    copy->set_loc((*i)->get_loc());
+    copies.push_back(copy);
+  }
+  return copies;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Benchmarks
+////////////////////////////////////////////////////////////////////////
+
+void bench_value(MicroBench &mb) {
+  mb.section("Value");
+  mb.run("copy (int)", "op", [](uint64_t n, Timer &timer) {
+    Value src(42);
+    int sum = 0;
+    timer.start();
+    for (uint64_t i = 0; i < n; i++) {
+      Value copy(src);
+      sum += copy.get_ival();
+    }
+    timer.stop();
+    return sum != 0 ? n : 0;
+  });
+  mb.run("assign (int)", "op", [](uint64_t n, Timer &timer) {
+    Value src(42), dst;
+    timer.start();
+    for (uint64_t i = 0; i < n; i++) {
+      dst = src;
+    }
+    timer.stop();
+    return n;
+  });
+  mb.run("copy (function, refcounted)", "op", [](uint64_t n, Timer &timer) {
+    Value src(new Function("f", std::vector<std::string>(), nullptr, nullptr));
+    timer.start();
+    for (uint64_t i = 0; i < n; i++) {
+      Value copy(src);
+    }
+    timer.stop();
+    return n;
+  });
+  mb.run("assign (function over int)", "op", [](uint64_t n, Timer &timer) {
+    Value src(new Function("f", std::vector<std::string>(), nullptr, nullptr));
+    Value dst;
+    timer.start();
+    for (uint64_t i = 0; i < n; i++) {
+      dst = src;
+      dst = Value(0);
+    }
+    timer.stop();
+    return n;
+  });
+}
+
+void bench_environment(MicroBench &mb) {
+  mb.section("Environment (variable defined at the outermost scope)");
+  const unsigned depths[] = { 0, 4, 16 };
+  const unsigned sizes[] = { 1, 16, 256 };
+  for (unsigned d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      unsigned depth = depths[d], size = sizes[s];
+      // a chain of depth + 1 Environments, each with size variables
+      auto make_chain = [depth, size](std::vector<std::unique_ptr<Environment>> &chain) {
+        for (unsigned level = 0; level <= depth; level++) {
+          chain.emplace_back(new Environment(level == 0 ? nullptr : chain.back().get()));
+          for (unsigned v = 0; v < size; v++) {
+            // only the outermost scope defines v0
+            chain.back()->create_var((level == 0 ? "v" : "w") + std::to_string(v), Location());
+          }
+        }
+      };
+      char name[64];
+      snprintf(name, sizeof(name), "get_var depth %u, %u vars/scope", depth, size);
+      mb.run(name, "op", [&make_chain](uint64_t n, Timer &timer) {
+        std::vector<std::unique_ptr<Environment>> chain;
+        make_chain(chain);
+        Environment *inner = chain.back().get();
+        const std::string var = "v0";
+        timer.start();
+        for (uint64_t i = 0; i < n; i++) {
+          inner->get_var(var);
+        }
+        timer.stop();
+        return n;
+      });
+      snprintf(name, sizeof(name), "set_var depth %u, %u vars/scope", depth, size);
+      mb.run(name, "op", [&make_chain](uint64_t n, Timer &timer) {
+        std::vector<std::unique_ptr<Environment>> chain;
+        make_chain(chain);
+        Environment *inner = chain.back().get();
+        const std::string var = "v0";
+        timer.start();
+        for (uint64_t i = 0; i < n; i++) {
+          inner->set_var(var, int(i), Location());
+        }
+        timer.stop();
+        return n;
+      });
+    }
+  }
+}
+
+void bench_lexer(MicroBench &mb) {
+  mb.section("Lexer");
+  const std::string src = synthetic_program(200);
+  unsigned num_tokens = 0;
+  {
+    std::unique_ptr<Lexer> lexer(string_lexer(src));
+    while (lexer->peek() != nullptr) {
+      delete lexer->next();
+      num_tokens++;
+    }
+  }
+  mb.run("tokens (synthetic program)", "token", [&src, num_tokens](uint64_t n, Timer &timer) {
+    for (uint64_t i = 0; i < n; i++) {
+      std::unique_ptr<Lexer> lexer(string_lexer(src));
+      timer.start();
+      while (lexer->peek() != nullptr) {
+        delete lexer->next();
+      }
+      timer.stop();
+    }
+    return n * num_tokens;
+  }, double(src.size()) / num_tokens);
+}
+
+void bench_parser(MicroBench &mb) {
+  mb.section("Parser2");
+  const std::string src = synthetic_program(200);
+  std::vector<Node *> tokens;
+  unsigned num_nodes;
+  {
+    std::unique_ptr<Lexer> lexer(string_lexer(src));
+    while (lexer->peek() != nullptr) {
+      tokens.push_back(lexer->next());
+    }
+    std::unique_ptr<Node> ast(Parser2(string_lexer(src)).parse());
+    num_nodes = count_nodes(ast.get());
+  }
+  mb.run("AST nodes (replayed tokens)", "node", [&tokens, num_nodes](uint64_t n, Timer &timer) {
+    for (uint64_t i = 0; i < n; i++) {
+      Parser2 parser(new Lexer(copy_tokens(tokens), Location()));
+      timer.start();
+      std::unique_ptr<Node> ast(parser.parse());
+      timer.stop();
+    }
+    return n * num_nodes;
+  });
+  mb.run("AST nodes (including lexing)", "node", [&src, num_nodes](uint64_t n, Timer &timer) {
+    for (uint64_t i = 0; i < n; i++) {
+      Parser2 parser(string_lexer(src));
+      timer.start();
+      std::unique_ptr<Node> ast(parser.parse());
+      timer.stop();
+    }
+    return n * num_nodes;
+  });
+  for (auto i = tokens.begin(); i != tokens.end(); ++i) {
+    delete *i;
+  }
+}
+
+// Runs a loop whose body is STMTS_PER_ITER copies of a statement, and
+// reports the time per statement beyond that of the empty loop.
+void bench_execute(MicroBench &mb) {
+  const unsigned STMTS_PER_ITER = 8;
+  mb.section("execute_node (cost per statement, less the loop's)");
+  struct Kind {
+    const char *node_kind;
+    const char *stmt;
+  };
+  const Kind kinds[] = {
+    { "INT_LITERAL", "1;" },
+    { "VARREF", "x;" },
+    { "ADD", "x + y;" },
+    { "MULTIPLY", "x * y;" },
+    { "DIVIDE", "x / y;" },
+    { "LESS_THAN", "x < y;" },
+    { "LOGICAL_AND", "x && y;" },
+    { "ASSIGN", "x = y;" },
+    { "IF (and block)", "if (x) { y; }" },
+    { "FUNC_CALL", "f(x);" },
+    { "FUNC_CALL (intrinsic)", "print(x);" },
+  };
+
+  // a loop of n iterations, n read from the input
+  auto program = [](const std::string &body) {
+    return "function f(a) { a; }\n"
+           "var n; var i; var x; var y;\n"
+           "n = readint(); i = 0; x = 3; y = 5;\n"
+           "while (i < n) {\n" + body + "  i = i + 1;\n}\n";
+  };
+  // run the program for n iterations, timing its execution
+  auto run_loop = [](const std::string &src, uint64_t n, Timer &timer) {
+    Interpreter interp(Parser2(string_lexer(src)).parse());
+    interp.analyze();
+    StringIOHandler io(std::to_string(n));
+    interp.set_io(&io);
+    timer.start();
+    interp.execute();
+    timer.stop();
+  };
+
+  const std::string base_src = program("");
+  for (unsigned k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+    std::string body;
+    for (unsigned s = 0; s < STMTS_PER_ITER; s++) {
+      body += std::string("  ") + kinds[k].stmt + "\n";
+    }
+    const std::string src = program(body);
+    std::string name = std::string(kinds[k].node_kind) + ": " + kinds[k].stmt;
+    mb.run(name, "stmt", [&src, &base_src, &run_loop](uint64_t n, Timer &timer) {
+      Timer base(timer.get_perf());
+      run_loop(base_src, n, base);
+      run_loop(src, n, timer);
+      timer.discount(base);
+      return n * STMTS_PER_ITER;
+    });
+  }
+}
+
+int usage() {
+  fprintf(stderr, "Usage: minilang-microbench [-p] [-r reps] [-f filter]\n");
+  return 1;
+}
+
+}
+
+int main(int argc, char **argv) {
+  bool use_perf = false;
+  unsigned reps = 11;
+  std::string filter;
+  int opt;
+  while ((opt = getopt(argc, argv, "pr:f:")) != -1) {
+    switch (opt) {
+    case 'p':
+      use_perf = true;
+      break;
+    case 'r':
+      reps = unsigned(std::max(1, atoi(optarg)));
+      break;
+    case 'f':
+      filter = optarg;
+      break;
+    default:
+      return usage();
+    }
+  }
+
+  PerfCounters perf;
+  if (use_perf && !perf.open()) {
+    fprintf(stderr, "Hardware counters are unavailable (%s); timing only\n", perf.get_error().c_str());
+    use_perf = false;
+  }
+
+  try {
+    MicroBench mb(use_perf ? &perf : nullptr, reps, filter);
+    bench_value(mb);
+    bench_environment(mb);
+    bench_lexer(mb);
+    bench_parser(mb);
+    bench_execute(mb);
+  } catch (BaseException &ex) {
+    fprintf(stderr, "%s\n", ex.get_message().c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <memory>
+#include "exceptions.h"
+#include "lexer.h"
+#include "parser2.h"
+#include "interp.h"
+#include "minilang.h"
+
+////////////////////////////////////////////////////////////////////////
+// MinilangProgram implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+Node *parse_and_analyze(FILE *in, const std::string &name) {
+  Parser2 parser(new Lexer(in, name));
+  std::unique_ptr<Node> ast(parser.parse());
+  Interpreter analyzer(ast.get(), IOHandler::get_stdio());
+  analyzer.analyze();
+  return ast.release();
+}
+
+}
+
+MinilangProgram::MinilangProgram(Node *ast_to_adopt)
+  : m_ast(ast_to_adopt) {
+}
+
+MinilangProgram::~MinilangProgram() {
+  delete m_ast;
+}
+
+MinilangProgram *MinilangProgram::compile(const std::string &source, const std::string &name) {
+  FILE *in = fmemopen(const_cast<char *>(source.data()), source.size(), "r");
+  if (!in) {
+    RuntimeError::raise("Could not read program source");
+  }
+  return new MinilangProgram(parse_and_analyze(in, name));
+}
+
+MinilangProgram *MinilangProgram::compile_file(const std::string &path) {
+  FILE *in = fopen(path.c_str(), "r");
+  if (!in) {
+    RuntimeError::raise("Could not open input file '%s'", path.c_str());
+  }
+  return new MinilangProgram(parse_and_analyze(in, path));
+}
+
+////////////////////////////////////////////////////////////////////////
+// MinilangContext implementation
+////////////////////////////////////////////////////////////////////////
+
+MinilangContext::MinilangContext(const MinilangProgram *program, IOHandler *io)
+  : m_program(program)
+  , m_interp(new Interpreter(program->get_ast(), io != nullptr ? io : IOHandler::get_stdio()))
+  , m_timeout_ms(0) {
+  m_interp->set_max_call_depth(DEFAULT_MAX_CALL_DEPTH);
+}
+
+MinilangContext::~MinilangContext() {
+}
+
+void MinilangContext::set_io(IOHandler *io) {
+  m_interp->set_io(io != nullptr ? io : IOHandler::get_stdio());
+}
+
+void MinilangContext::set_program(const MinilangProgram *program) {
+  m_program = program;
+  m_interp->set_ast(program->get_ast());
+}
+
+void MinilangContext::set_max_call_depth(unsigned depth) {
+  m_interp->set_max_call_depth(depth);
+}
+
+Value MinilangContext::run() {
+  if (m_timeout_ms > 0) {
+    m_interp->set_deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(m_timeout_ms));
+  } else {
+    m_interp->clear_deadline();
+  }
+  return m_interp->execute();
+}
@@ -0,0 +1,82 @@
+#ifndef MINILANG_H
+#define MINILANG_H
+
+// Embedding API for libminilang.
+//
+// A MinilangProgram is compiled (lexed, parsed, and analyzed) once
+// and is immutable afterwards, so it can be shared by any number of
+// MinilangContexts, including ones running concurrently on different
+// threads. A context executes the program with its own global
+// Environment and IOHandler, and can be run repeatedly: each run
+// starts from a fresh global scope, reusing the context's storage.
+//
+// Errors are reported by throwing the exceptions in exceptions.h
+// (SyntaxError, SemanticError, EvaluationError, RuntimeError), all
+// derived from BaseException.
+
+#include <string>
+#include <memory>
+#include "value.h"
+#include "io.h"
+class Node;
+class Interpreter;
+
+class MinilangProgram {
+private:
+  Node *m_ast;
+
+  MinilangProgram(Node *ast_to_adopt);
+
+  // value semantics prohibited
+  MinilangProgram(const MinilangProgram &);
+  MinilangProgram &operator=(const MinilangProgram &);
+
+public:
+  ~MinilangProgram();
+
+  // name is used as the source file name in error Locations
+  static MinilangProgram *compile(const std::string &source, const std::string &name = "<string>");
+  static MinilangProgram *compile_file(const std::string &path);
+
+  const Node *get_ast() const { return m_ast; }
+};
+
+class MinilangContext {
+private:
+  const MinilangProgram *m_program;
+  std::unique_ptr<Interpreter> m_interp;
+  unsigned m_timeout_ms;
+
+  // value semantics prohibited
+  MinilangContext(const MinilangContext &);
+  MinilangContext &operator=(const MinilangContext &);
+
+public:
+  // the program must outlive the context; a null io uses standard I/O
+  MinilangContext(const MinilangProgram *program, IOHandler *io = nullptr);
+  ~MinilangContext();
+
+  // the handler used by subsequent runs (e.g., one per request)
+  void set_io(IOHandler *io);
+
+  // the program executed by subsequent runs (which must outlive the
+  // context), so that one context can serve many programs
+  void set_program(const MinilangProgram *program);
+
+  // limit the wall time of subsequent runs (0 for no limit); a run
+  // that exceeds it raises an EvaluationError
+  void set_timeout(unsigned timeout_ms) { m_timeout_ms = timeout_ms; }
+
+  // Calls nested deeper than this raise an EvaluationError instead of
+  // overflowing the native stack of the thread running the context,
+  // which would bring down the whole process (the daemon or a batch
+  // runner, say), so contexts start with this limit.
+  static const unsigned DEFAULT_MAX_CALL_DEPTH = 1000;
+  // 0 for no limit
+  void set_max_call_depth(unsigned depth);
+
+  // execute the program, returning the value of its last statement
+  Value run();
+};
+
+#endif // MINILANG_H
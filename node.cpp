@@ -75,6 +75,12 @@ void Node::append_kid(Node *kid) {
   }
 }
 
+Node *Node::remove_kid(unsigned index) {
+  Node *kid = m_kids.at(index);
+  m_kids.erase(m_kids.begin() + index);
+  return kid;
+}
+
 void Node::prepend_kid(Node *kid) {
   m_kids.insert(m_kids.begin(), kid);
 
@@ -65,6 +65,8 @@ public:
 
   void append_kid(Node *kid);
   void prepend_kid(Node *kid);
+  // remove a child without deleting it (the caller takes ownership)
+  Node *remove_kid(unsigned index);
   unsigned get_num_kids() const { return unsigned(m_kids.size()); }
   Node *get_kid(unsigned index) const { return m_kids.at(index); }
   Node *get_last_kid() const { return m_kids.back(); }
@@ -20,7 +20,8 @@
 
 #include "node_base.h"
 
-NodeBase::NodeBase() {
+NodeBase::NodeBase()
+  : m_parallel_eval(false) {
 }
 
 NodeBase::~NodeBase() {
@@ -27,7 +27,9 @@
 // etc.)
 class NodeBase {
 private:
-  // fields could go here
+  // set by PurityAnalysis (purity.h) on expressions whose operands, or
+  // on AST_ARGS nodes whose arguments, may be evaluated in parallel
+  bool m_parallel_eval;
 
   // copy ctor and assignment operator not supported
   NodeBase(const NodeBase &);
@@ -36,6 +38,9 @@ private:
 public:
   NodeBase();
   virtual ~NodeBase();
+
+  bool is_parallel_eval() const { return m_parallel_eval; }
+  void set_parallel_eval(bool parallel_eval) { m_parallel_eval = parallel_eval; }
 };
 
 #endif // NODE_BASE_H
@@ -0,0 +1,500 @@
+#include <cassert>
+#include <algorithm>
+#include <memory>
+#include "token.h"
+#include "exceptions.h"
+#include "interp.h"
+#include "onepass.h"
+
+////////////////////////////////////////////////////////////////////////
+// OnePassCompiler implementation
+// The compile_ functions correspond to the parse_ functions of
+// Parser2 (see parser2.cpp for the grammar). Each leaves the code
+// for the construct it recognizes at the end of the current
+// function's instruction stream; expressions leave their value on
+// the stack, statements store theirs as the frame's result.
+////////////////////////////////////////////////////////////////////////
+
+// Scope layout: m_scopes[0] holds the intrinsic functions,
+// m_scopes[1] holds top-level definitions (global variables and
+// function slots), and each parameter list or statement list
+// pushes a further scope of local slots.
+
+OnePassCompiler::OnePassCompiler(Lexer *lexer_to_adopt)
+  : m_lexer(lexer_to_adopt)
+  , m_code(nullptr)
+  , m_state(nullptr) {
+}
+
+OnePassCompiler::~OnePassCompiler() {
+  delete m_lexer;
+}
+
+Bytecode *OnePassCompiler::compile() {
+  std::unique_ptr<Bytecode> code(new Bytecode());
+  m_code = code.get();
+
+  m_scopes.clear();
+  m_scopes.push_back(Scope());
+  const char *intrinsics[] = { "print", "println", "readint" };
+  for (const char *name : intrinsics) {
+    define(name, BINDING_INTRINSIC, m_code->add_intrinsic(name, Interpreter::lookup_intrinsic(name)));
+  }
+  m_scopes.push_back(Scope());
+
+  FnState state;
+  state.fn = new BytecodeFunction();
+  state.fn->name = "<main>";
+  state.fn->num_params = 0;
+  state.fn->num_locals = 0;
+  state.next_local = 0;
+  m_code->add_function(state.fn);
+  m_state = &state;
+
+  compile_Unit();
+  emit(BC_RET);
+
+  m_state = nullptr;
+  m_code = nullptr;
+  return code.release();
+}
+
+void OnePassCompiler::compile_Unit() {
+  // Unit → TStmt
+  // Unit → TStmt Unit
+  for (;;) {
+    compile_TStmt();
+    if (m_lexer->peek() == nullptr)
+      break;
+  }
+}
+
+void OnePassCompiler::compile_TStmt() {
+  // TStmt →      Stmt
+  // TStmt →      Func
+  Node *next = peek_or_error("Unexpected end of input looking for statement");
+  if (next->get_tag() == TOK_FUNC) {
+    compile_func();
+  } else {
+    compile_Stmt();
+  }
+}
+
+void OnePassCompiler::compile_Stmt() {
+  // Stmt -> ^ var ident ;
+  // Stmt -> ^ A ;
+  // Stmt →       if ( A ) { SList }
+  // Stmt →       if ( A ) { SList } else { SList }
+  // Stmt →       while ( A ) { SList }
+
+  Node *next = m_lexer->peek();
+  Node *next_next = m_lexer->peek(2);
+  if (!next || !next_next) {
+    SyntaxError::raise(m_lexer->get_current_loc(), "Unexpected end of input looking for statement");
+  }
+
+  if (next->get_tag() == TOK_VAR) {
+    expect_and_discard(TOK_VAR);
+    std::unique_ptr<Node> ident(expect(TOK_IDENTIFIER));
+    expect_and_discard(TOK_SEMICOLON);
+
+    std::string name = ident->get_str();
+    emit(BC_PUSH, 0);
+    if (m_scopes.size() == 2) {
+      // top-level variables are global (a redefinition reuses the slot)
+      auto i = m_scopes[1].find(name);
+      int slot = i != m_scopes[1].end() && i->second.kind == BINDING_GLOBAL ? i->second.index : m_code->add_global(name);
+      define(name, BINDING_GLOBAL, slot);
+      emit(BC_STORE_GLOBAL, slot);
+    } else {
+      int slot = int(m_state->next_local++);
+      m_state->fn->num_locals = std::max(m_state->fn->num_locals, m_state->next_local);
+      define(name, BINDING_LOCAL, slot);
+      emit(BC_STORE_LOCAL, slot);
+    }
+  } else if (next->get_tag() == TOK_WHILE) {
+    expect_and_discard(TOK_WHILE);
+
+    // ( A )
+    unsigned top = here();
+    expect_and_discard(TOK_LPAREN);
+    compile_A();
+    expect_and_discard(TOK_RPAREN);
+    unsigned exit_jump = emit(BC_JUMP_IF_FALSE);
+
+    // { SList }
+    expect_and_discard(TOK_LBRACE);
+    compile_SList();
+    expect_and_discard(TOK_RBRACE);
+    emit(BC_JUMP, int(top) - int(here()) - 1);
+    patch_jump(exit_jump);
+    emit(BC_PUSH, 0);
+  } else if (next->get_tag() == TOK_IF) {
+    expect_and_discard(TOK_IF);
+
+    // ( A )
+    expect_and_discard(TOK_LPAREN);
+    compile_A();
+    expect_and_discard(TOK_RPAREN);
+    unsigned else_jump = emit(BC_JUMP_IF_FALSE);
+
+    // { SList }
+    expect_and_discard(TOK_LBRACE);
+    compile_SList();
+    expect_and_discard(TOK_RBRACE);
+
+    Node *possible_else = m_lexer->peek();
+    if (possible_else && possible_else->get_tag() == TOK_ELSE) {
+      expect_and_discard(TOK_ELSE);
+      unsigned end_jump = emit(BC_JUMP);
+      patch_jump(else_jump);
+      expect_and_discard(TOK_LBRACE);
+      compile_SList();
+      expect_and_discard(TOK_RBRACE);
+      patch_jump(end_jump);
+    } else {
+      patch_jump(else_jump);
+    }
+    emit(BC_PUSH, 0);
+  } else {
+    compile_A();
+    expect_and_discard(TOK_SEMICOLON);
+  }
+  emit(BC_SET_RESULT);
+}
+
+void OnePassCompiler::compile_func() {
+  // Func →       function ident ( OptPList ) { SList }
+
+  expect_and_discard(TOK_FUNC);
+  std::unique_ptr<Node> ident(expect(TOK_IDENTIFIER));
+  expect_and_discard(TOK_LPAREN);
+
+  // OptPList →   PList
+  // OptPList →   ε
+  // PList →      ident
+  // PList →      ident , PList
+  std::vector<std::string> params;
+  Node *next = peek_or_error("Unexpected end of input looking for param list");
+  if (next->get_tag() != TOK_RPAREN) {
+    if (next->get_tag() != TOK_IDENTIFIER) SyntaxError::raise(m_lexer->get_current_loc(), "Expected identifier");
+    std::unique_ptr<Node> param(expect(TOK_IDENTIFIER));
+    params.push_back(param->get_str());
+    next = peek_or_error("Unexpected end of input parsing parameters");
+    while (next->get_tag() == TOK_COMMA) {
+      expect_and_discard(TOK_COMMA);
+      param.reset(expect(TOK_IDENTIFIER));
+      params.push_back(param->get_str());
+      next = peek_or_error("Unexpected end of input parsing parameters");
+    }
+  }
+  expect_and_discard(TOK_RPAREN);
+  expect_and_discard(TOK_LBRACE);
+
+  // bind the name before compiling the body, so recursive calls resolve;
+  // a redefinition rebinds the same slot when executed
+  std::string name = ident->get_str();
+  auto i = m_scopes[1].find(name);
+  int slot = i != m_scopes[1].end() && i->second.kind == BINDING_FUNC ? i->second.index : m_code->add_func_slot(name);
+  m_scopes[1][name] = { BINDING_FUNC, slot };
+
+  FnState state;
+  state.fn = new BytecodeFunction();
+  state.fn->name = name;
+  state.fn->num_params = unsigned(params.size());
+  state.fn->num_locals = unsigned(params.size());
+  state.next_local = unsigned(params.size());
+  int index = m_code->add_function(state.fn);
+
+  FnState *saved_state = m_state;
+  m_state = &state;
+  m_scopes.push_back(Scope());
+  for (unsigned j = 0; j < params.size(); j++) {
+    define(params[j], BINDING_LOCAL, int(j));
+  }
+  compile_SList();
+  expect_and_discard(TOK_RBRACE);
+  emit(BC_RET);
+  m_scopes.pop_back();
+  m_state = saved_state;
+
+  emit(BC_BIND_FUNC, slot, index);
+  emit(BC_PUSH, 0);
+  emit(BC_SET_RESULT);
+}
+
+void OnePassCompiler::compile_SList() {
+  // SList →      Stmt
+  // SList →      Stmt SList
+  unsigned saved_next_local = m_state->next_local;
+  enter_scope();
+  peek_or_error("Unexpected end of input looking for statement");
+  compile_Stmt();
+  Node *next = peek_or_error("Unexpected end of input after statement");
+  while (next->get_tag() != TOK_RBRACE) {
+    compile_Stmt();
+    next = peek_or_error("Unexpected end of input after statement");
+  }
+  leave_scope(saved_next_local);
+}
+
+void OnePassCompiler::compile_A() {
+  // A    → ^ ident = A
+  // A    → ^ L
+  Node *next = m_lexer->peek();
+  Node *next_next = m_lexer->peek(2);
+  if (!next || !next_next) {
+    SyntaxError::raise(m_lexer->get_current_loc(), "Unexpected end of input looking for statement");
+  }
+
+  if (next->get_tag() == TOK_IDENTIFIER && next_next->get_tag() == TOK_EQUAL) {
+    std::unique_ptr<Node> ident(expect(TOK_IDENTIFIER));
+    // resolve the target first, as semantic analysis of the AST does
+    Binding target = lookup(ident.get());
+    expect_and_discard(TOK_EQUAL);
+    compile_A();
+    if (target.kind == BINDING_LOCAL) {
+      emit(BC_STORE_LOCAL, target.index);
+    } else if (target.kind == BINDING_GLOBAL) {
+      emit(BC_STORE_GLOBAL, target.index);
+    } else {
+      RuntimeError::raise("Single-pass compiler does not support assignment to function '%s'", ident->get_str().c_str());
+    }
+    return;
+  }
+  compile_L();
+}
+
+void OnePassCompiler::compile_L() {
+  // L    → ^ R || R
+  // L    → ^ R && R
+  // L    → ^ R
+  compile_R();
+  Node *next = m_lexer->peek();
+  if (next && (next->get_tag() == TOK_OR || next->get_tag() == TOK_AND)) {
+    bool is_or = next->get_tag() == TOK_OR;
+    expect_and_discard(static_cast<enum TokenKind>(next->get_tag()));
+    // short circuit: the right operand is skipped if the left decides the result
+    unsigned short_jump = emit(is_or ? BC_JUMP_IF_TRUE : BC_JUMP_IF_FALSE);
+    compile_R();
+    emit(BC_TRUTH);
+    unsigned end_jump = emit(BC_JUMP);
+    patch_jump(short_jump);
+    emit(BC_PUSH, is_or ? 1 : 0);
+    patch_jump(end_jump);
+  }
+}
+
+void OnePassCompiler::compile_R() {
+  // R    → E < E
+  // R    → E <= E
+  // R    → E > E
+  // R    → E >= E
+  // R    → E == E
+  // R    → E != E
+  // R    → E
+  compile_E();
+  Node *next = m_lexer->peek();
+  if (!next) {
+    return;
+  }
+  BytecodeOp op;
+  switch (next->get_tag()) {
+    case TOK_LESSER:        op = BC_LT; break;
+    case TOK_LESSER_EQUAL:  op = BC_LE; break;
+    case TOK_GREATER:       op = BC_GT; break;
+    case TOK_GREATER_EQUAL: op = BC_GE; break;
+    case TOK_EQUAL_EQUAL:   op = BC_EQ; break;
+    case TOK_NOT_EQUAL:     op = BC_NE; break;
+    default:
+      return;
+  }
+  expect_and_discard(static_cast<enum TokenKind>(next->get_tag()));
+  compile_E();
+  emit(op);
+}
+
+void OnePassCompiler::compile_E() {
+  // E -> ^ T E'
+  compile_T();
+  compile_EPrime();
+}
+
+void OnePassCompiler::compile_EPrime() {
+  // E' -> ^ + T E'
+  // E' -> ^ - T E'
+  // E' -> ^ epsilon
+  for (;;) {
+    Node *next_tok = m_lexer->peek();
+    if (next_tok == nullptr || (next_tok->get_tag() != TOK_PLUS && next_tok->get_tag() != TOK_MINUS)) {
+      return;
+    }
+    bool is_plus = next_tok->get_tag() == TOK_PLUS;
+    expect_and_discard(static_cast<enum TokenKind>(next_tok->get_tag()));
+    compile_T();
+    emit(is_plus ? BC_ADD : BC_SUB);
+  }
+}
+
+void OnePassCompiler::compile_T() {
+  // T -> F T'
+  unsigned left_start = here();
+  compile_F();
+  compile_TPrime(left_start);
+}
+
+void OnePassCompiler::compile_TPrime(unsigned left_start) {
+  // T' -> ^ * F T'
+  // T' -> ^ / F T'
+  // T' -> ^ epsilon
+  for (;;) {
+    Node *next_tok = m_lexer->peek();
+    if (next_tok == nullptr || (next_tok->get_tag() != TOK_TIMES && next_tok->get_tag() != TOK_DIVIDE)) {
+      return;
+    }
+    std::unique_ptr<Node> op(expect(static_cast<enum TokenKind>(next_tok->get_tag())));
+    if (op->get_tag() == TOK_TIMES) {
+      compile_F();
+      emit(BC_MUL);
+      continue;
+    }
+
+    // The interpreter evaluates and checks the denominator before
+    // evaluating the numerator, so the denominator's code is moved
+    // in front of the numerator's (jumps are relative, so both
+    // sequences remain valid).
+    unsigned mid = here();
+    compile_F();
+    std::vector<BytecodeInstr> &code = m_state->fn->code;
+    std::rotate(code.begin() + left_start, code.begin() + mid, code.end());
+    BytecodeInstr check = { BC_CHKZERO, 0, m_code->add_location(op->get_loc()), 0 };
+    code.insert(code.begin() + left_start + (here() - mid), check);
+    emit(BC_DIVR);
+  }
+}
+
+void OnePassCompiler::compile_F() {
+  // F -> ^ number
+  // F -> ^ ident
+  // F -> ^ ( A )
+  // F →          ident ( OptArgList )
+  Node *next = m_lexer->peek();
+  Node *next_next = m_lexer->peek(2);
+  if (!next || !next_next) {
+    SyntaxError::raise(m_lexer->get_current_loc(), "Unexpected end of input looking for primary expression");
+  }
+
+  int next_tag = next->get_tag();
+  if (next_tag == TOK_IDENTIFIER && next_next->get_tag() == TOK_LPAREN) {
+    std::unique_ptr<Node> ident(expect(TOK_IDENTIFIER));
+    Binding callee = lookup(ident.get());
+    if (callee.kind != BINDING_FUNC && callee.kind != BINDING_INTRINSIC) {
+      RuntimeError::raise("%s not function", ident->get_str().c_str());
+    }
+    expect_and_discard(TOK_LPAREN);
+    unsigned num_args = compile_OptArgList();
+    expect_and_discard(TOK_RPAREN);
+    emit(callee.kind == BINDING_FUNC ? BC_CALL : BC_CALLI, callee.index, int(num_args), m_code->add_location(ident->get_loc()));
+  } else if (next_tag == TOK_INTEGER_LITERAL) {
+    std::unique_ptr<Node> tok(expect(TOK_INTEGER_LITERAL));
+    emit(BC_PUSH, std::stoi(tok->get_str()));
+  } else if (next_tag == TOK_IDENTIFIER) {
+    std::unique_ptr<Node> ident(expect(TOK_IDENTIFIER));
+    const Binding &b = lookup(ident.get());
+    if (b.kind == BINDING_LOCAL) {
+      emit(BC_LOAD_LOCAL, b.index);
+    } else if (b.kind == BINDING_GLOBAL) {
+      emit(BC_LOAD_GLOBAL, b.index);
+    } else {
+      RuntimeError::raise("Single-pass compiler does not support function '%s' used as a value", ident->get_str().c_str());
+    }
+  } else if (next_tag == TOK_LPAREN) {
+    expect_and_discard(TOK_LPAREN);
+    compile_A();
+    expect_and_discard(TOK_RPAREN);
+  } else {
+    SyntaxError::raise(next->get_loc(), "Invalid primary expression");
+  }
+}
+
+unsigned OnePassCompiler::compile_OptArgList() {
+  // OptArgList → ArgList
+  // OptArgList → ε
+  // ArgList →    L
+  // ArgList →    L , ArgList
+  Node *next = peek_or_error("Unexpected end of input looking for argument list");
+  if (next->get_tag() == TOK_RPAREN) {
+    return 0;
+  }
+  peek_or_error("Unexpected end of input looking for argument");
+  compile_L();
+  unsigned num_args = 1;
+  next = peek_or_error("Unexpected end of input after argument");
+  while (next->get_tag() == TOK_COMMA) {
+    expect_and_discard(TOK_COMMA);
+    compile_L();
+    num_args++;
+    next = peek_or_error("Unexpected end of input after argument");
+  }
+  return num_args;
+}
+
+const OnePassCompiler::Binding &OnePassCompiler::lookup(Node *ident) {
+  const std::string &name = ident->get_str();
+  for (auto i = m_scopes.rbegin(); i != m_scopes.rend(); ++i) {
+    auto j = i->find(name);
+    if (j != i->end()) {
+      return j->second;
+    }
+  }
+  SemanticError::raise(ident->get_loc(), "Undefined variable %s", name.c_str());
+}
+
+void OnePassCompiler::define(const std::string &name, BindingKind kind, int index) {
+  m_scopes.back()[name] = { kind, index };
+}
+
+void OnePassCompiler::enter_scope() {
+  m_scopes.push_back(Scope());
+}
+
+void OnePassCompiler::leave_scope(unsigned saved_next_local) {
+  m_scopes.pop_back();
+  // slots of the block's variables can be reused
+  m_state->next_local = saved_next_local;
+}
+
+unsigned OnePassCompiler::emit(BytecodeOp op, int a, int b, int c) {
+  m_state->fn->code.push_back({ op, a, b, c });
+  return unsigned(m_state->fn->code.size()) - 1;
+}
+
+unsigned OnePassCompiler::here() const {
+  return unsigned(m_state->fn->code.size());
+}
+
+// make the jump at jump_pc branch to the next instruction emitted
+void OnePassCompiler::patch_jump(unsigned jump_pc) {
+  m_state->fn->code[jump_pc].a = int(here()) - int(jump_pc) - 1;
+}
+
+Node *OnePassCompiler::expect(enum TokenKind tok_kind) {
+  std::unique_ptr<Node> next_terminal(m_lexer->next());
+  if (next_terminal->get_tag() != tok_kind) {
+    SyntaxError::raise(next_terminal->get_loc(), "Unexpected token '%s'", next_terminal->get_str().c_str());
+  }
+  return next_terminal.release();
+}
+
+void OnePassCompiler::expect_and_discard(enum TokenKind tok_kind) {
+  Node *tok = expect(tok_kind);
+  delete tok;
+}
+
+Node *OnePassCompiler::peek_or_error(const char *what, int how_far) {
+  Node *next = m_lexer->peek(how_far);
+  if (!next) {
+    SyntaxError::raise(m_lexer->get_current_loc(), "%s", what);
+  }
+  return next;
+}
@@ -0,0 +1,86 @@
+#ifndef ONEPASS_H
+#define ONEPASS_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "lexer.h"
+#include "bytecode.h"
+
+// Single-pass compiler: parses the same grammar as Parser2, but
+// instead of building an AST it resolves names and emits Bytecode
+// directly as each construct is recognized. Reports the same
+// syntax errors as Parser2, and undefined variables (as
+// SemanticErrors) as Interpreter::analyze does.
+class OnePassCompiler {
+private:
+  enum BindingKind {
+    BINDING_LOCAL,
+    BINDING_GLOBAL,
+    BINDING_FUNC,
+    BINDING_INTRINSIC,
+  };
+
+  struct Binding {
+    BindingKind kind;
+    int index;  // local slot, global slot, function slot, or intrinsic
+  };
+
+  typedef std::unordered_map<std::string, Binding> Scope;
+
+  // state of the function currently being compiled
+  struct FnState {
+    BytecodeFunction *fn;
+    unsigned next_local;
+  };
+
+  Lexer *m_lexer;
+  Bytecode *m_code;
+  FnState *m_state;
+  std::vector<Scope> m_scopes;
+
+  // value semantics prohibited
+  OnePassCompiler(const OnePassCompiler &);
+  OnePassCompiler &operator=(const OnePassCompiler &);
+
+public:
+  OnePassCompiler(Lexer *lexer_to_adopt);
+  ~OnePassCompiler();
+
+  // compile the entire input; the caller takes ownership of the result
+  Bytecode *compile();
+
+private:
+  // Compile functions for nonterminal grammar symbols
+  void compile_Unit();
+  void compile_TStmt();
+  void compile_Stmt();
+  void compile_func();
+  void compile_SList();
+  void compile_A();
+  void compile_L();
+  void compile_R();
+  void compile_E();
+  void compile_EPrime();
+  void compile_T();
+  void compile_TPrime(unsigned left_start);
+  void compile_F();
+  unsigned compile_OptArgList();
+
+  // name resolution
+  const Binding &lookup(Node *ident);
+  void define(const std::string &name, BindingKind kind, int index);
+  void enter_scope();
+  void leave_scope(unsigned saved_next_local);
+
+  // code emission
+  unsigned emit(BytecodeOp op, int a = 0, int b = 0, int c = 0);
+  unsigned here() const;
+  void patch_jump(unsigned jump_pc);
+
+  Node *expect(enum TokenKind tok_kind);
+  void expect_and_discard(enum TokenKind tok_kind);
+  Node *peek_or_error(const char *what, int how_far = 1);
+};
+
+#endif // ONEPASS_H
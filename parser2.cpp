@@ -2,10 +2,12 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <cstdio>
 #include "token.h"
 #include "ast.h"
 #include "exceptions.h"
 #include "parser2.h"
+#include "memstats.h"
 #include <iostream>
 
 ////////////////////////////////////////////////////////////////////////
@@ -65,7 +67,9 @@
 
 Parser2::Parser2(Lexer *lexer_to_adopt)
   : m_lexer(lexer_to_adopt)
-  , m_next(nullptr) {
+  , m_next(nullptr)
+  , m_started(false)
+  , m_lazy_functions(false) {
 }
 
 Parser2::~Parser2() {
@@ -73,9 +77,19 @@ Parser2::~Parser2() {
 }
 
 Node *Parser2::parse() {
+  MemoryScope scope(MEM_AST);
   return parse_Unit();
 }
 
+Node *Parser2::parse_next() {
+  MemoryScope scope(MEM_AST);
+  if (m_started && m_lexer->peek() == nullptr) {
+    return nullptr;
+  }
+  m_started = true;
+  return parse_TStmt();
+}
+
 Node *Parser2::parse_Unit() {
   // note that this function produces a "flattened" representation
   // of the unit
@@ -223,11 +237,62 @@ Node *Parser2::parse_func() {
 
   // { SList }
   expect_and_discard(TOK_LBRACE);
+  if (m_lazy_functions) {
+    // the closing brace is consumed as part of the body's tokens
+    function_def->append_kid(skip_SList());
+    return function_def.release();
+  }
   function_def->append_kid(parse_SList());
   expect_and_discard(TOK_RBRACE);
   return function_def.release();
 }
 
+Node *Parser2::skip_SList() {
+  // keep the source text through the brace matching the (already
+  // consumed) opening brace; it is scanned again when first called
+  std::unique_ptr<Node> lazy_body(new Node(AST_LAZY_STMTS));
+  lazy_body->set_loc(m_lexer->get_current_loc());
+  std::string text;
+  if (!m_lexer->skip_block(text)) {
+    // unterminated body: parse it now, which reports the error an
+    // eager parse would
+    lazy_body->set_str(text);
+    delete parse_lazy_body(lazy_body.get());
+    error_at_current_loc("Unexpected end of input after statement");
+  }
+  lazy_body->set_str(text);
+
+  Node *after = m_lexer->peek();
+  if (after) {
+    Node *copy = new Node(after->get_tag(), after->get_str());
+    copy->set_loc(after->get_loc());
+    lazy_body->append_kid(copy);
+  }
+  return lazy_body.release();
+}
+
+Node *Parser2::parse_lazy_body(Node *lazy_body) {
+  assert(lazy_body->get_tag() == AST_LAZY_STMTS);
+  MemoryScope scope(MEM_AST);
+  const std::string &text = lazy_body->get_str();
+  FILE *in = fmemopen(const_cast<char *>(text.data()), text.size(), "r");
+  if (!in) {
+    RuntimeError::raise("fmemopen failed");
+  }
+  Node *after = nullptr;
+  if (lazy_body->get_num_kids() > 0) {
+    Node *tok = lazy_body->get_kid(0);
+    MemoryScope token_scope(MEM_TOKENS);
+    after = new Node(tok->get_tag(), tok->get_str());
+    after->set_loc(tok->get_loc());
+  }
+
+  Parser2 parser(new Lexer(in, lazy_body->get_loc(), after));
+  std::unique_ptr<Node> body(parser.parse_SList());
+  parser.expect_and_discard(TOK_RBRACE);
+  return body.release();
+}
+
 Node *Parser2::parse_PList() {
   // PList →      ident                            -- nonempty param list
   // PList →      ident , PList
@@ -8,6 +8,8 @@ class Parser2 {
 private:
   Lexer *m_lexer;
   Node *m_next;
+  bool m_started;
+  bool m_lazy_functions;
 
 public:
   Parser2(Lexer *lexer_to_adopt);
@@ -15,6 +17,23 @@ public:
 
   Node *parse();
 
+  // Parse one top-level statement (TStmt), for callers that process
+  // the unit incrementally. Returns nullptr once the input is
+  // exhausted; as with parse(), an empty unit is a syntax error.
+  Node *parse_next();
+
+  // In lazy mode, function bodies are only brace-matched: the body
+  // of each AST_FUNC is an AST_LAZY_STMTS node holding its source
+  // text through the closing brace, located at its start, with a
+  // copy of the token after it as its kid (so that lookahead sees
+  // what an eager parse would). Syntax errors in a body are reported
+  // when it is scanned and parsed by parse_lazy_body.
+  void set_lazy_functions(bool lazy) { m_lazy_functions = lazy; }
+
+  // Parse the body held by an AST_LAZY_STMTS node, returning the
+  // AST_STMTS node an eager parse would have produced.
+  static Node *parse_lazy_body(Node *lazy_body);
+
 private:
   // Parse functions for nonterminal grammar symbols
   Node *parse_Unit();
@@ -34,6 +53,7 @@ private:
   Node *parse_OptPList();
   Node *parse_OptArgList();
   Node *parse_PList();
+  Node *skip_SList();
 
   // Consume a specific token, wrapping it in a Node
   Node *expect(enum TokenKind tok_kind);
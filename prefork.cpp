@@ -0,0 +1,201 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include "cpputil.h"
+#include "exceptions.h"
+#include "protocol.h"
+#include "prefork.h"
+
+////////////////////////////////////////////////////////////////////////
+// PreforkPool implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double ms_between(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::string describe_exit(int status) {
+  if (WIFSIGNALED(status)) {
+    return cpputil::format("Error: worker process killed by signal %d (%s)", WTERMSIG(status), strsignal(WTERMSIG(status)));
+  }
+  return cpputil::format("Error: worker process exited with status %d", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+
+}
+
+PreforkPool::PreforkPool(unsigned num_workers, Handler handler)
+  : m_handler(handler)
+  , m_workers(num_workers > 0 ? num_workers : 1)
+  , m_restarts(0) {
+  // a worker dying must not kill the parent when it writes to the pipe
+  signal(SIGPIPE, SIG_IGN);
+  for (auto i = m_workers.begin(); i != m_workers.end(); ++i) {
+    i->pid = -1;
+    i->to_worker = i->from_worker = -1;
+    i->job = -1;
+  }
+  for (auto i = m_workers.begin(); i != m_workers.end(); ++i) {
+    start_worker(*i);
+  }
+}
+
+PreforkPool::~PreforkPool() {
+  for (auto i = m_workers.begin(); i != m_workers.end(); ++i) {
+    stop_worker(*i, false);
+  }
+}
+
+void PreforkPool::run(unsigned num_jobs, unsigned timeout_ms, std::vector<std::string> &errors, std::vector<double> &wall_ms) {
+  errors.assign(num_jobs, std::string());
+  wall_ms.assign(num_jobs, 0.0);
+  std::vector<Clock::time_point> started(num_jobs);
+  unsigned next_job = 0, busy = 0;
+
+  while (next_job < num_jobs || busy > 0) {
+    // hand out jobs to idle workers
+    for (auto i = m_workers.begin(); i != m_workers.end() && next_job < num_jobs; ++i) {
+      if (i->job >= 0) continue;
+      DaemonRequest req;
+      req.op = DAEMON_RUN;
+      req.timeout_ms = timeout_ms;
+      req.hash = next_job;
+      started[next_job] = Clock::now();
+      if (!send_request(i->to_worker, req)) {
+        // died while idle: replace it and try again on the next pass
+        stop_worker(*i, true);
+        start_worker(*i);
+        m_restarts++;
+        continue;
+      }
+      i->job = int(next_job++);
+      busy++;
+    }
+
+    // wait for a reply, or for the earliest deadline
+    std::vector<struct pollfd> fds;
+    std::vector<Worker *> polled;
+    int wait_ms = -1;
+    Clock::time_point now = Clock::now();
+    for (auto i = m_workers.begin(); i != m_workers.end(); ++i) {
+      if (i->job < 0) continue;
+      fds.push_back({ i->from_worker, POLLIN, 0 });
+      polled.push_back(&*i);
+      if (timeout_ms > 0) {
+        double left = timeout_ms - ms_between(started[i->job], now);
+        int left_ms = left > 0.0 ? int(left) + 1 : 0;
+        if (wait_ms < 0 || left_ms < wait_ms) {
+          wait_ms = left_ms;
+        }
+      }
+    }
+    if (fds.empty()) continue;
+    if (poll(&fds[0], fds.size(), wait_ms) < 0 && errno != EINTR) {
+      RuntimeError::raise("poll failed: %s", strerror(errno));
+    }
+
+    now = Clock::now();
+    for (unsigned k = 0; k < fds.size(); k++) {
+      Worker &w = *polled[k];
+      unsigned job = unsigned(w.job);
+      if (fds[k].revents != 0) {
+        DaemonResponse resp;
+        if (recv_response(w.from_worker, resp)) {
+          errors[job] = resp.error;
+        } else {
+          // crashed: report how, and replace it
+          int status = 0;
+          close(w.to_worker);
+          close(w.from_worker);
+          waitpid(w.pid, &status, 0);
+          w.pid = -1;
+          errors[job] = describe_exit(status);
+          start_worker(w);
+          m_restarts++;
+        }
+      } else if (timeout_ms > 0 && ms_between(started[job], now) >= timeout_ms) {
+        errors[job] = "Error: Time limit exceeded";
+        stop_worker(w, true);
+        start_worker(w);
+        m_restarts++;
+      } else {
+        continue;
+      }
+      wall_ms[job] = ms_between(started[job], now);
+      w.job = -1;
+      busy--;
+    }
+  }
+}
+
+void PreforkPool::start_worker(Worker &w) {
+  int to_worker[2], from_worker[2];
+  if (pipe(to_worker) != 0 || pipe(from_worker) != 0) {
+    RuntimeError::raise("Could not create pipe: %s", strerror(errno));
+  }
+  // buffered output would otherwise be written by both processes
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid < 0) {
+    RuntimeError::raise("Could not fork worker: %s", strerror(errno));
+  }
+  if (pid == 0) {
+    // the worker must not hold other workers' pipes open, or the
+    // parent would not see them close when those workers die
+    for (auto i = m_workers.begin(); i != m_workers.end(); ++i) {
+      if (i->pid > 0) {
+        close(i->to_worker);
+        close(i->from_worker);
+      }
+    }
+    close(to_worker[1]);
+    close(from_worker[0]);
+    worker_loop(to_worker[0], from_worker[1]);
+    _exit(0);
+  }
+  close(to_worker[0]);
+  close(from_worker[1]);
+  w.pid = pid;
+  w.to_worker = to_worker[1];
+  w.from_worker = from_worker[0];
+  w.job = -1;
+}
+
+void PreforkPool::stop_worker(Worker &w, bool kill_it) {
+  if (w.pid <= 0) return;
+  if (kill_it) {
+    kill(w.pid, SIGKILL);
+  }
+  // closing the request pipe makes an idle worker exit
+  close(w.to_worker);
+  close(w.from_worker);
+  waitpid(w.pid, nullptr, 0);
+  w.pid = -1;
+  w.job = -1;
+}
+
+void PreforkPool::worker_loop(int in_fd, int out_fd) {
+  DaemonRequest req;
+  while (recv_request(in_fd, req)) {
+    DaemonResponse resp;
+    resp.hash = req.hash;
+    try {
+      resp.error = m_handler(unsigned(req.hash));
+    } catch (BaseException &ex) {
+      resp.error = ex.get_message();
+    }
+    resp.status = resp.error.empty() ? DAEMON_OK : DAEMON_ERROR;
+    if (!send_response(out_fd, resp)) {
+      break;
+    }
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef PREFORK_H
+#define PREFORK_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/types.h>
+
+// Pool of forked worker processes. The workers are forked when the
+// pool is created, so they share (copy-on-write) everything the parent
+// has built by then, such as compiled programs. Jobs are numbered;
+// the parent sends each job number to an idle worker over a pipe
+// (using the daemon protocol, protocol.h) and the worker calls the
+// handler and replies with its error message. A worker that crashes,
+// or whose job runs past the time limit (in which case it is killed),
+// fails its job and is replaced by a fresh fork.
+class PreforkPool {
+public:
+  // runs job number i in a worker, returning an error message ("" if ok)
+  typedef std::function<std::string(unsigned)> Handler;
+
+private:
+  struct Worker {
+    pid_t pid;
+    int to_worker, from_worker;  // pipe ends held by the parent
+    int job;                     // -1 if idle
+  };
+
+  Handler m_handler;
+  std::vector<Worker> m_workers;
+  unsigned m_restarts;
+
+  // value semantics prohibited
+  PreforkPool(const PreforkPool &);
+  PreforkPool &operator=(const PreforkPool &);
+
+public:
+  PreforkPool(unsigned num_workers, Handler handler);
+  ~PreforkPool();
+
+  // Run jobs 0..num_jobs-1, with a time limit per job (0 for none),
+  // filling in each job's error and wall time as seen by the parent.
+  void run(unsigned num_jobs, unsigned timeout_ms, std::vector<std::string> &errors, std::vector<double> &wall_ms);
+
+  unsigned get_num_workers() const { return unsigned(m_workers.size()); }
+  unsigned get_restarts() const { return m_restarts; }
+
+private:
+  void start_worker(Worker &w);
+  void stop_worker(Worker &w, bool kill_it);
+  void worker_loop(int in_fd, int out_fd);
+};
+
+#endif // PREFORK_H
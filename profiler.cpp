@@ -0,0 +1,205 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <ctime>
+#include <sys/time.h>
+#include "ast.h"
+#include "node.h"
+#include "cpputil.h"
+#include "exceptions.h"
+#include "profiler.h"
+
+////////////////////////////////////////////////////////////////////////
+// Profiler implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// frames buffer: room for samples averaging this deep
+const unsigned AVERAGE_SAMPLE_DEPTH = 32;
+
+// entries shown in each section of the report
+const unsigned REPORT_ENTRIES = 15;
+
+const char *const TOP_LEVEL = "<top level>";
+
+double process_cpu_secs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+std::string function_name(const Node *call) {
+  return call->get_kid(0)->get_str();
+}
+
+// print the largest counts first
+void print_top(FILE *out, const char *title, const std::unordered_map<std::string, unsigned> &counts, unsigned total) {
+  std::vector<std::pair<std::string, unsigned>> sorted(counts.begin(), counts.end());
+  std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, unsigned> &a, const std::pair<std::string, unsigned> &b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+  });
+  fprintf(out, "%s:\n", title);
+  for (unsigned i = 0; i < sorted.size() && i < REPORT_ENTRIES; i++) {
+    fprintf(out, "  %6.2f%%  %7u  %s\n", 100.0 * sorted[i].second / total, sorted[i].second, sorted[i].first.c_str());
+  }
+}
+
+}
+
+std::atomic<Profiler *> Profiler::s_active(nullptr);
+
+Profiler::Profiler(unsigned interval_us)
+  : m_interval_us(interval_us)
+  , m_cpu_start(0.0)
+  , m_cpu_secs(0.0)
+  , m_current(nullptr)
+  , m_depth(0)
+  , m_samples(new Sample[MAX_SAMPLES])
+  // not initialized: pages are only touched as samples fill them
+  , m_frames(new const Node *[MAX_SAMPLES * AVERAGE_SAMPLE_DEPTH])
+  , m_num_samples(0)
+  , m_num_frames(0)
+  , m_dropped(0)
+  , m_running(false) {
+  for (unsigned i = 0; i < STACK_RING_SIZE; i++) {
+    m_stack[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+Profiler::~Profiler() {
+  stop();
+}
+
+void Profiler::start() {
+  Profiler *expected = nullptr;
+  if (!s_active.compare_exchange_strong(expected, this)) {
+    RuntimeError::raise("Only one profiler can run at a time");
+  }
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = &handle_sigprof;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGPROF, &sa, nullptr);
+
+  struct itimerval timer;
+  timer.it_interval.tv_sec = m_interval_us / 1000000;
+  timer.it_interval.tv_usec = m_interval_us % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    s_active.store(nullptr);
+    RuntimeError::raise("setitimer failed: %s", strerror(errno));
+  }
+  m_cpu_start = process_cpu_secs();
+  m_running = true;
+}
+
+void Profiler::stop() {
+  if (!m_running) {
+    return;
+  }
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  // a signal already pending is ignored
+  signal(SIGPROF, SIG_IGN);
+  s_active.store(nullptr);
+  m_cpu_secs += process_cpu_secs() - m_cpu_start;
+  m_running = false;
+}
+
+void Profiler::handle_sigprof(int) {
+  Profiler *profiler = s_active.load(std::memory_order_acquire);
+  if (profiler != nullptr) {
+    profiler->take_sample();
+  }
+}
+
+// Runs in the signal handler: only copies into the preallocated buffers.
+void Profiler::take_sample() {
+  unsigned index = m_num_samples.load(std::memory_order_relaxed);
+  unsigned depth = m_depth.load(std::memory_order_acquire);
+  unsigned kept = depth < MAX_SAMPLE_DEPTH ? depth : MAX_SAMPLE_DEPTH;
+  unsigned first = m_num_frames.load(std::memory_order_relaxed);
+  if (index >= MAX_SAMPLES || first + kept > MAX_SAMPLES * AVERAGE_SAMPLE_DEPTH) {
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Sample &sample = m_samples[index];
+  sample.node = m_current.load(std::memory_order_relaxed);
+  sample.first_frame = first;
+  sample.depth = kept;
+  sample.truncated = kept < depth;
+  for (unsigned i = 0; i < kept; i++) {
+    m_frames[first + i] = m_stack[(depth - kept + i) % STACK_RING_SIZE].load(std::memory_order_relaxed);
+  }
+  m_num_frames.store(first + kept, std::memory_order_relaxed);
+  m_num_samples.store(index + 1, std::memory_order_relaxed);
+}
+
+void Profiler::finish(FILE *out, const char *folded_path) {
+  stop();
+  unsigned num_samples = m_num_samples.load();
+  ASTTreePrint tag_names;
+
+  std::unordered_map<std::string, unsigned> lines, nodes, self, total;
+  std::map<std::string, unsigned> folded;
+  for (unsigned i = 0; i < num_samples; i++) {
+    const Sample &sample = m_samples[i];
+    const Node *const *frames = &m_frames[sample.first_frame];
+
+    if (sample.node != nullptr) {
+      const Location &loc = sample.node->get_loc();
+      std::string line = cpputil::format("%s:%d", loc.get_srcfile().c_str(), loc.get_line());
+      lines[line]++;
+      nodes[cpputil::format("%s:%d:%d %s", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col(),
+                            tag_names.node_tag_to_string(sample.node->get_tag()).c_str())]++;
+    }
+
+    self[sample.depth > 0 ? function_name(frames[sample.depth - 1]) : TOP_LEVEL]++;
+    std::unordered_set<std::string> seen = { TOP_LEVEL };
+    std::string stack = sample.truncated ? "..." : TOP_LEVEL;
+    for (unsigned j = 0; j < sample.depth; j++) {
+      std::string name = function_name(frames[j]);
+      seen.insert(name);
+      stack += ";" + name;
+    }
+    for (auto j = seen.begin(); j != seen.end(); ++j) {
+      total[*j]++;
+    }
+    folded[stack]++;
+  }
+
+  unsigned dropped = m_dropped.load();
+  // the kernel may round the interval up to its timer tick
+  fprintf(out, "Profile: %u samples in %.3f s of CPU time (interval %u us requested)", num_samples, m_cpu_secs,
+          m_interval_us);
+  if (dropped > 0) {
+    fprintf(out, ", %u dropped (buffer full)", dropped);
+  }
+  fprintf(out, "\n");
+  if (num_samples > 0) {
+    print_top(out, "Hot lines", lines, num_samples);
+    print_top(out, "Hot nodes", nodes, num_samples);
+    print_top(out, "Functions (self)", self, num_samples);
+    print_top(out, "Functions (total)", total, num_samples);
+  }
+
+  if (folded_path != nullptr) {
+    FILE *f = fopen(folded_path, "w");
+    if (!f) {
+      RuntimeError::raise("Could not write profile to '%s'", folded_path);
+    }
+    for (auto i = folded.begin(); i != folded.end(); ++i) {
+      fprintf(f, "%s %u\n", i->first.c_str(), i->second);
+    }
+    fclose(f);
+  }
+}
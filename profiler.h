@@ -0,0 +1,80 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdio>
+#include <atomic>
+#include <memory>
+class Node;
+
+// Sampling profiler for the tree-walking interpreter. While it is
+// running, the Interpreter records the node it is executing and keeps
+// a shadow stack of the call sites (AST_FUNC_CALL nodes) of the active
+// user function calls. A SIGPROF timer (setitimer(ITIMER_PROF), so
+// samples are taken in proportion to CPU time) copies both into
+// preallocated buffers; everything else happens in finish(), after the
+// run, which reports the hottest source lines, AST nodes, and
+// functions, and writes folded stacks for flame graph tools
+// ("<top level>;f;g 12" per line). Functions are named by their call
+// sites, so the AST must still exist when finish() is called.
+class Profiler {
+public:
+  // deepest frames kept per sample (the innermost ones)
+  static const unsigned MAX_SAMPLE_DEPTH = 128;
+  static const unsigned MAX_SAMPLES = 1u << 17;
+
+private:
+  // the shadow stack is a ring, so that the innermost frames are
+  // available however deep the recursion goes
+  static const unsigned STACK_RING_SIZE = 1024;
+
+  struct Sample {
+    const Node *node;
+    unsigned first_frame;      // index into m_frames
+    unsigned depth;            // number of frames recorded
+    bool truncated;
+  };
+
+  unsigned m_interval_us;
+  double m_cpu_start, m_cpu_secs;   // process CPU time while running
+  std::atomic<const Node *> m_current;
+  std::atomic<unsigned> m_depth;
+  std::atomic<const Node *> m_stack[STACK_RING_SIZE];
+
+  std::unique_ptr<Sample[]> m_samples;
+  std::unique_ptr<const Node *[]> m_frames;
+  std::atomic<unsigned> m_num_samples, m_num_frames, m_dropped;
+  bool m_running;
+
+  static std::atomic<Profiler *> s_active;
+
+  // value semantics prohibited
+  Profiler(const Profiler &);
+  Profiler &operator=(const Profiler &);
+
+public:
+  Profiler(unsigned interval_us = 1000);
+  ~Profiler();
+
+  void start();
+  void stop();
+
+  // stop, print the report to out, and write folded stacks to
+  // folded_path (if not null)
+  void finish(FILE *out, const char *folded_path);
+
+  // called by the Interpreter, from one thread (so plain loads and
+  // stores suffice: the signal handler only needs to see them in order)
+  void enter_node(const Node *node) { m_current.store(node, std::memory_order_relaxed); }
+  void push_call(const Node *call) {
+    unsigned depth = m_depth.load(std::memory_order_relaxed);
+    m_stack[depth % STACK_RING_SIZE].store(call, std::memory_order_relaxed);
+    m_depth.store(depth + 1, std::memory_order_release);
+  }
+  void pop_call() { m_depth.store(m_depth.load(std::memory_order_relaxed) - 1, std::memory_order_release); }
+
+private:
+  static void handle_sigprof(int sig);
+  void take_sample();
+};
+
+#endif // PROFILER_H
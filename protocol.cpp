@@ -0,0 +1,83 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "protocol.h"
+
+namespace {
+
+struct Header {
+  uint32_t code;           // op or status
+  uint32_t timeout_ms;
+  uint64_t hash;
+  uint32_t len1, len2;     // lengths of the two strings that follow
+};
+
+// refuse absurd lengths rather than trying to allocate them
+const uint32_t MAX_STRING = 256u << 20;
+
+bool write_all(int fd, const void *buf, size_t len) {
+  const char *p = static_cast<const char *>(buf);
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+bool read_all(int fd, void *buf, size_t len) {
+  char *p = static_cast<char *>(buf);
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+bool send_message(int fd, uint32_t code, uint32_t timeout_ms, uint64_t hash, const std::string &s1, const std::string &s2) {
+  Header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.code = code;
+  hdr.timeout_ms = timeout_ms;
+  hdr.hash = hash;
+  hdr.len1 = uint32_t(s1.size());
+  hdr.len2 = uint32_t(s2.size());
+  return write_all(fd, &hdr, sizeof(hdr)) && write_all(fd, s1.data(), s1.size()) && write_all(fd, s2.data(), s2.size());
+}
+
+bool recv_message(int fd, uint32_t &code, uint32_t &timeout_ms, uint64_t &hash, std::string &s1, std::string &s2) {
+  Header hdr;
+  if (!read_all(fd, &hdr, sizeof(hdr)) || hdr.len1 > MAX_STRING || hdr.len2 > MAX_STRING) {
+    return false;
+  }
+  code = hdr.code;
+  timeout_ms = hdr.timeout_ms;
+  hash = hdr.hash;
+  s1.resize(hdr.len1);
+  s2.resize(hdr.len2);
+  return read_all(fd, &s1[0], hdr.len1) && read_all(fd, &s2[0], hdr.len2);
+}
+
+}
+
+bool send_request(int fd, const DaemonRequest &req) {
+  return send_message(fd, req.op, req.timeout_ms, req.hash, req.source, req.input);
+}
+
+bool recv_request(int fd, DaemonRequest &req) {
+  return recv_message(fd, req.op, req.timeout_ms, req.hash, req.source, req.input);
+}
+
+bool send_response(int fd, const DaemonResponse &resp) {
+  return send_message(fd, resp.status, 0, resp.hash, resp.output, resp.error);
+}
+
+bool recv_response(int fd, DaemonResponse &resp) {
+  uint32_t unused;
+  return recv_message(fd, resp.status, unused, resp.hash, resp.output, resp.error);
+}
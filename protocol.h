@@ -0,0 +1,47 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+#include <string>
+
+// Messages exchanged between the minilang daemon (daemon.h) and its
+// clients over a Unix domain socket. Each message is a fixed-size
+// header followed by two length-prefixed byte strings, in host byte
+// order (both ends are on the same machine). A connection can carry
+// any number of request/response pairs.
+
+enum DaemonOp {
+  DAEMON_RUN = 1,      // run source, or the cached program with the given hash
+  DAEMON_STATS,        // report server statistics
+};
+
+enum DaemonStatus {
+  DAEMON_OK = 0,
+  DAEMON_ERROR,        // the program failed to compile or run
+  DAEMON_TIMEOUT,      // the program exceeded its time limit
+  DAEMON_UNKNOWN_HASH, // no cached program has the hash: resend the source
+  DAEMON_BAD_REQUEST,
+};
+
+struct DaemonRequest {
+  uint32_t op;
+  uint32_t timeout_ms;   // 0 for the server's default
+  uint64_t hash;         // with no source, the hash of a cached program
+  std::string source;
+  std::string input;     // read by readint
+};
+
+struct DaemonResponse {
+  uint32_t status;
+  uint64_t hash;         // of the program that ran, for later requests
+  std::string output;    // program output (or statistics); includes the Result line
+  std::string error;     // error message, as the command line would print it
+};
+
+// These return false if the connection fails or is closed.
+bool send_request(int fd, const DaemonRequest &req);
+bool recv_request(int fd, DaemonRequest &req);
+bool send_response(int fd, const DaemonResponse &resp);
+bool recv_response(int fd, DaemonResponse &resp);
+
+#endif // PROTOCOL_H
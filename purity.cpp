@@ -0,0 +1,178 @@
+#include <algorithm>
+#include "ast.h"
+#include "node.h"
+#include "interp.h"
+#include "purity.h"
+
+////////////////////////////////////////////////////////////////////////
+// PurityAnalysis implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// binary operators whose operands can be evaluated in either order
+// (AST_AND and AST_OR don't always evaluate their right operand)
+bool is_parallel_operator(int tag) {
+  switch (tag) {
+  case AST_ADD: case AST_SUB: case AST_MULTIPLY: case AST_DIVIDE:
+  case AST_LESSER: case AST_LESSER_EQUAL: case AST_GREATER: case AST_GREATER_EQUAL:
+  case AST_EQUAL_EQUAL: case AST_NOT_EQUAL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+unsigned add_cost(unsigned a, unsigned b) {
+  return std::min(a + b, 1u << 30);
+}
+
+}
+
+PurityAnalysis::PurityAnalysis()
+  : m_num_marked(0) {
+}
+
+PurityAnalysis::~PurityAnalysis() {
+}
+
+void PurityAnalysis::analyze(Node *unit) {
+  collect_defs(unit);
+
+  // each function's own effects, and the functions it calls
+  std::unordered_map<std::string, std::unordered_set<std::string>> callees;
+  for (auto i = m_defs.begin(); i != m_defs.end(); ++i) {
+    bool pure = Interpreter::lookup_intrinsic(i->first) == nullptr;
+    std::unordered_set<std::string> &calls = callees[i->first];
+    for (auto j = i->second.begin(); pure && j != i->second.end(); ++j) {
+      Node *func = *j;
+      std::unordered_set<std::string> locals;
+      if (func->get_num_kids() == 3) {
+        Node *params = func->get_kid(1);
+        for (auto k = params->cbegin(); k != params->cend(); ++k) {
+          locals.insert((*k)->get_str());
+        }
+      }
+      pure = check_body(func->get_last_kid(), locals, calls);
+    }
+    if (pure) {
+      m_pure_functions.insert(i->first);
+    }
+  }
+
+  // a function calling an impure function is impure
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto i = m_pure_functions.begin(); i != m_pure_functions.end(); ) {
+      const std::unordered_set<std::string> &calls = callees[*i];
+      bool pure = std::all_of(calls.begin(), calls.end(),
+                              [this](const std::string &name) { return m_pure_functions.count(name) > 0; });
+      if (pure) {
+        ++i;
+      } else {
+        i = m_pure_functions.erase(i);
+        changed = true;
+      }
+    }
+  }
+
+  unsigned cost;
+  visit(unit, cost);
+}
+
+void PurityAnalysis::collect_defs(Node *node) {
+  if (node->get_tag() == AST_LAZY_STMTS) {
+    return;
+  }
+  if (node->get_tag() == AST_FUNC) {
+    m_defs[node->get_kid(0)->get_str()].push_back(node);
+  }
+  for (auto i = node->cbegin(); i != node->cend(); ++i) {
+    collect_defs(*i);
+  }
+}
+
+// Check a function body for effects other than on its own variables
+// (locals: the names declared so far in the enclosing scopes of the
+// function), collecting the names of the functions it calls.
+bool PurityAnalysis::check_body(Node *node, std::unordered_set<std::string> &locals, std::unordered_set<std::string> &callees) {
+  switch (node->get_tag()) {
+  case AST_LAZY_STMTS:
+  case AST_FUNC:
+    return false;
+  case AST_VARDEF:
+    locals.insert(node->get_kid(0)->get_str());
+    return true;
+  case AST_EQUAL:
+    return locals.count(node->get_kid(0)->get_str()) > 0 && check_body(node->get_kid(1), locals, callees);
+  case AST_FUNC_CALL: {
+    std::string name = node->get_kid(0)->get_str();
+    if (Interpreter::lookup_intrinsic(name) != nullptr || m_defs.count(name) == 0) {
+      return false;
+    }
+    callees.insert(name);
+    return node->get_num_kids() < 2 || check_body(node->get_kid(1), locals, callees);
+  }
+  case AST_STMTS: {
+    std::unordered_set<std::string> scoped_locals(locals);
+    for (auto i = node->cbegin(); i != node->cend(); ++i) {
+      if (!check_body(*i, scoped_locals, callees)) return false;
+    }
+    return true;
+  }
+  default:
+    for (auto i = node->cbegin(); i != node->cend(); ++i) {
+      if (!check_body(*i, locals, callees)) return false;
+    }
+    return true;
+  }
+}
+
+// Returns whether node is a pure expression, with its estimated cost,
+// and marks the nodes below it (and it) that are worth parallelizing.
+bool PurityAnalysis::visit(Node *node, unsigned &cost) {
+  int tag = node->get_tag();
+  cost = 1;
+  if (tag == AST_LAZY_STMTS) {
+    return false;
+  }
+
+  unsigned num_kids = node->get_num_kids();
+  std::vector<unsigned> kid_costs(num_kids);
+  bool kids_pure = true;
+  unsigned num_costly = 0;
+  for (unsigned i = 0; i < num_kids; i++) {
+    kids_pure = visit(node->get_kid(i), kid_costs[i]) && kids_pure;
+    cost = add_cost(cost, kid_costs[i]);
+    if (kid_costs[i] >= PARALLEL_COST_THRESHOLD) num_costly++;
+  }
+
+  switch (tag) {
+  case AST_VARREF:
+  case AST_INT_LITERAL:
+    return true;
+  case AST_FUNC_CALL:
+    cost = add_cost(cost, CALL_COST);
+    return kids_pure && m_pure_functions.count(node->get_kid(0)->get_str()) > 0;
+  case AST_ARGS:
+    if (kids_pure && num_costly >= 2) {
+      node->set_parallel_eval(true);
+      m_num_marked++;
+    }
+    return kids_pure;
+  default:
+    if (is_parallel_operator(tag)) {
+      if (kids_pure && num_costly == 2) {
+        node->set_parallel_eval(true);
+        m_num_marked++;
+      }
+      return kids_pure;
+    }
+    if (tag == AST_AND || tag == AST_OR) {
+      return kids_pure;
+    }
+    // statements, definitions, and assignments
+    return false;
+  }
+}
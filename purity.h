@@ -0,0 +1,54 @@
+#ifndef PURITY_H
+#define PURITY_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+class Node;
+
+// Finds pure (side-effect-free) functions and expressions in an
+// analyzed AST, and marks the places where evaluating independent
+// pure subexpressions in parallel is likely to pay off: binary
+// operators whose operands are both pure and costly, and calls with
+// at least two costly arguments, all pure (see
+// NodeBase::set_parallel_eval).
+//
+// A function is pure if its body assigns only to its own parameters
+// and local variables, doesn't define functions, and calls only pure
+// functions (and no intrinsics, which all perform I/O or start
+// tasks). Calls are matched by name, so a name with several
+// definitions is pure only if all of them are. Lazily parsed bodies
+// are treated as impure. The cost of an expression is estimated from
+// its size, with each call to a user function counting as
+// CALL_COST nodes.
+class PurityAnalysis {
+private:
+  std::unordered_map<std::string, std::vector<Node *>> m_defs;
+  std::unordered_set<std::string> m_pure_functions;
+  unsigned m_num_marked;
+
+  // value semantics prohibited
+  PurityAnalysis(const PurityAnalysis &);
+  PurityAnalysis &operator=(const PurityAnalysis &);
+
+public:
+  static const unsigned CALL_COST = 100;
+  // operands cheaper than this are evaluated in place
+  static const unsigned PARALLEL_COST_THRESHOLD = CALL_COST;
+
+  PurityAnalysis();
+  ~PurityAnalysis();
+
+  void analyze(Node *unit);
+
+  bool is_pure_function(const std::string &name) const { return m_pure_functions.count(name) > 0; }
+  unsigned get_num_marked() const { return m_num_marked; }
+
+private:
+  void collect_defs(Node *node);
+  bool check_body(Node *node, std::unordered_set<std::string> &locals, std::unordered_set<std::string> &callees);
+  bool visit(Node *node, unsigned &cost);
+};
+
+#endif // PURITY_H
@@ -0,0 +1,299 @@
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <climits>
+#include <cctype>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "exceptions.h"
+#include "io.h"
+#include "interp.h"
+#include "vm.h"
+#include "sessions.h"
+
+////////////////////////////////////////////////////////////////////////
+// SessionServer::SessionIO: input received from, and output waiting
+// to be sent to, a session's connection
+////////////////////////////////////////////////////////////////////////
+
+class SessionServer::SessionIO : public IOHandler {
+private:
+  std::string m_input, m_output;
+  size_t m_input_pos;
+  bool m_input_closed;
+  bool m_failed;         // like an istream, stays failed after bad input
+
+public:
+  SessionIO()
+    : m_input_pos(0)
+    , m_input_closed(false)
+    , m_failed(false) {
+  }
+
+  void add_input(const char *data, size_t len) {
+    // drop what has been consumed, now and then
+    if (m_input_pos > 4096 && m_input_pos * 2 > m_input.size()) {
+      m_input.erase(0, m_input_pos);
+      m_input_pos = 0;
+    }
+    m_input.append(data, len);
+  }
+  void close_input() { m_input_closed = true; }
+  bool is_input_closed() const { return m_input_closed; }
+
+  std::string &get_output() { return m_output; }
+
+  virtual void write(const std::string &text) {
+    m_output += text;
+  }
+
+  // an integer is complete once whitespace (or the end of the input) follows it
+  virtual bool would_block() {
+    if (m_failed || m_input_closed) {
+      return false;
+    }
+    size_t i = m_input_pos;
+    while (i < m_input.size() && isspace((unsigned char) m_input[i])) i++;
+    if (i < m_input.size() && (m_input[i] == '-' || m_input[i] == '+')) i++;
+    while (i < m_input.size() && isdigit((unsigned char) m_input[i])) i++;
+    return i == m_input.size();
+  }
+
+  // same results as reading standard input with operator>>
+  virtual int read_int() {
+    while (m_input_pos < m_input.size() && isspace((unsigned char) m_input[m_input_pos])) m_input_pos++;
+    if (m_failed || m_input_pos == m_input.size()) {
+      return 0;
+    }
+    const char *start = m_input.c_str() + m_input_pos;
+    char *end;
+    errno = 0;
+    long long val = strtoll(start, &end, 10);
+    if (end == start || (!isdigit((unsigned char) end[-1]))) {
+      m_failed = true;
+      return 0;
+    }
+    m_input_pos += size_t(end - start);
+    if (errno == ERANGE || val > INT_MAX || val < INT_MIN) {
+      m_failed = true;
+      return val > 0 ? INT_MAX : INT_MIN;
+    }
+    return int(val);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////
+// SessionServer implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+void set_nonblocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+}
+
+SessionServer::SessionServer(const Bytecode *code, const std::string &socket_path)
+  : m_code(code)
+  , m_socket_path(socket_path)
+  , m_listen_fd(-1)
+  , m_epoll_fd(-1) {
+}
+
+SessionServer::~SessionServer() {
+  while (!m_sessions.empty()) {
+    close_session(m_sessions.begin()->first);
+  }
+  if (m_epoll_fd >= 0) close(m_epoll_fd);
+  if (m_listen_fd >= 0) close(m_listen_fd);
+}
+
+void SessionServer::run() {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (m_socket_path.size() >= sizeof(addr.sun_path)) {
+    RuntimeError::raise("Socket path '%s' is too long", m_socket_path.c_str());
+  }
+  strcpy(addr.sun_path, m_socket_path.c_str());
+
+  m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_listen_fd < 0) {
+    RuntimeError::raise("Could not create socket: %s", strerror(errno));
+  }
+  unlink(m_socket_path.c_str());
+  if (bind(m_listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 || listen(m_listen_fd, 1024) != 0) {
+    RuntimeError::raise("Could not listen on '%s': %s", m_socket_path.c_str(), strerror(errno));
+  }
+  set_nonblocking(m_listen_fd);
+  signal(SIGPIPE, SIG_IGN);
+
+  m_epoll_fd = epoll_create1(0);
+  if (m_epoll_fd < 0) {
+    RuntimeError::raise("epoll_create1 failed: %s", strerror(errno));
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = m_listen_fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_listen_fd, &ev);
+
+  const int MAX_EVENTS = 256;
+  struct epoll_event events[MAX_EVENTS];
+  for (;;) {
+    // don't sleep while some sessions are waiting for a time slice
+    int n = epoll_wait(m_epoll_fd, events, MAX_EVENTS, m_runnable.empty() ? -1 : 0);
+    if (n < 0 && errno != EINTR) {
+      RuntimeError::raise("epoll_wait failed: %s", strerror(errno));
+    }
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == m_listen_fd) {
+        accept_sessions();
+        continue;
+      }
+      auto s = m_sessions.find(fd);
+      if (s == m_sessions.end()) continue;
+      if (events[i].events & EPOLLOUT) {
+        send_output(*s->second);
+      }
+      // sending may have closed the session
+      s = m_sessions.find(fd);
+      if (s != m_sessions.end() && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        read_input(*s->second);
+      }
+    }
+
+    // one time slice for each session that was runnable at this point
+    for (size_t count = m_runnable.size(); count > 0; count--) {
+      int fd = m_runnable.front();
+      m_runnable.pop_front();
+      auto s = m_sessions.find(fd);
+      if (s != m_sessions.end()) {
+        s->second->queued = false;
+        step(*s->second);
+      }
+    }
+  }
+}
+
+void SessionServer::accept_sessions() {
+  for (;;) {
+    int fd = accept(m_listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      // EAGAIN: no more pending connections
+      return;
+    }
+    set_nonblocking(fd);
+    std::unique_ptr<Session> s(new Session());
+    s->fd = fd;
+    s->io.reset(new SessionIO());
+    s->context.reset(new Interpreter(nullptr, s->io.get()));
+    s->vm.reset(new VM(m_code, s->context.get()));
+    s->queued = s->finished = s->want_write = false;
+    s->vm->start();
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    Session &session = *s;
+    m_sessions[fd] = std::move(s);
+    make_runnable(session);
+  }
+}
+
+void SessionServer::read_input(Session &s) {
+  char buf[4096];
+  for (;;) {
+    ssize_t n = read(s.fd, buf, sizeof(buf));
+    if (n > 0) {
+      s.io->add_input(buf, size_t(n));
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (n < 0 && errno == EINTR) continue;
+    // end of input: readint returns 0 from now on
+    s.io->close_input();
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = s.want_write ? EPOLLOUT : 0;
+    ev.data.fd = s.fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, s.fd, &ev);
+    break;
+  }
+  if (s.vm->get_state() == VM_WAITING_INPUT && !s.io->would_block()) {
+    make_runnable(s);
+  }
+}
+
+void SessionServer::step(Session &s) {
+  try {
+    VMState state = s.vm->resume(TIME_SLICE);
+    if (state == VM_RUNNABLE) {
+      make_runnable(s);
+    } else if (state == VM_FINISHED) {
+      s.io->write("Result: " + s.vm->get_result().as_str() + "\n");
+      s.finished = true;
+    }
+  } catch (BaseException &ex) {
+    s.io->write(ex.get_message() + "\n");
+    s.finished = true;
+  }
+  send_output(s);
+}
+
+void SessionServer::make_runnable(Session &s) {
+  if (!s.queued) {
+    s.queued = true;
+    m_runnable.push_back(s.fd);
+  }
+}
+
+void SessionServer::send_output(Session &s) {
+  std::string &out = s.io->get_output();
+  size_t sent = 0;
+  while (sent < out.size()) {
+    ssize_t n = write(s.fd, out.data() + sent, out.size() - sent);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (n <= 0) {
+      // the client has gone away
+      close_session(s.fd);
+      return;
+    }
+    sent += size_t(n);
+  }
+  out.erase(0, sent);
+
+  if (out.empty() && s.finished) {
+    close_session(s.fd);
+    return;
+  }
+  // wait for the socket to become writable only while output is pending
+  bool want_write = !out.empty();
+  if (want_write != s.want_write) {
+    s.want_write = want_write;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (s.io->is_input_closed() ? 0 : EPOLLIN) | (want_write ? EPOLLOUT : 0);
+    ev.data.fd = s.fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, s.fd, &ev);
+  }
+}
+
+void SessionServer::close_session(int fd) {
+  auto s = m_sessions.find(fd);
+  if (s == m_sessions.end()) return;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  // the VM refers to the context, which refers to the io
+  s->second->vm.reset();
+  m_sessions.erase(s);
+}
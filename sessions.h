@@ -0,0 +1,63 @@
+#ifndef SESSIONS_H
+#define SESSIONS_H
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+class Bytecode;
+class Interpreter;
+class VM;
+
+// Serves interactive sessions of one compiled program on a Unix
+// domain socket, all on a single thread. Each connection starts a
+// session: a run of the program in its own VM, whose readint reads
+// integers sent by the client and whose output is sent back (followed
+// by the Result line, or an error message, when the program ends).
+// A session waiting for input is suspended (see VM::resume) rather
+// than blocking the thread, and runnable sessions take turns in time
+// slices, so any number of sessions can be in progress at once.
+class SessionServer {
+private:
+  class SessionIO;
+
+  struct Session {
+    int fd;
+    std::unique_ptr<SessionIO> io;
+    std::unique_ptr<Interpreter> context;   // passes io to the intrinsics
+    std::unique_ptr<VM> vm;
+    bool queued;                            // in m_runnable
+    bool finished;                          // close once the output is sent
+    bool want_write;                        // registered for EPOLLOUT
+  };
+
+  const Bytecode *m_code;
+  std::string m_socket_path;
+  int m_listen_fd, m_epoll_fd;
+  std::unordered_map<int, std::unique_ptr<Session>> m_sessions;
+  std::deque<int> m_runnable;
+
+  // value semantics prohibited
+  SessionServer(const SessionServer &);
+  SessionServer &operator=(const SessionServer &);
+
+public:
+  // instructions a session runs before yielding to the others
+  static const unsigned TIME_SLICE = 100000;
+
+  SessionServer(const Bytecode *code, const std::string &socket_path);
+  ~SessionServer();
+
+  // accept and serve sessions (does not return normally)
+  void run();
+
+private:
+  void accept_sessions();
+  void read_input(Session &s);
+  void step(Session &s);
+  void make_runnable(Session &s);
+  void send_output(Session &s);
+  void close_session(int fd);
+};
+
+#endif // SESSIONS_H
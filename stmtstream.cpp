@@ -0,0 +1,91 @@
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "parser2.h"
+#include "stmtstream.h"
+
+////////////////////////////////////////////////////////////////////////
+// StatementStream implementation
+////////////////////////////////////////////////////////////////////////
+
+// State shared by the parser thread and the consumer. It is reference
+// counted because the parser thread may outlive the StatementStream
+// (see the destructor).
+struct StatementStream::Channel {
+  std::mutex lock;
+  std::condition_variable ready;
+  std::deque<Node *> stmts;
+  bool done = false;              // no more statements will be added
+  bool stopped = false;           // consumer is no longer interested
+  std::exception_ptr error;       // delivered after the queued statements
+
+  ~Channel() {
+    for (auto i = stmts.begin(); i != stmts.end(); ++i) {
+      delete *i;
+    }
+  }
+};
+
+StatementStream::StatementStream(Lexer *lexer_to_adopt, bool lazy_functions)
+  : m_chan(new Channel()) {
+  std::shared_ptr<Parser2> parser(new Parser2(lexer_to_adopt));
+  parser->set_lazy_functions(lazy_functions);
+  std::shared_ptr<Channel> chan = m_chan;
+
+  m_parser_thread = std::thread([parser, chan]() {
+    std::exception_ptr error;
+    for (;;) {
+      Node *stmt = nullptr;
+      try {
+        stmt = parser->parse_next();
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      std::lock_guard<std::mutex> guard(chan->lock);
+      if (stmt != nullptr && !chan->stopped) {
+        chan->stmts.push_back(stmt);
+        chan->ready.notify_one();
+        continue;
+      }
+      delete stmt;
+      chan->error = error;
+      chan->done = true;
+      chan->ready.notify_one();
+      return;
+    }
+  });
+}
+
+StatementStream::~StatementStream() {
+  bool finished;
+  {
+    std::lock_guard<std::mutex> guard(m_chan->lock);
+    m_chan->stopped = true;
+    finished = m_chan->done;
+  }
+  // If the consumer stopped early (e.g., because of a runtime error),
+  // the parser thread may be blocked reading input that will never
+  // arrive. It exits after its current statement, and the shared
+  // state is freed by whichever side releases it last.
+  if (finished) {
+    m_parser_thread.join();
+  } else {
+    m_parser_thread.detach();
+  }
+}
+
+Node *StatementStream::next() {
+  std::unique_lock<std::mutex> guard(m_chan->lock);
+  m_chan->ready.wait(guard, [this]() { return !m_chan->stmts.empty() || m_chan->done; });
+  if (!m_chan->stmts.empty()) {
+    Node *stmt = m_chan->stmts.front();
+    m_chan->stmts.pop_front();
+    return stmt;
+  }
+  if (m_chan->error) {
+    std::rethrow_exception(m_chan->error);
+  }
+  return nullptr;
+}
@@ -0,0 +1,35 @@
+#ifndef STMTSTREAM_H
+#define STMTSTREAM_H
+
+#include <memory>
+#include <thread>
+#include "lexer.h"
+#include "node.h"
+
+// Parses top-level statements on a background thread and hands them
+// out in order, so that parsing the next statement (including waiting
+// for its text to arrive, e.g. over a pipe) overlaps with executing
+// the current one.
+class StatementStream {
+private:
+  struct Channel;
+
+  std::shared_ptr<Channel> m_chan;
+  std::thread m_parser_thread;
+
+  // value semantics prohibited
+  StatementStream(const StatementStream &);
+  StatementStream &operator=(const StatementStream &);
+
+public:
+  // lazy_functions is passed to Parser2::set_lazy_functions
+  StatementStream(Lexer *lexer_to_adopt, bool lazy_functions = false);
+  ~StatementStream();
+
+  // Wait for the next statement, which the caller adopts. Returns
+  // nullptr at the end of the unit, and rethrows a syntax error once
+  // all statements preceding it have been retrieved.
+  Node *next();
+};
+
+#endif // STMTSTREAM_H
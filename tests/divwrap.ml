@@ -0,0 +1,11 @@
+var i;
+var n;
+var x;
+i = 65536;
+n = 0;
+while (n < 70000) {
+  x = 100 / i;
+  i = i + 65536;
+  n = n + 1;
+}
+println(x);
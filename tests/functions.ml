@@ -0,0 +1,38 @@
+var total;
+var i;
+
+function fib(n) {
+  var r;
+  if (n < 2) {
+    r = n;
+  } else {
+    r = fib(n - 1) + fib(n - 2);
+  }
+  r;
+}
+
+function square(x) {
+  x * x;
+}
+
+function sumsquares(n) {
+  var s;
+  var k;
+  s = 0;
+  k = 1;
+  while (k <= n) {
+    s = s + square(k);
+    k = k + 1;
+  }
+  s;
+}
+
+total = 0;
+i = 0;
+while (i < 10) {
+  total = total + fib(i);
+  println(total);
+  i = i + 1;
+}
+println(sumsquares(20));
+println(fib(18) - sumsquares(12) * 2);
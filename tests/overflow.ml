@@ -0,0 +1,14 @@
+var big;
+var min;
+var x;
+big = 2147483647;
+min = 0 - big - 1;
+println(big + 1);
+println(min - 1);
+println(big * 3);
+println(min / (0 - 1));
+x = 1;
+while (x != 0) {
+  x = x * 2;
+}
+println(x);
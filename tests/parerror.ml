@@ -0,0 +1,16 @@
+var zero;
+
+function fib(n) {
+  var r;
+  if (n < 2) {
+    r = n;
+  } else {
+    r = fib(n - 1) + fib(n - 2);
+  }
+  r;
+}
+
+zero = 0;
+println(fib(12) + fib(11));
+println(fib(16) + 1 / zero);
+println(1);
@@ -0,0 +1,13 @@
+var ok;
+var bad;
+
+function divide(a, b) {
+  println(a);
+  a / b;
+}
+
+ok = spawn(divide, 10, 2);
+bad = spawn(divide, 7, 0);
+println(join(ok));
+println(join(bad));
+println(1);
@@ -0,0 +1,16 @@
+var h;
+
+function inner() {
+  while (h == 0) {
+    0;
+  }
+  join(h);
+}
+
+function outer() {
+  join(spawn(inner));
+}
+
+h = spawn(outer);
+println(1);
+join(h);
@@ -0,0 +1,27 @@
+var a;
+var b;
+var c;
+
+function work(id, n) {
+  var k;
+  k = 0;
+  while (k < n) {
+    print(id);
+    k = k + 1;
+  }
+  println(0);
+  id * 100 + n;
+}
+
+function show(i) {
+  println(i * i);
+}
+
+a = spawn(work, 1, 3);
+b = spawn(work, 2, 2);
+c = spawn(work, 3, 1);
+println(join(c));
+println(join(a));
+println(join(b));
+parfor(show, 0, 8);
+println(0 - 1);
@@ -0,0 +1,12 @@
+var h;
+
+function self() {
+  while (h == 0) {
+    0;
+  }
+  join(h);
+}
+
+h = spawn(self);
+println(1);
+join(h);
@@ -0,0 +1,141 @@
+#include <cassert>
+#include "threadpool.h"
+
+////////////////////////////////////////////////////////////////////////
+// WorkStealingPool implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// which pool (if any) the current thread is a worker of, and its index
+thread_local const WorkStealingPool *t_pool = nullptr;
+thread_local int t_worker_index = -1;
+
+}
+
+WorkStealingPool::WorkStealingPool(unsigned num_threads)
+  : m_queued(0)
+  , m_pending(0)
+  , m_next_worker(0)
+  , m_stopping(false) {
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+  for (unsigned i = 0; i < num_threads; i++) {
+    m_workers.emplace_back(new Worker());
+  }
+  for (unsigned i = 0; i < num_threads; i++) {
+    m_threads.emplace_back(&WorkStealingPool::run_worker, this, i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  wait_idle();
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stopping = true;
+  }
+  m_work_available.notify_all();
+  for (auto i = m_threads.begin(); i != m_threads.end(); ++i) {
+    i->join();
+  }
+}
+
+void WorkStealingPool::submit(Task task) {
+  int self = get_current_worker();
+  unsigned target;
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    target = self >= 0 ? unsigned(self) : m_next_worker++ % unsigned(m_workers.size());
+    m_pending++;
+  }
+  {
+    // the deque's lock is held while counting the task, as in try_take,
+    // so the count never falls behind the tasks that can be taken
+    std::lock_guard<std::mutex> guard(m_workers[target]->lock);
+    m_workers[target]->tasks.push_back(std::move(task));
+    std::lock_guard<std::mutex> count_guard(m_lock);
+    m_queued++;
+  }
+  m_work_available.notify_one();
+}
+
+void WorkStealingPool::wait_idle() {
+  std::unique_lock<std::mutex> guard(m_lock);
+  m_idle.wait(guard, [this]() { return m_pending == 0; });
+}
+
+void WorkStealingPool::wait_until(const std::function<bool()> &done) {
+  std::unique_lock<std::mutex> guard(m_lock);
+  m_changed.wait(guard, done);
+}
+
+bool WorkStealingPool::wait_until(const std::function<bool()> &done, std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> guard(m_lock);
+  return m_changed.wait_until(guard, deadline, done);
+}
+
+void WorkStealingPool::notify() {
+  {
+    // a waiter is either before its check of done() or waiting
+    std::lock_guard<std::mutex> guard(m_lock);
+  }
+  m_changed.notify_all();
+}
+
+int WorkStealingPool::get_current_worker() const {
+  return t_pool == this ? t_worker_index : -1;
+}
+
+void WorkStealingPool::run_worker(unsigned index) {
+  t_pool = this;
+  t_worker_index = int(index);
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> guard(m_lock);
+      m_work_available.wait(guard, [this]() { return m_queued > 0 || m_stopping; });
+      if (m_queued == 0 && m_stopping) {
+        return;
+      }
+    }
+    Task task;
+    if (try_take(int(index), task)) {
+      task();
+      finish_task();
+    }
+  }
+}
+
+// take a task from the worker's own deque (newest first), or steal
+// the oldest task of another worker
+bool WorkStealingPool::try_take(int self, Task &task) {
+  unsigned n = unsigned(m_workers.size());
+  for (unsigned k = 0; k < n; k++) {
+    unsigned victim = self >= 0 ? (unsigned(self) + k) % n : k;
+    Worker &w = *m_workers[victim];
+    std::lock_guard<std::mutex> guard(w.lock);
+    if (w.tasks.empty()) {
+      continue;
+    }
+    if (int(victim) == self) {
+      task = std::move(w.tasks.back());
+      w.tasks.pop_back();
+    } else {
+      task = std::move(w.tasks.front());
+      w.tasks.pop_front();
+    }
+    std::lock_guard<std::mutex> count_guard(m_lock);
+    assert(m_queued > 0);
+    m_queued--;
+    return true;
+  }
+  return false;
+}
+
+void WorkStealingPool::finish_task() {
+  std::lock_guard<std::mutex> guard(m_lock);
+  assert(m_pending > 0);
+  if (--m_pending == 0) {
+    m_idle.notify_all();
+  }
+}
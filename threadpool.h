@@ -0,0 +1,75 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+// Fixed-size pool of worker threads with work stealing. Each worker
+// has its own deque: tasks submitted by a worker go on the back of
+// its deque and it takes work from the back (most recent first),
+// while idle workers steal from the front of other workers' deques.
+// Tasks submitted from outside the pool are spread round-robin.
+class WorkStealingPool {
+public:
+  typedef std::function<void()> Task;
+
+private:
+  struct Worker {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::vector<std::thread> m_threads;
+  std::mutex m_lock;                   // protects the counts below
+  std::condition_variable m_work_available;
+  std::condition_variable m_idle;
+  std::condition_variable m_changed;   // see wait_until
+  unsigned m_queued;                   // tasks in the deques
+  unsigned m_pending;                  // tasks submitted but not finished
+  unsigned m_next_worker;              // for round-robin submission
+  bool m_stopping;
+
+  // value semantics prohibited
+  WorkStealingPool(const WorkStealingPool &);
+  WorkStealingPool &operator=(const WorkStealingPool &);
+
+public:
+  WorkStealingPool(unsigned num_threads);
+  // waits for submitted tasks to finish
+  ~WorkStealingPool();
+
+  unsigned get_num_threads() const { return unsigned(m_threads.size()); }
+
+  // tasks must not throw; they should catch and record their own errors
+  void submit(Task task);
+
+  // wait until every submitted task has finished
+  void wait_idle();
+
+  // Block the calling thread until done() is true. done() is checked
+  // (under the pool's lock) on entry and after each notify(), so
+  // whatever makes it true must call notify() afterwards. A task
+  // waiting for tasks that haven't started should run them itself
+  // first, so they can't be starved of workers.
+  void wait_until(const std::function<bool()> &done);
+  // likewise, but giving up at the deadline; returns done()
+  bool wait_until(const std::function<bool()> &done, std::chrono::steady_clock::time_point deadline);
+  void notify();
+
+  // the index of the pool worker running the calling thread, or -1
+  int get_current_worker() const;
+
+private:
+  void run_worker(unsigned index);
+  bool try_take(int self, Task &task);
+  void finish_task();
+};
+
+#endif // THREADPOOL_H
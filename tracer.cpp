@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include "node.h"
+#include "cpputil.h"
+#include "exceptions.h"
+#include "tracer.h"
+
+////////////////////////////////////////////////////////////////////////
+// Tracer implementation
+////////////////////////////////////////////////////////////////////////
+
+std::atomic<unsigned> Tracer::s_next_id(1);
+
+Tracer::Tracer()
+  : m_id(s_next_id++)
+  , m_start(std::chrono::steady_clock::now()) {
+}
+
+Tracer::~Tracer() {
+}
+
+void Tracer::record(const Node *call, const char *name, const char *category, char phase) {
+  Ring *ring = get_ring();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) == RING_SIZE) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    drain(*ring);
+  }
+  Event &event = ring->events[head % RING_SIZE];
+  event.ts_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+  event.call = call;
+  event.name = name;
+  event.category = category;
+  event.phase = phase;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+// the calling thread's ring, created on its first event
+Tracer::Ring *Tracer::get_ring() {
+  static thread_local unsigned t_tracer_id = 0;
+  static thread_local Ring *t_ring = nullptr;
+  if (t_tracer_id != m_id) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_rings.emplace_back(new Ring());
+    t_ring = m_rings.back().get();
+    t_ring->tid = unsigned(m_rings.size());
+    t_ring->head.store(0, std::memory_order_relaxed);
+    t_ring->tail.store(0, std::memory_order_relaxed);
+    t_tracer_id = m_id;
+  }
+  return t_ring;
+}
+
+// move a ring's pending events to m_events; m_lock must be held
+void Tracer::drain(Ring &ring) {
+  uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+  uint64_t head = ring.head.load(std::memory_order_acquire);
+  for (uint64_t i = tail; i != head; i++) {
+    m_events.push_back(std::make_pair(ring.tid, ring.events[i % RING_SIZE]));
+  }
+  ring.tail.store(head, std::memory_order_release);
+}
+
+void Tracer::write(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (out == nullptr) {
+    RuntimeError::raise("Could not write trace file '%s'", path);
+  }
+
+  std::lock_guard<std::mutex> guard(m_lock);
+  for (auto i = m_rings.begin(); i != m_rings.end(); ++i) {
+    drain(**i);
+  }
+
+  int pid = int(getpid());
+  fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  for (unsigned tid = 1; tid <= m_rings.size(); tid++) {
+    std::string thread_name = tid == 1 ? "main" : cpputil::format("thread %u", tid);
+    fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %u, \"args\": {\"name\": \"%s\"}},\n",
+            pid, tid, thread_name.c_str());
+  }
+  for (auto i = m_events.begin(); i != m_events.end(); ++i) {
+    const Event &event = i->second;
+    std::string name = event.call != nullptr ? event.call->get_kid(0)->get_str() : event.name;
+    std::string args;
+    if (event.call != nullptr && event.phase == 'B') {
+      const Location &loc = event.call->get_loc();
+      args = cpputil::format(", \"args\": {\"loc\": \"%s:%d:%d\"}", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col());
+    }
+    fprintf(out, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %u%s}%s\n",
+            name.c_str(), event.category, event.phase, double(event.ts_ns) / 1000.0, pid, i->first, args.c_str(),
+            i + 1 != m_events.end() ? "," : "");
+  }
+  fprintf(out, "]}\n");
+  fclose(out);
+}
@@ -0,0 +1,96 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <chrono>
+class Node;
+
+// Records timed events for a trace viewer: the phases of a run (lex,
+// parse, analyze, execute), calls (entering and leaving each
+// AST_FUNC_CALL, for user-defined functions and intrinsics), and the
+// time readint spends waiting for input. Each thread records into its
+// own ring buffer, without locking; a ring that fills up is emptied
+// into the Tracer's event list (under its lock) by its own thread.
+// write() produces a Chrome trace-event JSON file (for chrome://tracing
+// or Perfetto). Calls are named by their call sites, so the AST must
+// still exist when write() is called.
+class Tracer {
+public:
+  static const unsigned RING_SIZE = 1u << 14;
+
+private:
+  struct Event {
+    uint64_t ts_ns;             // since the Tracer was created
+    const Node *call;           // the AST_FUNC_CALL, for a call event
+    const char *name;           // otherwise, the event's name
+    const char *category;
+    char phase;                 // 'B' (begin) or 'E' (end)
+  };
+
+  // Written only by its thread; events in [tail, head) are
+  // pending. Either thread may empty it, holding the Tracer's lock.
+  struct Ring {
+    unsigned tid;
+    std::atomic<uint64_t> head, tail;
+    Event events[RING_SIZE];
+  };
+
+  unsigned m_id;                              // identifies the threads' rings
+  std::chrono::steady_clock::time_point m_start;
+  std::mutex m_lock;                          // protects the members below
+  std::vector<std::unique_ptr<Ring>> m_rings; // by tid - 1
+  std::vector<std::pair<unsigned, Event>> m_events;  // emptied from rings
+
+  // value semantics prohibited
+  Tracer(const Tracer &);
+  Tracer &operator=(const Tracer &);
+
+public:
+  Tracer();
+  ~Tracer();
+
+  void begin_call(const Node *call) { record(call, nullptr, "call", 'B'); }
+  void end_call(const Node *call)   { record(call, nullptr, "call", 'E'); }
+  // name and category must be string literals (or otherwise outlive
+  // the Tracer)
+  void begin(const char *name, const char *category) { record(nullptr, name, category, 'B'); }
+  void end(const char *name, const char *category)   { record(nullptr, name, category, 'E'); }
+
+  // write the events recorded so far (raises a RuntimeError if the
+  // file can't be written)
+  void write(const char *path);
+
+private:
+  void record(const Node *call, const char *name, const char *category, char phase);
+  Ring *get_ring();
+  void drain(Ring &ring);
+
+  static std::atomic<unsigned> s_next_id;
+};
+
+// Records a begin event now and the matching end event when it goes
+// out of scope (even by an exception); does nothing without a Tracer.
+class TraceSpan {
+private:
+  Tracer *m_tracer;
+  const char *m_name, *m_category;
+
+  // value semantics prohibited
+  TraceSpan(const TraceSpan &);
+  TraceSpan &operator=(const TraceSpan &);
+
+public:
+  TraceSpan(Tracer *tracer, const char *name, const char *category)
+    : m_tracer(tracer), m_name(name), m_category(category) {
+    if (m_tracer != nullptr) m_tracer->begin(m_name, m_category);
+  }
+  ~TraceSpan() {
+    if (m_tracer != nullptr) m_tracer->end(m_name, m_category);
+  }
+};
+
+#endif // TRACER_H
@@ -0,0 +1,101 @@
+#include <cassert>
+#include <memory>
+#include "ast.h"
+#include "token.h"
+#include "node.h"
+#include "treeshake.h"
+
+////////////////////////////////////////////////////////////////////////
+// TreeShaker implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// strings longer than the small-string buffer (15 characters in
+// libstdc++) are stored on the heap
+size_t heap_string_bytes(const std::string &s) {
+  return s.size() > 15 ? s.size() + 1 : 0;
+}
+
+}
+
+TreeShaker::TreeShaker() {
+}
+
+TreeShaker::~TreeShaker() {
+}
+
+void TreeShaker::shake(Node *unit) {
+  assert(unit->get_tag() == AST_UNIT);
+
+  // definitions of each function name (a name may be redefined),
+  // and the names referenced by the top-level statements
+  std::unordered_map<std::string, std::vector<Node *>> defs;
+  std::unordered_set<std::string> roots;
+  for (auto i = unit->cbegin(); i != unit->cend(); ++i) {
+    Node *stmt = *i;
+    if (stmt->get_tag() == AST_FUNC) {
+      defs[stmt->get_kid(0)->get_str()].push_back(stmt);
+    } else {
+      collect_refs(stmt, roots);
+    }
+  }
+
+  // propagate reachability through the bodies of reachable functions
+  std::unordered_set<std::string> reachable;
+  std::vector<std::string> worklist(roots.begin(), roots.end());
+  while (!worklist.empty()) {
+    std::string name = worklist.back();
+    worklist.pop_back();
+    auto i = defs.find(name);
+    if (i == defs.end() || !reachable.insert(name).second) {
+      continue;
+    }
+    std::unordered_set<std::string> refs;
+    for (Node *def : i->second) {
+      collect_refs(def->get_last_kid(), refs);
+    }
+    worklist.insert(worklist.end(), refs.begin(), refs.end());
+  }
+
+  // the last statement is kept regardless, since its value (0 for a
+  // definition) is the result of the program
+  for (unsigned i = 0; i + 1 < unit->get_num_kids(); ) {
+    Node *stmt = unit->get_kid(i);
+    if (stmt->get_tag() != AST_FUNC || reachable.count(stmt->get_kid(0)->get_str()) > 0) {
+      i++;
+      continue;
+    }
+    std::unique_ptr<Node> dead(unit->remove_kid(i));
+    m_removed.push_back({ dead->get_kid(0)->get_str(), dead->get_loc(), get_ast_bytes(dead.get()) });
+  }
+}
+
+void TreeShaker::print_report(FILE *out) const {
+  size_t total = 0;
+  for (auto i = m_removed.begin(); i != m_removed.end(); ++i) {
+    fprintf(out, "%s:%d:%d: removed unreachable function %s (%zu bytes)\n",
+            i->loc.get_srcfile().c_str(), i->loc.get_line(), i->loc.get_col(), i->name.c_str(), i->bytes);
+    total += i->bytes;
+  }
+  fprintf(out, "Tree shaking removed %zu function(s), %zu bytes of AST\n", m_removed.size(), total);
+}
+
+size_t TreeShaker::get_ast_bytes(Node *ast) {
+  size_t bytes = 0;
+  ast->preorder([&bytes](Node *n) {
+    bytes += sizeof(Node) + n->get_num_kids() * sizeof(Node *);
+    bytes += heap_string_bytes(n->get_str()) + heap_string_bytes(n->get_loc().get_srcfile());
+  });
+  return bytes;
+}
+
+// names referenced in a subtree: identifiers in AST nodes, or in the
+// tokens of a lazily parsed function body
+void TreeShaker::collect_refs(Node *ast, std::unordered_set<std::string> &refs) {
+  ast->preorder([&refs](Node *n) {
+    if (n->get_tag() == AST_VARREF || n->get_tag() == TOK_IDENTIFIER) {
+      refs.insert(n->get_str());
+    }
+  });
+}
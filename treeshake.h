@@ -0,0 +1,49 @@
+#ifndef TREESHAKE_H
+#define TREESHAKE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "location.h"
+class Node;
+
+// Removes top-level function definitions (AST_FUNC) that can't be
+// reached from the unit's other top-level statements. A function is
+// reachable if its name is referenced (called, or used as a value)
+// by a top-level statement or by the body of a reachable function.
+// References are matched by name only, so a variable or parameter
+// that shadows a function name conservatively keeps it alive.
+class TreeShaker {
+private:
+  struct Removed {
+    std::string name;
+    Location loc;
+    size_t bytes;
+  };
+
+  std::vector<Removed> m_removed;
+
+  // value semantics prohibited
+  TreeShaker(const TreeShaker &);
+  TreeShaker &operator=(const TreeShaker &);
+
+public:
+  TreeShaker();
+  ~TreeShaker();
+
+  // shake an analyzed AST_UNIT in place
+  void shake(Node *unit);
+
+  // list the removed functions and the AST memory they occupied
+  void print_report(FILE *out) const;
+
+  // approximate heap footprint of an AST subtree
+  static size_t get_ast_bytes(Node *ast);
+
+private:
+  static void collect_refs(Node *ast, std::unordered_set<std::string> &refs);
+};
+
+#endif // TREESHAKE_H
@@ -1,12 +1,15 @@
 #include "function.h"
 #include "valrep.h"
+#include "counters.h"
 
 ValRep::ValRep(ValRepKind kind)
   : m_kind(kind)
   , m_refcount(0) {
+  Counters::count_valrep_allocated();
 }
 
 ValRep::~ValRep() {
+  Counters::count_valrep_freed();
 }
 
 Function *ValRep::as_function() {
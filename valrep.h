@@ -2,6 +2,7 @@
 #define VALREP_H
 
 #include <cassert>
+#include <atomic>
 class Function;
 
 // A "ValRep" (value representation) is a type used as
@@ -17,7 +18,7 @@ enum ValRepKind {
 class ValRep {
 private:
   ValRepKind m_kind;
-  int m_refcount;
+  std::atomic<int> m_refcount;  // Values may be shared by tasks on other threads
 
   // copy constructor and assignment operator prohibited
   ValRep(const ValRep &);
@@ -33,13 +34,12 @@ public:
   // derived from ValRep.  add_ref() should be called when a
   // Value is set to point to a ValRep. remove_ref() should be
   // called when a Value no longer points to a ValRep.
-  // If remove_ref() is called and the reference count
-  // (as returned by get_num_refs()) becomes 0, the ValRep object
-  // should be deleted (because there are no longer any Value
-  // objects pointing to it.)
-  void add_ref()           { ++m_refcount; }
-  void remove_ref()        { assert(m_refcount > 0); --m_refcount; }
-  int get_num_refs() const { return m_refcount; }
+  // If remove_ref() returns 0 (the new reference count),
+  // the ValRep object should be deleted (because there are no
+  // longer any Value objects pointing to it.)
+  void add_ref()           { m_refcount.fetch_add(1, std::memory_order_relaxed); }
+  int remove_ref()         { int n = m_refcount.fetch_sub(1, std::memory_order_acq_rel) - 1; assert(n >= 0); return n; }
+  int get_num_refs() const { return m_refcount.load(std::memory_order_relaxed); }
 
   // It's useful to have functions that return a pointer to
   // the actual derived type (e.g., Function). Obviously, the caller
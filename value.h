@@ -2,8 +2,9 @@
 #define VALUE_H
 
 #include <cassert>
+#include <cstdint>
 #include <string>
-class ValRep;
+#include "valrep.h"
 class Function;
 
 enum ValueKind {
@@ -26,60 +27,102 @@ class Location;
 class Interpreter;
 typedef Value (*IntrinsicFn)(Value args[], unsigned num_args, const Location &loc, Interpreter *interp);
 
-// An "atomic" value that doesn't require a separate
-// (dynamically-allocated) representation
-union Atomic {
-  int ival;
-  IntrinsicFn intrinsic_fn;
-};
-
 // An instance of Value is a runtime value.
 // Its type can vary (int, function, intrinsic function, etc.)
+//
+// A Value is a single tagged word, so copying one is a word copy (plus
+// a reference count increment for dynamic values). The low two bits
+// are the tag: a dynamic value is its ValRep pointer itself (ValReps
+// are at least 4-byte aligned, so its tag is 0), an int is kept in the
+// high 32 bits, and an intrinsic function's pointer is shifted left
+// past the tag (user-space code addresses leave the top bits clear).
+// A moved-from Value is the int 0.
 
 class Value {
 private:
-  ValueKind m_kind;
-  union {
-    Atomic m_atomic; // for "atomic" values
-    ValRep *m_rep;   // for "dynamic" values (pointer to associated ValRep object)
+  enum {
+    TAG_REP = 0,
+    TAG_INT = 1,
+    TAG_INTRINSIC_FN = 2,
+    TAG_BITS = 2,
+    TAG_MASK = (1 << TAG_BITS) - 1,
+    INT_SHIFT = 32,
   };
 
+  uintptr_t m_bits;
+
+  static uintptr_t int_bits(int ival) {
+    return (uintptr_t(uint32_t(ival)) << INT_SHIFT) | TAG_INT;
+  }
+
+  unsigned get_tag() const { return unsigned(m_bits & TAG_MASK); }
+  ValRep *get_rep() const { return reinterpret_cast<ValRep *>(m_bits); }
+
+  void attach() { if (is_dynamic()) get_rep()->add_ref(); }
+  void detach() { if (is_dynamic()) release(); }
+  void release();
+
 public:
-  Value(int ival = 0);
+  Value(int ival = 0) : m_bits(int_bits(ival)) { }
   Value(Function *fn);
   Value(IntrinsicFn intrinsic_fn);
-  Value(const Value &other);
-  ~Value();
+  Value(const Value &other) : m_bits(other.m_bits) { attach(); }
+  Value(Value &&other) noexcept : m_bits(other.m_bits) { other.m_bits = int_bits(0); }
+  ~Value() { detach(); }
+
+  Value &operator=(const Value &rhs) {
+    // attach first, in case this Value holds the only other reference
+    uintptr_t bits = rhs.m_bits;
+    if (bits != m_bits) {
+      if ((bits & TAG_MASK) == TAG_REP) reinterpret_cast<ValRep *>(bits)->add_ref();
+      detach();
+      m_bits = bits;
+    }
+    return *this;
+  }
 
-  Value &operator=(const Value &rhs);
+  Value &operator=(Value &&rhs) noexcept {
+    if (this != &rhs) {
+      detach();
+      m_bits = rhs.m_bits;
+      rhs.m_bits = int_bits(0);
+    }
+    return *this;
+  }
 
-  ValueKind get_kind() const { return m_kind; }
+  ValueKind get_kind() const {
+    switch (get_tag()) {
+    case TAG_INT:          return VALUE_INT;
+    case TAG_INTRINSIC_FN: return VALUE_INTRINSIC_FN;
+    default:               return VALUE_FUNCTION;   // the only kind of ValRep
+    }
+  }
 
   // Getters to extract the contents of a Value.
   // The caller should use get_kind() first to determine
   // what kind of data the Value is storing.
 
   int get_ival() const {
-    assert(m_kind == VALUE_INT);
-    return m_atomic.ival;
+    assert(get_tag() == TAG_INT);
+    return int(uint32_t(m_bits >> INT_SHIFT));
   }
 
   Function *get_function() const;
 
   IntrinsicFn get_intrinsic_fn() const {
-    assert(m_kind == VALUE_INTRINSIC_FN);
-    return m_atomic.intrinsic_fn;
+    assert(get_tag() == TAG_INTRINSIC_FN);
+    return reinterpret_cast<IntrinsicFn>(m_bits >> TAG_BITS);
   }
 
   // convert to a string representation
   std::string as_str() const;
 
-  bool is_numeric() const { return m_kind == VALUE_INT; }
-  bool is_dynamic() const { return m_kind >= VALUE_FUNCTION; }
+  bool is_numeric() const { return get_tag() == TAG_INT; }
+  bool is_dynamic() const { return get_tag() == TAG_REP; }
   bool is_atomic() const  { return !is_dynamic(); }
-
-private:
-  // TODO: add additional member functions, if necessary
 };
 
+static_assert(sizeof(Value) == sizeof(void *), "a Value is one word");
+static_assert(sizeof(uintptr_t) >= 8, "an int and its tag fit in a word");
+
 #endif // VALUE_H
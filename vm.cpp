@@ -0,0 +1,160 @@
+#include <cassert>
+#include "arith.h"
+#include "exceptions.h"
+#include "interp.h"
+#include "io.h"
+#include "vm.h"
+
+////////////////////////////////////////////////////////////////////////
+// VM implementation
+////////////////////////////////////////////////////////////////////////
+
+VM::VM(const Bytecode *code, Interpreter *interp)
+  : m_code(code)
+  , m_interp(interp)
+  , m_globals(code->get_num_globals(), 0)
+  , m_func_slots(code->get_num_func_slots(), -1)
+  , m_readint(Interpreter::lookup_intrinsic("readint"))
+  , m_state(VM_FINISHED)
+  , m_result(0) {
+}
+
+VM::~VM() {
+}
+
+Value VM::execute() {
+  start();
+  if (resume() != VM_FINISHED) {
+    RuntimeError::raise("VM: program suspended waiting for input outside of an event loop");
+  }
+  return get_result();
+}
+
+void VM::start() {
+  m_stack.clear();
+  m_locals.clear();
+  m_frames.clear();
+  push_frame(m_code->get_function(0), 0);
+  m_state = VM_RUNNABLE;
+}
+
+VMState VM::resume(unsigned max_instrs) {
+  assert(m_state != VM_FINISHED);
+  for (unsigned count = 0; ; ) {
+    if (max_instrs > 0 && ++count > max_instrs) {
+      return m_state = VM_RUNNABLE;
+    }
+    Frame &frame = m_frames.back();
+    const BytecodeInstr &ins = frame.fn->code[frame.pc++];
+
+    switch (ins.op) {
+      case BC_PUSH:
+        m_stack.push_back(ins.a);
+        break;
+      case BC_POP:
+        m_stack.pop_back();
+        break;
+      case BC_LOAD_LOCAL:
+        m_stack.push_back(m_locals[frame.locals_base + ins.a]);
+        break;
+      case BC_STORE_LOCAL:
+        m_locals[frame.locals_base + ins.a] = m_stack.back();
+        break;
+      case BC_LOAD_GLOBAL:
+        m_stack.push_back(m_globals[ins.a]);
+        break;
+      case BC_STORE_GLOBAL:
+        m_globals[ins.a] = m_stack.back();
+        break;
+      case BC_ADD: { int b = pop(); m_stack.back() = wrap_add(m_stack.back(), b); break; }
+      case BC_SUB: { int b = pop(); m_stack.back() = wrap_sub(m_stack.back(), b); break; }
+      case BC_MUL: { int b = pop(); m_stack.back() = wrap_mul(m_stack.back(), b); break; }
+      case BC_CHKZERO:
+        if (m_stack.back() == 0) EvaluationError::raise(m_code->get_location(ins.b), "Division by zero");
+        break;
+      case BC_DIVR: { int a = pop(); m_stack.back() = wrap_div(a, m_stack.back()); break; }
+      case BC_LT: { int b = pop(); m_stack.back() = m_stack.back() < b; break; }
+      case BC_LE: { int b = pop(); m_stack.back() = m_stack.back() <= b; break; }
+      case BC_GT: { int b = pop(); m_stack.back() = m_stack.back() > b; break; }
+      case BC_GE: { int b = pop(); m_stack.back() = m_stack.back() >= b; break; }
+      case BC_EQ: { int b = pop(); m_stack.back() = m_stack.back() == b; break; }
+      case BC_NE: { int b = pop(); m_stack.back() = m_stack.back() != b; break; }
+      case BC_TRUTH:
+        m_stack.back() = m_stack.back() != 0;
+        break;
+      case BC_JUMP:
+        frame.pc += ins.a;
+        break;
+      case BC_JUMP_IF_FALSE:
+        if (pop() == 0) frame.pc += ins.a;
+        break;
+      case BC_JUMP_IF_TRUE:
+        if (pop() != 0) frame.pc += ins.a;
+        break;
+      case BC_SET_RESULT:
+        frame.result = pop();
+        break;
+      case BC_BIND_FUNC:
+        m_func_slots[ins.a] = ins.b;
+        break;
+      case BC_CALL: {
+        const Location &loc = m_code->get_location(ins.c);
+        if (m_func_slots[ins.a] < 0) {
+          EvaluationError::raise(loc, "Call to undefined function");
+        }
+        const BytecodeFunction *callee = m_code->get_function(m_func_slots[ins.a]);
+        if (callee->num_params != unsigned(ins.b)) {
+          EvaluationError::raise(loc, "Incorect number of function arguments.");
+        }
+        // note that frame is invalidated by push_frame
+        push_frame(callee, unsigned(ins.b));
+        break;
+      }
+      case BC_CALLI: {
+        IntrinsicFn fn = m_code->get_intrinsic(ins.a);
+        if (fn == m_readint && m_interp != nullptr && m_interp->get_io()->would_block()) {
+          // retry the call when resumed
+          frame.pc--;
+          return m_state = VM_WAITING_INPUT;
+        }
+        unsigned arg_ct = unsigned(ins.b);
+        std::vector<Value> args(arg_ct);
+        unsigned base = unsigned(m_stack.size()) - arg_ct;
+        for (unsigned j = 0; j < arg_ct; j++) {
+          args[j] = Value(m_stack[base + j]);
+        }
+        m_stack.resize(base);
+        Value result = fn(args.data(), arg_ct, m_code->get_location(ins.c), m_interp);
+        m_stack.push_back(result.get_ival());
+        break;
+      }
+      case BC_RET: {
+        int result = frame.result;
+        m_locals.resize(frame.locals_base);
+        m_frames.pop_back();
+        if (m_frames.empty()) {
+          m_result = result;
+          return m_state = VM_FINISHED;
+        }
+        m_stack.push_back(result);
+        break;
+      }
+      default:
+        RuntimeError::raise("VM: unexpected opcode %d", int(ins.op));
+    }
+  }
+}
+
+// the arguments are moved from the operand stack into the
+// callee's parameter slots
+void VM::push_frame(const BytecodeFunction *fn, unsigned num_args) {
+  assert(m_stack.size() >= num_args);
+  unsigned base = unsigned(m_locals.size());
+  m_locals.resize(base + fn->num_locals, 0);
+  unsigned arg_base = unsigned(m_stack.size()) - num_args;
+  for (unsigned j = 0; j < num_args; j++) {
+    m_locals[base + j] = m_stack[arg_base + j];
+  }
+  m_stack.resize(arg_base);
+  m_frames.push_back({ fn, 0, base, 0 });
+}
@@ -0,0 +1,73 @@
+#ifndef VM_H
+#define VM_H
+
+#include <vector>
+#include "value.h"
+#include "bytecode.h"
+class Interpreter;
+class IOHandler;
+
+// Stack machine executing Bytecode produced by OnePassCompiler.
+// All execution state (operand stack, local slots, call frames)
+// lives in the VM object rather than on the C++ stack, so deep
+// recursion in the interpreted program does not consume native
+// stack space.
+//
+// Because of this, execution can also be suspended and resumed: when
+// the program calls readint and the IOHandler (of the Interpreter
+// passed to the VM) would block, resume() returns instead, and a later
+// call continues from the same point. An event loop can thus run many
+// programs on one thread (see sessions.h).
+enum VMState {
+  VM_RUNNABLE,          // started, or stopped at the end of a time slice
+  VM_WAITING_INPUT,     // suspended in readint
+  VM_FINISHED,
+};
+
+class VM {
+private:
+  struct Frame {
+    const BytecodeFunction *fn;
+    unsigned pc;
+    unsigned locals_base;
+    int result;           // value of the most recently executed statement
+  };
+
+  const Bytecode *m_code;
+  Interpreter *m_interp;
+  std::vector<int> m_stack;
+  std::vector<int> m_locals;
+  std::vector<int> m_globals;
+  std::vector<int> m_func_slots;  // function index bound to each slot, or -1
+  std::vector<Frame> m_frames;
+  IntrinsicFn m_readint;
+  VMState m_state;
+  int m_result;
+
+  // value semantics prohibited
+  VM(const VM &);
+  VM &operator=(const VM &);
+
+public:
+  // the Interpreter (which may be null) is passed to intrinsic functions
+  VM(const Bytecode *code, Interpreter *interp = nullptr);
+  ~VM();
+
+  // run the program to completion
+  Value execute();
+
+  // Suspendable use: start() sets up a run of the program, and each
+  // call to resume() continues it until it finishes, waits for input,
+  // or (if max_instrs is nonzero) has executed max_instrs instructions.
+  void start();
+  VMState resume(unsigned max_instrs = 0);
+  VMState get_state() const { return m_state; }
+  // the program's result, once it has finished
+  Value get_result() const { return Value(m_result); }
+
+private:
+  void push_frame(const BytecodeFunction *fn, unsigned num_args);
+  int pop() { int v = m_stack.back(); m_stack.pop_back(); return v; }
+};
+
+#endif // VM_H